@@ -0,0 +1,162 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+enum AntiAliasingMode
+{
+	AA_NONE,
+	AA_MSAA,		// Multisampled scene target, resolved by a blit; forward shading only (the G-buffer has one sample)
+	AA_FXAA,		// Post-process: blur along the local luma gradient (fxaa.frag)
+	AA_SMAA,		// Post-process: edge runs measured and blended by their shape in one pass (smaa_lite.frag)
+	AA_MODE_COUNT
+};
+
+// Samples per pixel of the MSAA mode, fewer when the driver supports fewer
+const GLsizei AA_SAMPLES = 4;
+
+// Selectable anti-aliasing. Begin hands out the target the scene is drawn into for the mode, Resolve turns it into
+// the frame in target: the samples are resolved, or the post-process program reads the scene and writes the
+// smoothed result. Both targets outlive the frame like the damage tracker's, so a scissored partial redraw only
+// touches what changed; the post-processes read pixels beyond the changed ones and need whole frames.
+class AntiAliasing
+{
+public:
+	AntiAliasingMode Mode;
+	GLsizei Samples;
+
+	AntiAliasing(GLsizei width, GLsizei height) : Mode(AA_NONE), Samples(AA_SAMPLES), width(width), height(height), active(AA_NONE)
+	{
+		GLint maxSamples = 0;
+		glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+		this->Samples = std::min(this->Samples, (GLsizei)maxSamples);
+
+		glGenRenderbuffers(2, this->multisampleBuffers);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->multisampleBuffers[0]);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->Samples, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->multisampleBuffers[1]);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->Samples, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glGenFramebuffers(1, &this->multisampleFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->multisampleFramebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->multisampleBuffers[0]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->multisampleBuffers[1]);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::ANTIALIASING::MULTISAMPLE_INCOMPLETE" << std::endl;
+
+		// The post-processes sample the scene bilinearly between pixels
+		glGenTextures(1, &this->sceneTexture);
+		glBindTexture(GL_TEXTURE_2D, this->sceneTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glGenRenderbuffers(1, &this->sceneDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->sceneDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glGenFramebuffers(1, &this->sceneFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->sceneFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->sceneTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->sceneDepth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::ANTIALIASING::SCENE_INCOMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glGenVertexArrays(1, &this->fullscreenVAO);
+	}
+
+	~AntiAliasing()
+	{
+		glDeleteFramebuffers(1, &this->multisampleFramebuffer);
+		glDeleteFramebuffers(1, &this->sceneFramebuffer);
+		glDeleteRenderbuffers(2, this->multisampleBuffers);
+		glDeleteRenderbuffers(1, &this->sceneDepth);
+		glDeleteTextures(1, &this->sceneTexture);
+		glDeleteVertexArrays(1, &this->fullscreenVAO);
+	}
+
+	static const char* Name(AntiAliasingMode mode)
+	{
+		const char* names[AA_MODE_COUNT] = { "none", "msaa", "fxaa", "smaa" };
+		return mode < AA_MODE_COUNT ? names[mode] : "none";
+	}
+
+	// Mode by its Name, AA_NONE for anything else
+	static AntiAliasingMode Parse(const std::string& name)
+	{
+		for (int mode = 0; mode < AA_MODE_COUNT; mode++)
+			if (name == Name((AntiAliasingMode)mode))
+				return (AntiAliasingMode)mode;
+		std::cout << "ERROR::ANTIALIASING::UNKNOWN_MODE " << name << std::endl;
+		return AA_NONE;
+	}
+
+	// The mode the frame being drawn uses: Mode, unless that is MSAA and the frame cannot be multisampled
+	AntiAliasingMode Active(bool multisampled) const
+	{
+		return this->Mode == AA_MSAA && !multisampled ? AA_NONE : this->Mode;
+	}
+
+	bool IsPostProcess(bool multisampled) const
+	{
+		AntiAliasingMode mode = this->Active(multisampled);
+		return mode == AA_FXAA || mode == AA_SMAA;
+	}
+
+	// Binds and clears the target the scene is drawn into for the mode and returns it, target itself (left bound
+	// as it is) without one. The clear stays within the scissor like the damage tracker's
+	GLuint Begin(GLuint target, const glm::vec3& clearColor, bool multisampled)
+	{
+		this->active = this->Active(multisampled);
+		if (this->active == AA_NONE)
+			return target;
+		GLuint framebuffer = this->active == AA_MSAA ? this->multisampleFramebuffer : this->sceneFramebuffer;
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glClearColor(clearColor.x, clearColor.y, clearColor.z, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		return framebuffer;
+	}
+
+	// Writes the scene drawn since Begin to target. program is the post-process of the mode (fullscreen.vs with
+	// fxaa.frag or smaa_lite.frag), unused for the others
+	void Resolve(GLuint program, GLuint target)
+	{
+		if (this->active == AA_MSAA)
+		{
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, this->multisampleFramebuffer);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+			glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
+		else if (this->active != AA_NONE)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, target);
+			glUseProgram(program);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, this->sceneTexture);
+			glUniform1i(glGetUniformLocation(program, "scene"), 0);
+			glUniform2f(glGetUniformLocation(program, "texelSize"), 1.0f / this->width, 1.0f / this->height);
+			glDisable(GL_DEPTH_TEST);
+			glBindVertexArray(this->fullscreenVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			glBindVertexArray(0);
+			glEnable(GL_DEPTH_TEST);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+	}
+
+private:
+	GLsizei width, height;
+	AntiAliasingMode active;
+	GLuint multisampleFramebuffer, multisampleBuffers[2];
+	GLuint sceneFramebuffer, sceneTexture, sceneDepth;
+	GLuint fullscreenVAO;
+};
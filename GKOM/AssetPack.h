@@ -0,0 +1,424 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Every entry starts on this boundary, so mesh and texture data can be handed to glBufferData/glTexImage2D as is
+const unsigned int PAK_ALIGNMENT = 256;
+const unsigned int PAK_VERSION = 1;
+const unsigned int PAK_FLAG_LZ4 = 1;
+
+// Read-only window on an asset's bytes. Views point into the mapped pack (or into storage owned by the
+// AssetPack for compressed entries and loose files) and stay valid as long as the pack is alive.
+struct AssetView
+{
+	const unsigned char* Data;
+	size_t Size;
+
+	AssetView() : Data(NULL), Size(0) {}
+	AssetView(const unsigned char* data, size_t size) : Data(data), Size(size) {}
+	bool IsValid() const { return this->Data != NULL; }
+};
+
+// Single-file asset pack (.pak): header, aligned entry data, then a table of entries sorted by name.
+// The runtime maps the file and returns zero-copy views; entries compressed with LZ4 are inflated once
+// on first access. Names missing from the pack are read from loose files, so development works without a pack.
+class AssetPack
+{
+public:
+	struct Header
+	{
+		char Magic[4];			// "GPAK"
+		unsigned int Version;
+		unsigned int EntryCount;
+		unsigned int Alignment;
+		unsigned long long TableOffset;
+	};
+	struct Entry
+	{
+		char Name[64];			// Zero padded path relative to the working directory
+		unsigned long long Offset;
+		unsigned long long Size;		// Stored size
+		unsigned long long OriginalSize;	// Size after decompression
+		unsigned int Flags;
+		unsigned int Reserved;
+	};
+
+	AssetPack() : base(NULL), mappedSize(0), header(NULL), entries(NULL)
+#ifdef _WIN32
+		, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+	{
+	}
+
+	~AssetPack()
+	{
+		this->Close();
+	}
+
+	// Pack the application reads its shaders, textures and meshes from
+	static AssetPack& Default()
+	{
+		static AssetPack pack;
+		return pack;
+	}
+
+	// Maps a pack file, returns false (and keeps serving loose files) if it is missing or malformed
+	bool Open(const std::string& path)
+	{
+		this->Close();
+#ifdef _WIN32
+		this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (this->file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		GetFileSizeEx(this->file, &size);
+		this->mappedSize = (size_t)size.QuadPart;
+		this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (this->mapping != NULL)
+			this->base = (const unsigned char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0)
+		{
+			this->mappedSize = (size_t)info.st_size;
+			void* address = mmap(NULL, this->mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			this->base = address != MAP_FAILED ? (const unsigned char*)address : NULL;
+		}
+		close(fd);
+#endif
+		if (this->base == NULL || this->mappedSize < sizeof(Header))
+		{
+			this->Close();
+			return false;
+		}
+		this->header = (const Header*)this->base;
+		if (memcmp(this->header->Magic, "GPAK", 4) != 0 || this->header->Version != PAK_VERSION
+			|| this->header->TableOffset + (unsigned long long)this->header->EntryCount * sizeof(Entry) > this->mappedSize)
+		{
+			std::cout << "ERROR::ASSET_PACK::INVALID_PACK " << path << std::endl;
+			this->Close();
+			return false;
+		}
+		this->entries = (const Entry*)(this->base + this->header->TableOffset);
+		for (unsigned int i = 0; i < this->header->EntryCount; i++)
+			if (this->entries[i].Offset + this->entries[i].Size > this->mappedSize)
+			{
+				std::cout << "ERROR::ASSET_PACK::ENTRY_OUT_OF_RANGE " << path << std::endl;
+				this->Close();
+				return false;
+			}
+		return true;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (this->base != NULL)
+			UnmapViewOfFile(this->base);
+		if (this->mapping != NULL)
+			CloseHandle(this->mapping);
+		if (this->file != INVALID_HANDLE_VALUE)
+			CloseHandle(this->file);
+		this->mapping = NULL;
+		this->file = INVALID_HANDLE_VALUE;
+#else
+		if (this->base != NULL)
+			munmap((void*)this->base, this->mappedSize);
+#endif
+		this->base = NULL;
+		this->mappedSize = 0;
+		this->header = NULL;
+		this->entries = NULL;
+		this->inflated.clear();
+	}
+
+	bool IsOpen()
+	{
+		return this->base != NULL;
+	}
+
+	// Returns the bytes of an asset: straight from the mapping when stored, inflated once when compressed,
+	// or read from a loose file when the pack does not have it. Invalid view if the asset does not exist.
+	AssetView Read(const std::string& name)
+	{
+		std::map<std::string, std::vector<unsigned char> >::iterator cached = this->inflated.find(name);
+		if (cached != this->inflated.end())
+			return view(cached->second);
+
+		const Entry* entry = this->find(name);
+		if (entry != NULL && !(entry->Flags & PAK_FLAG_LZ4))
+			return AssetView(this->base + entry->Offset, (size_t)entry->Size);
+
+		std::vector<unsigned char>& storage = this->inflated[name];
+		if (entry != NULL)
+		{
+			storage.resize((size_t)entry->OriginalSize);
+			if (!Lz4Decompress(this->base + entry->Offset, (size_t)entry->Size, storage.empty() ? NULL : &storage[0], storage.size()))
+			{
+				std::cout << "ERROR::ASSET_PACK::CORRUPT_ENTRY " << name << std::endl;
+				this->inflated.erase(name);
+				return AssetView();
+			}
+			return view(storage);
+		}
+		if (!readFile(name, storage))
+		{
+			this->inflated.erase(name);
+			return AssetView();
+		}
+		return view(storage);
+	}
+
+	// Drops the storage behind a compressed entry or loose file once its contents have been consumed,
+	// views returned for that name become invalid
+	void Release(const std::string& name)
+	{
+		this->inflated.erase(name);
+	}
+
+	// Offline step: writes the given files into one pack. Entries are LZ4 compressed when that saves at least
+	// an eighth of their size (shaders, raw data); already compressed files such as JPEGs are stored as is.
+	static bool Build(const std::string& packPath, const std::vector<std::string>& files, bool compress = true)
+	{
+		std::ofstream pack(packPath.c_str(), std::ios::binary);
+		if (!pack)
+		{
+			std::cout << "ERROR::ASSET_PACK::CANNOT_WRITE " << packPath << std::endl;
+			return false;
+		}
+		std::vector<Entry> table;
+		Header header;
+		memcpy(header.Magic, "GPAK", 4);
+		header.Version = PAK_VERSION;
+		header.Alignment = PAK_ALIGNMENT;
+		header.EntryCount = 0;
+		header.TableOffset = 0;
+		pack.write((const char*)&header, sizeof(header));
+		unsigned long long offset = sizeof(header);
+
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			std::vector<unsigned char> data;
+			if (!readFile(files[i], data) || files[i].size() >= sizeof(((Entry*)0)->Name))
+			{
+				std::cout << "ERROR::ASSET_PACK::CANNOT_ADD " << files[i] << std::endl;
+				return false;
+			}
+			Entry entry;
+			memset(&entry, 0, sizeof(entry));
+			strncpy(entry.Name, files[i].c_str(), sizeof(entry.Name) - 1);
+			entry.OriginalSize = data.size();
+			if (compress && !data.empty())
+			{
+				std::vector<unsigned char> packed = Lz4Compress(&data[0], data.size());
+				if (packed.size() <= data.size() - data.size() / 8)
+				{
+					data.swap(packed);
+					entry.Flags |= PAK_FLAG_LZ4;
+				}
+			}
+			// Pad up to the alignment so the entry starts on a PAK_ALIGNMENT boundary
+			static const char zeros[PAK_ALIGNMENT] = { 0 };
+			unsigned long long padding = (PAK_ALIGNMENT - offset % PAK_ALIGNMENT) % PAK_ALIGNMENT;
+			pack.write(zeros, (std::streamsize)padding);
+			offset += padding;
+			entry.Offset = offset;
+			entry.Size = data.size();
+			if (!data.empty())
+				pack.write((const char*)&data[0], (std::streamsize)data.size());
+			offset += data.size();
+			table.push_back(entry);
+		}
+
+		// Table sorted by name, lookups binary search it straight from the mapping
+		std::sort(table.begin(), table.end(), [](const Entry& a, const Entry& b) { return strcmp(a.Name, b.Name) < 0; });
+		unsigned long long padding = (8 - offset % 8) % 8;
+		pack.write("\0\0\0\0\0\0\0", (std::streamsize)padding);
+		header.TableOffset = offset + padding;
+		header.EntryCount = (unsigned int)table.size();
+		if (!table.empty())
+			pack.write((const char*)&table[0], (std::streamsize)(table.size() * sizeof(Entry)));
+		pack.seekp(0);
+		pack.write((const char*)&header, sizeof(header));
+		return pack.good();
+	}
+
+	// LZ4 block format compressor, greedy matching with a single-entry hash table
+	static std::vector<unsigned char> Lz4Compress(const unsigned char* source, size_t size)
+	{
+		const int HASH_BITS = 16;
+		std::vector<unsigned char> out;
+		out.reserve(size + size / 255 + 16);
+		std::vector<int> table(1 << HASH_BITS, -1);
+		size_t anchor = 0, i = 0;
+		// The format ends with at least 5 literals and the last match starts 12 bytes before the end
+		if (size >= 13)
+		{
+			while (i < size - 12)
+			{
+				unsigned int sequence = read32(source + i);
+				unsigned int hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+				int candidate = table[hash];
+				table[hash] = (int)i;
+				if (candidate < 0 || i - candidate > 65535 || read32(source + candidate) != sequence)
+				{
+					i++;
+					continue;
+				}
+				size_t length = 4;
+				while (i + length < size - 5 && source[candidate + length] == source[i + length])
+					length++;
+				lz4Emit(out, source + anchor, i - anchor, (unsigned int)(i - candidate), length);
+				i += length;
+				anchor = i;
+			}
+		}
+		lz4Emit(out, source + anchor, size - anchor, 0, 0);
+		return out;
+	}
+
+	// LZ4 block format decompressor, fails on any out-of-range length or offset
+	static bool Lz4Decompress(const unsigned char* source, size_t size, unsigned char* destination, size_t destinationSize)
+	{
+		const unsigned char* ip = source;
+		const unsigned char* end = source + size;
+		unsigned char* op = destination;
+		unsigned char* outEnd = destination + destinationSize;
+		while (ip < end)
+		{
+			unsigned int token = *ip++;
+			size_t literals = token >> 4;
+			if (literals == 15 && !lz4Length(ip, end, literals))
+				return false;
+			if ((size_t)(end - ip) < literals || (size_t)(outEnd - op) < literals)
+				return false;
+			memcpy(op, ip, literals);
+			ip += literals;
+			op += literals;
+			if (ip == end)
+				break;
+			if (end - ip < 2)
+				return false;
+			size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			size_t length = token & 15;
+			if (length == 15 && !lz4Length(ip, end, length))
+				return false;
+			length += 4;
+			if (offset == 0 || offset > (size_t)(op - destination) || (size_t)(outEnd - op) < length)
+				return false;
+			// Byte copy, matches may overlap their own output
+			const unsigned char* match = op - offset;
+			for (size_t i = 0; i < length; i++)
+				op[i] = match[i];
+			op += length;
+		}
+		return op == outEnd;
+	}
+
+private:
+	const unsigned char* base;
+	size_t mappedSize;
+	const Header* header;
+	const Entry* entries;
+	std::map<std::string, std::vector<unsigned char> > inflated;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+
+	const Entry* find(const std::string& name)
+	{
+		if (this->entries == NULL)
+			return NULL;
+		const Entry* first = this->entries;
+		const Entry* last = this->entries + this->header->EntryCount;
+		const Entry* entry = std::lower_bound(first, last, name, [](const Entry& e, const std::string& key) { return strncmp(e.Name, key.c_str(), sizeof(e.Name)) < 0; });
+		if (entry != last && strncmp(entry->Name, name.c_str(), sizeof(entry->Name)) == 0)
+			return entry;
+		return NULL;
+	}
+
+	static AssetView view(const std::vector<unsigned char>& storage)
+	{
+		static const unsigned char empty = 0;
+		return AssetView(storage.empty() ? &empty : &storage[0], storage.size());
+	}
+
+	static bool readFile(const std::string& path, std::vector<unsigned char>& data)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		file.seekg(0, std::ios::end);
+		data.resize((size_t)file.tellg());
+		file.seekg(0, std::ios::beg);
+		if (!data.empty())
+			file.read((char*)&data[0], (std::streamsize)data.size());
+		return file.good();
+	}
+
+	static unsigned int read32(const unsigned char* p)
+	{
+		unsigned int value;
+		memcpy(&value, p, 4);
+		return value;
+	}
+
+	static bool lz4Length(const unsigned char*& ip, const unsigned char* end, size_t& length)
+	{
+		unsigned int byte;
+		do
+		{
+			if (ip == end)
+				return false;
+			byte = *ip++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	static void lz4PutLength(std::vector<unsigned char>& out, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+			out.push_back(255);
+		out.push_back((unsigned char)length);
+	}
+
+	// One sequence: literals followed by a match; a zero length match marks the final literal run
+	static void lz4Emit(std::vector<unsigned char>& out, const unsigned char* literals, size_t literalCount, unsigned int offset, size_t matchLength)
+	{
+		size_t matchCode = matchLength >= 4 ? matchLength - 4 : 0;
+		out.push_back((unsigned char)((std::min(literalCount, (size_t)15) << 4) | std::min(matchCode, (size_t)15)));
+		if (literalCount >= 15)
+			lz4PutLength(out, literalCount - 15);
+		out.insert(out.end(), literals, literals + literalCount);
+		if (matchLength == 0)
+			return;
+		out.push_back((unsigned char)(offset & 0xFF));
+		out.push_back((unsigned char)(offset >> 8));
+		if (matchCode >= 15)
+			lz4PutLength(out, matchCode - 15);
+	}
+};
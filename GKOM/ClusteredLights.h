@@ -0,0 +1,261 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// SSE2 is the baseline for the x86/x64 targets we build, other targets use the scalar path
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLUSTER_SIMD 1
+#include <emmintrin.h>
+#endif
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Cluster grid: screen tiles by exponential depth slices between the near and far plane. Has to match gkom.frag.
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// A light stops at the distance where its brightest term has fallen to this fraction
+const GLfloat LIGHT_CUTOFF = 1.0f / 256.0f;
+
+struct PointLight
+{
+	glm::vec3 Position;
+	glm::vec3 Ambient;
+	glm::vec3 Diffuse;
+	glm::vec3 Specular;
+	GLfloat Constant;
+	GLfloat Linear;
+	GLfloat Quadratic;
+	GLfloat Radius;
+
+	PointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, GLfloat constant = 1.0f, GLfloat linear = 0.09f, GLfloat quadratic = 0.032f)
+		: Position(position), Ambient(ambient), Diffuse(diffuse), Specular(specular), Constant(constant), Linear(linear), Quadratic(quadratic)
+	{
+		// Solve peak / (constant + linear * d + quadratic * d^2) = cutoff for d
+		GLfloat peak = std::max(glm::max(ambient.x, glm::max(ambient.y, ambient.z)), std::max(glm::max(diffuse.x, glm::max(diffuse.y, diffuse.z)), glm::max(specular.x, glm::max(specular.y, specular.z))));
+		GLfloat c = constant - peak / LIGHT_CUTOFF;
+		if (c >= 0.0f)
+			this->Radius = 0.0f;
+		else if (quadratic > 0.0f)
+			this->Radius = (-linear + sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+		else
+			this->Radius = linear > 0.0f ? -c / linear : 1e30f;
+	}
+};
+
+// Clustered forward shading: every frame the lights are binned into view space clusters on the CPU, four clusters
+// per SSE sphere-vs-box test, and the fragment shader only loops over the lights of the cluster it falls in.
+// Lights, the per-cluster (offset, count) table and the light index list are uploaded as texture buffers.
+class ClusteredLights
+{
+public:
+	std::vector<PointLight> Lights;
+	// Light/cluster pairs binned in the last update
+	GLuint AssignedCount;
+
+	ClusteredLights() : AssignedCount(0), fovy(0.0f), aspect(0.0f), nearPlane(0.0f), farPlane(0.0f)
+	{
+		glGenBuffers(3, this->buffers);
+		glGenTextures(3, this->textures);
+		const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+		for (int i = 0; i < 3; i++)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[i]);
+			glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], this->buffers[i]);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	~ClusteredLights()
+	{
+		glDeleteTextures(3, this->textures);
+		glDeleteBuffers(3, this->buffers);
+	}
+
+	// Bins the lights for this frame's camera and uploads the result. fovy is passed the way glm::perspective takes it.
+	void Update(const glm::mat4& view, GLfloat fovy, GLfloat aspect, GLfloat nearPlane, GLfloat farPlane)
+	{
+		if (fovy != this->fovy || aspect != this->aspect || nearPlane != this->nearPlane || farPlane != this->farPlane)
+			this->buildClusterBounds(fovy, aspect, nearPlane, farPlane);
+
+		std::vector<GLuint> counts(CLUSTER_COUNT, 0);
+		this->pairs.clear();
+		GLfloat sliceScale = CLUSTER_Z / log(farPlane / nearPlane);
+		for (size_t l = 0; l < this->Lights.size(); l++)
+		{
+			const PointLight& light = this->Lights[l];
+			glm::vec3 centre = glm::vec3(view * glm::vec4(light.Position, 1.0f));
+			GLfloat radius = light.Radius;
+			// Depth range of the sphere gives the slices, then every tile of those slices is tested four at a time
+			GLfloat nearest = -centre.z - radius, farthest = -centre.z + radius;
+			if (farthest < nearPlane || nearest > farPlane)
+				continue;
+			int firstSlice = std::max(0, (int)floor(log(std::max(nearest, nearPlane) / nearPlane) * sliceScale));
+			int lastSlice = std::min(CLUSTER_Z - 1, (int)floor(log(std::min(farthest, farPlane) / nearPlane) * sliceScale));
+
+			for (int slice = firstSlice; slice <= lastSlice; slice++)
+			{
+				int tile = 0;
+#ifdef CLUSTER_SIMD
+				__m128 cx = _mm_set1_ps(centre.x), cy = _mm_set1_ps(centre.y), cz = _mm_set1_ps(centre.z);
+				__m128 radiusSquared = _mm_set1_ps(radius * radius), zero = _mm_setzero_ps();
+				for (; tile + 4 <= CLUSTER_X * CLUSTER_Y; tile += 4)
+				{
+					int cluster = slice * CLUSTER_X * CLUSTER_Y + tile;
+					// Per axis distance outside the box: max(min - c, 0) + max(c - max, 0)
+					__m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minX[cluster]), cx), zero), _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&this->maxX[cluster])), zero));
+					__m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minY[cluster]), cy), zero), _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&this->maxY[cluster])), zero));
+					__m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minZ[cluster]), cz), zero), _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&this->maxZ[cluster])), zero));
+					__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					int hits = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared));
+					for (int k = 0; hits != 0; k++, hits >>= 1)
+						if (hits & 1)
+						{
+							counts[cluster + k]++;
+							this->pairs.push_back(std::make_pair((GLuint)(cluster + k), (GLuint)l));
+						}
+				}
+#endif
+				for (; tile < CLUSTER_X * CLUSTER_Y; tile++)
+				{
+					int cluster = slice * CLUSTER_X * CLUSTER_Y + tile;
+					GLfloat dx = std::max(this->minX[cluster] - centre.x, 0.0f) + std::max(centre.x - this->maxX[cluster], 0.0f);
+					GLfloat dy = std::max(this->minY[cluster] - centre.y, 0.0f) + std::max(centre.y - this->maxY[cluster], 0.0f);
+					GLfloat dz = std::max(this->minZ[cluster] - centre.z, 0.0f) + std::max(centre.z - this->maxZ[cluster], 0.0f);
+					if (dx * dx + dy * dy + dz * dz <= radius * radius)
+					{
+						counts[cluster]++;
+						this->pairs.push_back(std::make_pair((GLuint)cluster, (GLuint)l));
+					}
+				}
+			}
+		}
+
+		// Counting sort of the pairs into one index list, each cluster gets (offset, count)
+		std::vector<GLuint> table(CLUSTER_COUNT * 2);
+		GLuint offset = 0;
+		for (int c = 0; c < CLUSTER_COUNT; c++)
+		{
+			table[c * 2] = offset;
+			table[c * 2 + 1] = 0;
+			offset += counts[c];
+		}
+		std::vector<GLuint> indices(std::max(offset, 1u));
+		for (size_t i = 0; i < this->pairs.size(); i++)
+		{
+			GLuint cluster = this->pairs[i].first;
+			indices[table[cluster * 2] + table[cluster * 2 + 1]++] = this->pairs[i].second;
+		}
+		this->AssignedCount = offset;
+		upload(this->buffers[1], &table[0], table.size() * sizeof(GLuint));
+		upload(this->buffers[2], &indices[0], indices.size() * sizeof(GLuint));
+		this->UploadLights();
+	}
+
+	// Light parameters only, for renderers that do not need the clusters (deferred light volumes)
+	void UploadLights()
+	{
+		std::vector<GLfloat> lightData(std::max(this->Lights.size(), (size_t)1) * 16, 0.0f);
+		for (size_t l = 0; l < this->Lights.size(); l++)
+		{
+			const PointLight& light = this->Lights[l];
+			GLfloat texels[16] = {
+				light.Position.x, light.Position.y, light.Position.z, light.Radius,
+				light.Ambient.x, light.Ambient.y, light.Ambient.z, light.Constant,
+				light.Diffuse.x, light.Diffuse.y, light.Diffuse.z, light.Linear,
+				light.Specular.x, light.Specular.y, light.Specular.z, light.Quadratic };
+			std::copy(texels, texels + 16, lightData.begin() + l * 16);
+		}
+		upload(this->buffers[0], &lightData[0], lightData.size() * sizeof(GLfloat));
+	}
+
+	// Texture buffer with 4 RGBA32F texels per light: position and radius, then ambient, diffuse and specular
+	// colors with the constant, linear and quadratic attenuation factors in their alpha
+	GLuint LightTexture() const
+	{
+		return this->textures[0];
+	}
+
+	void Bind(GLuint program, GLint lightUnit, GLint clusterUnit, GLint indexUnit, GLsizei width, GLsizei height)
+	{
+		const GLint units[3] = { lightUnit, clusterUnit, indexUnit };
+		const char* names[3] = { "lightData", "lightClusters", "lightIndices" };
+		for (int i = 0; i < 3; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + units[i]);
+			glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+			glUniform1i(glGetUniformLocation(program, names[i]), units[i]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+		GLfloat sliceScale = CLUSTER_Z / log(this->farPlane / this->nearPlane);
+		glUniform2f(glGetUniformLocation(program, "clusterTileSize"), (GLfloat)width / CLUSTER_X, (GLfloat)height / CLUSTER_Y);
+		glUniform2f(glGetUniformLocation(program, "clusterSlice"), sliceScale, -log(this->nearPlane) * sliceScale);
+	}
+
+private:
+	GLuint buffers[3];
+	GLuint textures[3];
+	GLfloat fovy, aspect, nearPlane, farPlane;
+	// View space bounding boxes of the clusters, one array per component so SSE can load four clusters at once
+	std::vector<GLfloat> minX, minY, minZ, maxX, maxY, maxZ;
+	std::vector<std::pair<GLuint, GLuint> > pairs;
+
+	// Only depends on the projection, so it is rebuilt when zooming rather than every frame
+	void buildClusterBounds(GLfloat fovy, GLfloat aspect, GLfloat nearPlane, GLfloat farPlane)
+	{
+		this->fovy = fovy;
+		this->aspect = aspect;
+		this->nearPlane = nearPlane;
+		this->farPlane = farPlane;
+		GLfloat tanY = fabs(tan(fovy * 0.5f)), tanX = tanY * aspect;
+		this->minX.resize(CLUSTER_COUNT);
+		this->minY.resize(CLUSTER_COUNT);
+		this->minZ.resize(CLUSTER_COUNT);
+		this->maxX.resize(CLUSTER_COUNT);
+		this->maxY.resize(CLUSTER_COUNT);
+		this->maxZ.resize(CLUSTER_COUNT);
+		for (int z = 0; z < CLUSTER_Z; z++)
+		{
+			GLfloat depths[2] = { nearPlane * std::pow(farPlane / nearPlane, (GLfloat)z / CLUSTER_Z), nearPlane * std::pow(farPlane / nearPlane, (GLfloat)(z + 1) / CLUSTER_Z) };
+			for (int y = 0; y < CLUSTER_Y; y++)
+				for (int x = 0; x < CLUSTER_X; x++)
+				{
+					glm::vec3 lower(1e30f), upper(-1e30f);
+					// Box around the eight corners: the tile's edge rays cut at the slice's near and far depth
+					for (int d = 0; d < 2; d++)
+						for (int corner = 0; corner < 4; corner++)
+						{
+							GLfloat ndcX = -1.0f + 2.0f * (x + (corner & 1)) / CLUSTER_X;
+							GLfloat ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / CLUSTER_Y;
+							glm::vec3 point(ndcX * tanX * depths[d], ndcY * tanY * depths[d], -depths[d]);
+							lower = glm::min(lower, point);
+							upper = glm::max(upper, point);
+						}
+					int cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+					this->minX[cluster] = lower.x;
+					this->minY[cluster] = lower.y;
+					this->minZ[cluster] = lower.z;
+					this->maxX[cluster] = upper.x;
+					this->maxY[cluster] = upper.y;
+					this->maxZ[cluster] = upper.z;
+				}
+		}
+	}
+
+	static void upload(GLuint buffer, const void* data, size_t size)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		// Respecifying the whole store orphans last frame's copy, so there is no wait for the GPU to finish reading it
+		glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+};
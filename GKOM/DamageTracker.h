@@ -0,0 +1,257 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// GL Includes
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "Hash.h"
+
+// Pixels added around a moving object's projected box, for its edge pixels and the interpolated normals of them
+const GLint DAMAGE_MARGIN = 2;
+
+// Screen rectangle in pixels, lower left origin like glScissor
+struct DamageRect
+{
+	GLint X, Y, Width, Height;
+
+	DamageRect() : X(0), Y(0), Width(0), Height(0) {}
+	DamageRect(GLint x, GLint y, GLint width, GLint height) : X(x), Y(y), Width(width), Height(height) {}
+
+	bool IsEmpty() const
+	{
+		return this->Width <= 0 || this->Height <= 0;
+	}
+
+	DamageRect Union(const DamageRect& other) const
+	{
+		if (this->IsEmpty())
+			return other;
+		if (other.IsEmpty())
+			return *this;
+		GLint x = std::min(this->X, other.X), y = std::min(this->Y, other.Y);
+		return DamageRect(x, y, std::max(this->X + this->Width, other.X + other.Width) - x, std::max(this->Y + this->Height, other.Y + other.Height) - y);
+	}
+};
+
+// Redraws only what changed. The frame is rendered into an offscreen color and depth target that outlives it,
+// and every frame collects what it would show:
+//   - Global state (camera, toggles, lights, ...) is hashed, any difference repaints the whole frame;
+//   - moving objects give their world box, a moved object damages the screen rectangles it covered last frame
+//     and covers now, and only that rectangle is cleared and drawn again (scissored);
+//   - with no change at all the frame is idle: nothing is drawn or presented and Wait blocks in glfwWaitEvents.
+// Present copies the target to the window, whose back buffer is undefined after a swap.
+class DamageTracker
+{
+public:
+	GLuint Framebuffer, ColorTexture, DepthTexture;
+
+	DamageTracker(GLsizei width, GLsizei height) : width(width), height(height), key(0), lastKey(0), full(true), hasFrame(false), armed(false), quit(false)
+	{
+		glGenTextures(1, &this->ColorTexture);
+		glBindTexture(GL_TEXTURE_2D, this->ColorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glGenTextures(1, &this->DepthTexture);
+		glBindTexture(GL_TEXTURE_2D, this->DepthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &this->Framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->Framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->ColorTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->DepthTexture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::DAMAGE::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		this->waker = std::thread(&DamageTracker::wake, this);
+	}
+
+	~DamageTracker()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->quit = true;
+		}
+		this->changed.notify_one();
+		this->waker.join();
+		glDeleteFramebuffers(1, &this->Framebuffer);
+		glDeleteTextures(1, &this->ColorTexture);
+		glDeleteTextures(1, &this->DepthTexture);
+	}
+
+	// Starts collecting the state of a frame
+	void Begin(const glm::mat4& viewProjection)
+	{
+		this->key = Hash::Seed;
+		this->viewProjection = viewProjection;
+		this->damage = DamageRect();
+		this->Global(viewProjection);
+	}
+
+	// Anything whose change shows all over the frame
+	template <typename T> void Global(const T& value)
+	{
+		Hash::Bytes(this->key, &value, sizeof(T));
+	}
+
+	// Repaints everything, e.g. a reloaded shader or streamed texture tiles
+	void Invalidate()
+	{
+		this->full = true;
+	}
+
+	// A moving object with the model space box lower .. upper. id is its slot, the same one every frame. When its
+	// movement shows outside its own box (the shadows it casts), pass spills and a move repaints everything
+	void Object(size_t id, const glm::mat4& model, const glm::vec3& lower, const glm::vec3& upper, bool spills = false)
+	{
+		if (id >= this->objects.size())
+			this->objects.resize(id + 1);
+		ObjectState& object = this->objects[id];
+		DamageRect covered = this->project(model, lower, upper);
+		if (!object.Seen || object.Model != model)
+		{
+			if (spills)
+				this->full = true;
+			this->damage = this->damage.Union(object.Covered).Union(covered);
+		}
+		object.Seen = true;
+		object.Model = model;
+		object.Covered = covered;
+	}
+
+	// Nothing to draw this frame
+	bool IsIdle() const
+	{
+		return this->hasFrame && !this->full && this->key == this->lastKey && this->damage.IsEmpty();
+	}
+
+	// The part of the frame to draw again, the whole frame when the global state changed
+	DamageRect Damage() const
+	{
+		if (!this->hasFrame || this->full || this->key != this->lastKey)
+			return DamageRect(0, 0, this->width, this->height);
+		return this->damage;
+	}
+
+	// Binds the frame's target with the scissor on the damage and clears that part of it. The scissor stays
+	// on for the shading passes, which then only touch what is drawn again
+	void BeginFrame(const glm::vec3& clearColor)
+	{
+		DamageRect rect = this->Damage();
+		glBindFramebuffer(GL_FRAMEBUFFER, this->Framebuffer);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(rect.X, rect.Y, rect.Width, rect.Height);
+		glClearColor(clearColor.x, clearColor.y, clearColor.z, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// Ends the scissored passes. The state collected since Begin becomes what the next frame is compared with
+	void EndFrame()
+	{
+		glDisable(GL_SCISSOR_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		this->lastKey = this->key;
+		this->full = false;
+		this->hasFrame = true;
+	}
+
+	// Copies the frame to the window's back buffer, the caller swaps
+	void Present()
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, this->Framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// Blocks until an event arrives or seconds have passed. GLFW 3.1 has no timed wait, so a helper thread posts
+	// an empty event at the deadline
+	void Wait(double seconds)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(std::max(seconds, 0.0) * 1e6));
+			this->armed = true;
+		}
+		this->changed.notify_one();
+		glfwWaitEvents();
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->armed = false;
+	}
+
+private:
+	struct ObjectState
+	{
+		bool Seen;
+		glm::mat4 Model;
+		DamageRect Covered;
+
+		ObjectState() : Seen(false) {}
+	};
+
+	GLsizei width, height;
+	glm::mat4 viewProjection;
+	GLuint64 key, lastKey;
+	bool full, hasFrame;
+	DamageRect damage;
+	std::vector<ObjectState> objects;
+
+	std::thread waker;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::chrono::steady_clock::time_point deadline;
+	bool armed, quit;
+
+	// Screen rectangle of a model space box, the whole screen when part of it is behind the camera
+	DamageRect project(const glm::mat4& model, const glm::vec3& lower, const glm::vec3& upper) const
+	{
+		glm::vec2 screenLower(1e9f), screenUpper(-1e9f);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 position((corner & 1) ? upper.x : lower.x, (corner & 2) ? upper.y : lower.y, (corner & 4) ? upper.z : lower.z);
+			glm::vec4 clip = this->viewProjection * model * glm::vec4(position, 1.0f);
+			if (clip.w <= 1e-4f)
+				return DamageRect(0, 0, this->width, this->height);
+			glm::vec2 pixel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * glm::vec2((GLfloat)this->width, (GLfloat)this->height);
+			screenLower = glm::min(screenLower, pixel);
+			screenUpper = glm::max(screenUpper, pixel);
+		}
+		GLint x0 = std::max((GLint)std::floor(screenLower.x) - DAMAGE_MARGIN, 0), y0 = std::max((GLint)std::floor(screenLower.y) - DAMAGE_MARGIN, 0);
+		GLint x1 = std::min((GLint)std::ceil(screenUpper.x) + DAMAGE_MARGIN, (GLint)this->width), y1 = std::min((GLint)std::ceil(screenUpper.y) + DAMAGE_MARGIN, (GLint)this->height);
+		return DamageRect(x0, y0, x1 - x0, y1 - y0);
+	}
+
+	// Helper thread of Wait
+	void wake()
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		while (!this->quit)
+		{
+			if (!this->armed)
+			{
+				this->changed.wait(lock);
+				continue;
+			}
+			if (this->changed.wait_until(lock, this->deadline) == std::cv_status::timeout && this->armed)
+			{
+				this->armed = false;
+				glfwPostEmptyEvent();
+			}
+		}
+	}
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+// Std. Includes
+#include <iostream>
+#include <cmath>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Mesh.h"
+#include "Primitives.h"
+
+// Deferred shading path. The geometry pass writes a lean G-buffer (12 bytes per pixel):
+//   albedo RGBA8 (alpha holds the specular intensity), octahedral normal RG16, depth 24 bit;
+// then every light draws the back faces of its bounding sphere, instanced straight from the light texture buffer,
+// adding into an R11F_G11F_B10F accumulation target. Resolve copies the result to the window. A third RG16F target
+// holds the screen motion for the temporal upsampling, which renders into the lower left corner (SetRenderSize).
+class DeferredRenderer
+{
+public:
+	GLuint GBuffer, AlbedoTexture, NormalTexture, MotionTexture, DepthTexture;
+	GLuint Accumulation, AccumulationTexture;
+
+	DeferredRenderer(GLsizei width, GLsizei height) : width(width), height(height), renderWidth(width), renderHeight(height)
+	{
+		glGenTextures(1, &this->AlbedoTexture);
+		glGenTextures(1, &this->NormalTexture);
+		glGenTextures(1, &this->MotionTexture);
+		glGenTextures(1, &this->DepthTexture);
+		glGenTextures(1, &this->AccumulationTexture);
+		createTarget(this->AlbedoTexture, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		createTarget(this->NormalTexture, GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+		createTarget(this->MotionTexture, GL_RG16F, GL_RG, GL_FLOAT);
+		createTarget(this->DepthTexture, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+		createTarget(this->AccumulationTexture, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT);
+
+		glGenFramebuffers(1, &this->GBuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->GBuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->AlbedoTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->NormalTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, this->MotionTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->DepthTexture, 0);
+		const GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+		glDrawBuffers(3, drawBuffers);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::DEFERRED::GBUFFER_INCOMPLETE" << std::endl;
+
+		// No depth attachment: the light pass reads the G-buffer depth as a texture instead of testing against it
+		glGenFramebuffers(1, &this->Accumulation);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->Accumulation);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->AccumulationTexture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::DEFERRED::ACCUMULATION_INCOMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// 16 x 8 sphere, scaled so its faces (not just its vertices) enclose the light radius
+		this->volume.Upload(Primitives::Sphere(1.0f, VOLUME_SEGMENTS, VOLUME_SEGMENTS / 2));
+		glGenVertexArrays(1, &this->fullscreenVAO);
+	}
+
+	~DeferredRenderer()
+	{
+		glDeleteFramebuffers(1, &this->GBuffer);
+		glDeleteFramebuffers(1, &this->Accumulation);
+		GLuint textures[5] = { this->AlbedoTexture, this->NormalTexture, this->MotionTexture, this->DepthTexture, this->AccumulationTexture };
+		glDeleteTextures(5, textures);
+		glDeleteVertexArrays(1, &this->fullscreenVAO);
+	}
+
+	// Size of the part of the targets that is drawn, the whole of them unless the frame is upsampled
+	void SetRenderSize(GLsizei width, GLsizei height)
+	{
+		this->renderWidth = width;
+		this->renderHeight = height;
+	}
+
+	// Binds and clears the G-buffer and sets the viewport to the render size, the caller then draws the scene with gbuffer.frag
+	void BeginGeometry()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, this->GBuffer);
+		glViewport(0, 0, this->renderWidth, this->renderHeight);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// Accumulates every light in the texture buffer into the accumulation target
+	void AccumulateLights(GLuint program, GLuint lightTexture, GLsizei lightCount, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos, GLfloat shininess)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, this->Accumulation);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		glUseProgram(program);
+		this->bindGBuffer(program);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+		glUniform1i(glGetUniformLocation(program, "lightData"), 3);
+		GLfloat step = 3.14159265f / VOLUME_SEGMENTS;
+		glUniform1f(glGetUniformLocation(program, "volumeScale"), 1.0f / (cos(step) * cos(step)));
+		glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+		glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+		glUniformMatrix4fv(glGetUniformLocation(program, "inverseViewProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(projection * view)));
+		glUniform3f(glGetUniformLocation(program, "viewPos"), viewPos.x, viewPos.y, viewPos.z);
+		glUniform1f(glGetUniformLocation(program, "shininess"), shininess);
+		glUniform2f(glGetUniformLocation(program, "viewportSize"), (GLfloat)this->renderWidth, (GLfloat)this->renderHeight);
+
+		// Back faces only, so a volume the camera stands in still covers the screen; depth clamp keeps volumes
+		// reaching past the far plane from being clipped open
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+		glEnable(GL_DEPTH_CLAMP);
+		glCullFace(GL_FRONT);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		this->volume.DrawInstanced(lightCount);
+		glDisable(GL_BLEND);
+		glCullFace(GL_BACK);
+		glDisable(GL_DEPTH_CLAMP);
+		glDepthMask(GL_TRUE);
+		glEnable(GL_DEPTH_TEST);
+		this->unbindTextures(4);
+	}
+
+	// Writes the accumulated light to target (the window by default), empty pixels get the sky or the clear color. The
+	// albedo and normal targets are bound as well for the image based ambient (EnvironmentMap.h), whose uniforms the
+	// caller sets on program
+	void Resolve(GLuint program, const glm::vec3& clearColor, GLuint target = 0)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+		glUseProgram(program);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, this->AccumulationTexture);
+		glUniform1i(glGetUniformLocation(program, "accumulation"), 0);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, this->DepthTexture);
+		glUniform1i(glGetUniformLocation(program, "depth"), 1);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, this->AlbedoTexture);
+		glUniform1i(glGetUniformLocation(program, "gAlbedo"), 2);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, this->NormalTexture);
+		glUniform1i(glGetUniformLocation(program, "gNormal"), 3);
+		glActiveTexture(GL_TEXTURE0);
+		glUniform3f(glGetUniformLocation(program, "clearColor"), clearColor.x, clearColor.y, clearColor.z);
+		glUniform2f(glGetUniformLocation(program, "viewportSize"), (GLfloat)this->renderWidth, (GLfloat)this->renderHeight);
+		this->DrawFullscreen();
+		this->unbindTextures(4);
+	}
+
+	// One triangle covering the viewport, fullscreen.vs makes the corners from gl_VertexID
+	void DrawFullscreen()
+	{
+		glDisable(GL_DEPTH_TEST);
+		glBindVertexArray(this->fullscreenVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+private:
+	static const GLuint VOLUME_SEGMENTS = 16;
+	GLsizei width, height, renderWidth, renderHeight;
+	Mesh volume;
+	GLuint fullscreenVAO;
+
+	void createTarget(GLuint texture, GLenum internalFormat, GLenum format, GLenum type)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, this->width, this->height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void bindGBuffer(GLuint program)
+	{
+		const GLuint textures[3] = { this->AlbedoTexture, this->NormalTexture, this->DepthTexture };
+		const char* names[3] = { "gAlbedo", "gNormal", "gDepth" };
+		for (int i = 0; i < 3; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glUniform1i(glGetUniformLocation(program, names[i]), i);
+		}
+	}
+
+	// The targets must not stay bound where the next geometry pass samples its material, that would read the G-buffer
+	// while writing it. Unit 3 holds the light buffer in the light pass and the normals in the resolve
+	void unbindTextures(int count)
+	{
+		for (int i = count - 1; i >= 0; i--)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			if (i == 3)
+				glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+	}
+};
@@ -0,0 +1,417 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// SSE2 is the baseline for the x86/x64 targets we build, other targets use the scalar path
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ENVIRONMENT_SIMD 1
+#include <emmintrin.h>
+#endif
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <SOIL.h>
+
+#include "AssetPack.h"
+#include "Hash.h"
+#include "JpegDecoder.h"
+
+// Face size of the specular cube's first mip, the chain goes down to 1x1
+const int ENVIRONMENT_SIZE = 64;
+// Face size of the copy the lobes are integrated over, every output texel reads all 6 faces of it
+const int ENVIRONMENT_SOURCE_SIZE = 32;
+const int ENVIRONMENT_IRRADIANCE_SIZE = 16;
+// Scale on the lookups: the sky is a photo at display brightness, this brings its ambient near the flat
+// ambient terms of the lights it replaces
+const GLfloat ENVIRONMENT_INTENSITY = 0.35f;
+// Bump when the filtering changes, older cache files are then ignored
+const GLuint ENVIRONMENT_CACHE_VERSION = 1;
+
+// Image based ambient light. The source image becomes a cubemap - an equirectangular panorama (2:1) is
+// wrapped around, anything else is put on all six faces - which is then
+// prefiltered on the CPU, output texels shared out over all cores and each one integrated over the whole
+// source cube four texels at a time:
+//   - a specular cube whose mip m holds the Phong lobe of exponent 4^(levels - 1 - m) (mip 0 is the source),
+//     so textureLod(environmentMap, reflection, lod) matches a material's shininess;
+//   - an irradiance cube with the cosine convolution divided by pi, so albedo * texture(irradianceMap, normal)
+//     is the diffuse ambient.
+// The filtered faces are cached in the working directory, keyed by a hash of the image and the settings.
+class EnvironmentMap
+{
+public:
+	GLuint SpecularMap, IrradianceMap;
+	GLint Levels;
+
+	EnvironmentMap() : SpecularMap(0), IrradianceMap(0), Levels(0)
+	{
+	}
+
+	~EnvironmentMap()
+	{
+		glDeleteTextures(1, &this->SpecularMap);
+		glDeleteTextures(1, &this->IrradianceMap);
+	}
+
+	// False if the image cannot be read, the maps then stay empty and the lights keep their ambient terms
+	bool Load(const std::string& path)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		AssetView file = AssetPack::Default().Read(path);
+		if (!file.IsValid())
+		{
+			std::cout << "ERROR::ENVIRONMENT::FILE_NOT_FOUND " << path << std::endl;
+			return false;
+		}
+		GLuint64 key = cacheKey(file.Data, file.Size);
+		bool cached = this->loadCache(key);
+		if (!cached)
+		{
+			int width = 0, height = 0;
+			unsigned char* image = JpegDecoder::Decode(file.Data, file.Size, &width, &height);
+			if (image == NULL)
+				image = SOIL_load_image_from_memory(file.Data, (int)file.Size, &width, &height, 0, SOIL_LOAD_RGB);
+			if (image == NULL)
+			{
+				AssetPack::Default().Release(path);
+				std::cout << "ERROR::ENVIRONMENT::IMAGE_NOT_DECODED " << path << std::endl;
+				return false;
+			}
+			this->prefilter(image, width, height);
+			SOIL_free_image_data(image);
+			this->saveCache(key);
+		}
+		AssetPack::Default().Release(path);
+		this->upload();
+
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "ENVIRONMENT::" << (cached ? "CACHED " : "FILTERED ") << this->Levels << " specular levels from " << ENVIRONMENT_SIZE
+			<< ", irradiance " << ENVIRONMENT_IRRADIANCE_SIZE << ", in " << milliseconds << " ms" << std::endl;
+		return true;
+	}
+
+	bool IsValid() const
+	{
+		return this->SpecularMap != 0;
+	}
+
+	// Binds both cubes and sets the uniforms gkom.frag and deferred_resolve.frag read (ENVIRONMENT)
+	void Bind(GLuint program, GLint specularUnit, GLint irradianceUnit) const
+	{
+		glActiveTexture(GL_TEXTURE0 + specularUnit);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, this->SpecularMap);
+		glActiveTexture(GL_TEXTURE0 + irradianceUnit);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, this->IrradianceMap);
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(program, "environmentMap"), specularUnit);
+		glUniform1i(glGetUniformLocation(program, "irradianceMap"), irradianceUnit);
+		glUniform1f(glGetUniformLocation(program, "environmentLevels"), (GLfloat)this->Levels);
+		glUniform1f(glGetUniformLocation(program, "environmentIntensity"), ENVIRONMENT_INTENSITY);
+	}
+
+	// Unit direction through the point (s, t) in [-1, 1] of a face, in the GL cube map face order and orientation
+	static glm::vec3 FaceDirection(int face, GLfloat s, GLfloat t)
+	{
+		switch (face)
+		{
+		case 0: return glm::normalize(glm::vec3(1.0f, -t, -s));
+		case 1: return glm::normalize(glm::vec3(-1.0f, -t, s));
+		case 2: return glm::normalize(glm::vec3(s, 1.0f, t));
+		case 3: return glm::normalize(glm::vec3(s, -1.0f, -t));
+		case 4: return glm::normalize(glm::vec3(s, -t, 1.0f));
+		default: return glm::normalize(glm::vec3(-s, -t, -1.0f));
+		}
+	}
+
+	// Through the center of texel (x, y) of a face size texels wide
+	static glm::vec3 Direction(int face, int x, int y, int size)
+	{
+		return FaceDirection(face, (x + 0.5f) * 2.0f / size - 1.0f, (y + 0.5f) * 2.0f / size - 1.0f);
+	}
+
+private:
+	struct CacheHeader
+	{
+		char Magic[4];			// "GENV"
+		GLuint Size, Levels, IrradianceSize;
+		GLuint64 Key;
+	};
+
+	// Source cube in structure-of-arrays form: direction, solid angle and color of every texel
+	struct Source
+	{
+		std::vector<GLfloat> X, Y, Z, Weight, R, G, B;
+	};
+
+	std::vector<std::vector<glm::vec3> > levels;	// 6 faces per level, face after face, rows of texels
+	std::vector<glm::vec3> irradiance;
+
+	// Hash of the image and everything that changes the filtered result
+	static GLuint64 cacheKey(const unsigned char* data, size_t size)
+	{
+		GLuint64 hash = Hash::Seed;
+		const GLuint settings[4] = { ENVIRONMENT_CACHE_VERSION, ENVIRONMENT_SIZE, ENVIRONMENT_SOURCE_SIZE, ENVIRONMENT_IRRADIANCE_SIZE };
+		Hash::Bytes(hash, settings, sizeof(settings));
+		Hash::Bytes(hash, data, size);
+		return hash;
+	}
+
+	// Written to the working directory next to the shaders
+	static std::string cachePath(GLuint64 key)
+	{
+		char name[64];
+		sprintf(name, "envcache_%016llx.bin", (unsigned long long)key);
+		return name;
+	}
+
+	bool loadCache(GLuint64 key)
+	{
+		std::ifstream file(cachePath(key).c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		CacheHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || memcmp(header.Magic, "GENV", 4) != 0 || header.Key != key
+			|| header.Size != (GLuint)ENVIRONMENT_SIZE || header.IrradianceSize != (GLuint)ENVIRONMENT_IRRADIANCE_SIZE || header.Levels == 0)
+			return false;
+		this->levels.resize(header.Levels);
+		for (GLuint level = 0; level < header.Levels; level++)
+		{
+			int size = std::max(ENVIRONMENT_SIZE >> level, 1);
+			this->levels[level].resize(6 * size * size);
+			if (!file.read((char*)&this->levels[level][0], this->levels[level].size() * sizeof(glm::vec3)))
+				return false;
+		}
+		this->irradiance.resize(6 * ENVIRONMENT_IRRADIANCE_SIZE * ENVIRONMENT_IRRADIANCE_SIZE);
+		if (!file.read((char*)&this->irradiance[0], this->irradiance.size() * sizeof(glm::vec3)))
+			return false;
+		this->Levels = (GLint)header.Levels;
+		return true;
+	}
+
+	void saveCache(GLuint64 key) const
+	{
+		CacheHeader header;
+		memcpy(header.Magic, "GENV", 4);
+		header.Size = ENVIRONMENT_SIZE;
+		header.Levels = (GLuint)this->levels.size();
+		header.IrradianceSize = ENVIRONMENT_IRRADIANCE_SIZE;
+		header.Key = key;
+		std::ofstream file(cachePath(key).c_str(), std::ios::binary);
+		file.write((const char*)&header, sizeof(header));
+		for (size_t level = 0; level < this->levels.size(); level++)
+			file.write((const char*)&this->levels[level][0], this->levels[level].size() * sizeof(glm::vec3));
+		file.write((const char*)&this->irradiance[0], this->irradiance.size() * sizeof(glm::vec3));
+		if (!file.good())
+			std::cout << "ERROR::ENVIRONMENT::CACHE_NOT_WRITTEN" << std::endl;
+	}
+
+	// Bilinear lookup in the 8 bit image, u and v in [0, 1]
+	static glm::vec3 sample(const unsigned char* image, int width, int height, GLfloat u, GLfloat v)
+	{
+		GLfloat x = glm::clamp(u * width - 0.5f, 0.0f, width - 1.0f), y = glm::clamp(v * height - 0.5f, 0.0f, height - 1.0f);
+		int x0 = (int)x, y0 = (int)y;
+		int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+		GLfloat fx = x - x0, fy = y - y0;
+		const int corners[4] = { y0 * width + x0, y0 * width + x1, y1 * width + x0, y1 * width + x1 };
+		const GLfloat weights[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+		glm::vec3 result(0.0f);
+		for (int i = 0; i < 4; i++)
+			result += glm::vec3(image[corners[i] * 3], image[corners[i] * 3 + 1], image[corners[i] * 3 + 2]) * (weights[i] / 255.0f);
+		return result;
+	}
+
+	// Where the image is seen along a direction, s and t in [0, 1] on the face are used by the box layout
+	static glm::vec3 lookup(const unsigned char* image, int width, int height, const glm::vec3& direction, GLfloat s, GLfloat t)
+	{
+		if (width == 2 * height)
+		{
+			GLfloat u = std::atan2(direction.z, direction.x) / (2.0f * 3.14159265f) + 0.5f;
+			GLfloat v = std::acos(glm::clamp(direction.y, -1.0f, 1.0f)) / 3.14159265f;
+			return sample(image, width, height, u, v);
+		}
+		return sample(image, width, height, s, t);
+	}
+
+	void prefilter(const unsigned char* image, int width, int height)
+	{
+		// Mip 0: the image resampled onto the faces, 4x4 samples per texel against aliasing
+		const int SUPERSAMPLE = 4;
+		int levelCount = 1;
+		while ((ENVIRONMENT_SIZE >> (levelCount - 1)) > 1)
+			levelCount++;
+		this->levels.assign(levelCount, std::vector<glm::vec3>());
+		this->levels[0].assign(6 * ENVIRONMENT_SIZE * ENVIRONMENT_SIZE, glm::vec3(0.0f));
+		for (int face = 0; face < 6; face++)
+			for (int y = 0; y < ENVIRONMENT_SIZE; y++)
+				for (int x = 0; x < ENVIRONMENT_SIZE; x++)
+				{
+					glm::vec3 sum(0.0f);
+					for (int sy = 0; sy < SUPERSAMPLE; sy++)
+						for (int sx = 0; sx < SUPERSAMPLE; sx++)
+						{
+							GLfloat s = (x + (sx + 0.5f) / SUPERSAMPLE) / ENVIRONMENT_SIZE, t = (y + (sy + 0.5f) / SUPERSAMPLE) / ENVIRONMENT_SIZE;
+							sum += lookup(image, width, height, FaceDirection(face, s * 2.0f - 1.0f, t * 2.0f - 1.0f), s, t);
+						}
+					this->levels[0][(face * ENVIRONMENT_SIZE + y) * ENVIRONMENT_SIZE + x] = sum / (GLfloat)(SUPERSAMPLE * SUPERSAMPLE);
+				}
+
+		// Integration source: mip 0 box filtered down
+		Source source;
+		const int n = ENVIRONMENT_SOURCE_SIZE, scale = ENVIRONMENT_SIZE / ENVIRONMENT_SOURCE_SIZE;
+		size_t count = 6 * n * n;
+		source.X.resize(count); source.Y.resize(count); source.Z.resize(count); source.Weight.resize(count);
+		source.R.resize(count); source.G.resize(count); source.B.resize(count);
+		for (int face = 0; face < 6; face++)
+			for (int y = 0; y < n; y++)
+				for (int x = 0; x < n; x++)
+				{
+					size_t i = (face * n + y) * n + x;
+					glm::vec3 color(0.0f);
+					for (int dy = 0; dy < scale; dy++)
+						for (int dx = 0; dx < scale; dx++)
+							color += this->levels[0][(face * ENVIRONMENT_SIZE + y * scale + dy) * ENVIRONMENT_SIZE + x * scale + dx];
+					color /= (GLfloat)(scale * scale);
+					glm::vec3 direction = Direction(face, x, y, n);
+					// Solid angle of the texel: its area on the unit cube face over the cube of its distance
+					GLfloat s = (x + 0.5f) * 2.0f / n - 1.0f, t = (y + 0.5f) * 2.0f / n - 1.0f;
+					GLfloat distanceSquared = 1.0f + s * s + t * t;
+					source.X[i] = direction.x;
+					source.Y[i] = direction.y;
+					source.Z[i] = direction.z;
+					source.Weight[i] = (4.0f / (n * n)) / (distanceSquared * std::sqrt(distanceSquared));
+					source.R[i] = color.r;
+					source.G[i] = color.g;
+					source.B[i] = color.b;
+				}
+
+		// Every output texel of every level plus the irradiance cube, one job list for all threads
+		std::vector<std::pair<int, int> > jobs;		// (level, face * size + row), level -1 is the irradiance cube
+		for (int level = 1; level < levelCount; level++)
+		{
+			int size = ENVIRONMENT_SIZE >> level;
+			this->levels[level].assign(6 * size * size, glm::vec3(0.0f));
+			for (int row = 0; row < 6 * size; row++)
+				jobs.push_back(std::make_pair(level, row));
+		}
+		this->irradiance.assign(6 * ENVIRONMENT_IRRADIANCE_SIZE * ENVIRONMENT_IRRADIANCE_SIZE, glm::vec3(0.0f));
+		for (int row = 0; row < 6 * ENVIRONMENT_IRRADIANCE_SIZE; row++)
+			jobs.push_back(std::make_pair(-1, row));
+
+		std::atomic<size_t> next(0);
+		unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.push_back(std::thread([&]()
+			{
+				for (size_t job = next++; job < jobs.size(); job = next++)
+				{
+					int level = jobs[job].first;
+					int size = level < 0 ? ENVIRONMENT_IRRADIANCE_SIZE : ENVIRONMENT_SIZE >> level;
+					int face = jobs[job].second / size, y = jobs[job].second % size;
+					for (int x = 0; x < size; x++)
+					{
+						glm::vec3 direction = Direction(face, x, y, size);
+						if (level < 0)
+							// Cosine weights sum to pi over the hemisphere, E / pi is the ambient per unit albedo
+							this->irradiance[(face * size + y) * size + x] = convolve(source, direction, 0, false) / 3.14159265f;
+						else
+							// Exponent 4^(levels - 1 - level): squaring the cosine twice per step
+							this->levels[level][(face * size + y) * size + x] = convolve(source, direction, 2 * (levelCount - 1 - level), true);
+					}
+				}
+			}));
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		this->Levels = levelCount;
+	}
+
+	// Sum of the source weighted by max(cos, 0)^(2^squarings) times solid angle, divided by the weights when
+	// normalize is set (a lobe average) or left as the integral otherwise
+	static glm::vec3 convolve(const Source& source, const glm::vec3& direction, int squarings, bool normalize)
+	{
+		size_t count = source.X.size();
+		GLfloat sums[4];
+#ifdef ENVIRONMENT_SIMD
+		__m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z), zero = _mm_setzero_ps();
+		__m128 r = zero, g = zero, b = zero, total = zero;
+		for (size_t i = 0; i < count; i += 4)
+		{
+			__m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&source.X[i])), _mm_mul_ps(dy, _mm_loadu_ps(&source.Y[i]))), _mm_mul_ps(dz, _mm_loadu_ps(&source.Z[i])));
+			cosine = _mm_max_ps(cosine, zero);
+			for (int k = 0; k < squarings; k++)
+				cosine = _mm_mul_ps(cosine, cosine);
+			__m128 weight = _mm_mul_ps(cosine, _mm_loadu_ps(&source.Weight[i]));
+			r = _mm_add_ps(r, _mm_mul_ps(weight, _mm_loadu_ps(&source.R[i])));
+			g = _mm_add_ps(g, _mm_mul_ps(weight, _mm_loadu_ps(&source.G[i])));
+			b = _mm_add_ps(b, _mm_mul_ps(weight, _mm_loadu_ps(&source.B[i])));
+			total = _mm_add_ps(total, weight);
+		}
+		// Horizontal sums
+		__m128 rg = _mm_add_ps(_mm_unpacklo_ps(r, g), _mm_unpackhi_ps(r, g));
+		__m128 bt = _mm_add_ps(_mm_unpacklo_ps(b, total), _mm_unpackhi_ps(b, total));
+		_mm_storeu_ps(sums, _mm_add_ps(_mm_movelh_ps(rg, bt), _mm_movehl_ps(bt, rg)));
+#else
+		sums[0] = sums[1] = sums[2] = sums[3] = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			GLfloat cosine = std::max(direction.x * source.X[i] + direction.y * source.Y[i] + direction.z * source.Z[i], 0.0f);
+			for (int k = 0; k < squarings; k++)
+				cosine *= cosine;
+			GLfloat weight = cosine * source.Weight[i];
+			sums[0] += weight * source.R[i];
+			sums[1] += weight * source.G[i];
+			sums[2] += weight * source.B[i];
+			sums[3] += weight;
+		}
+#endif
+		glm::vec3 result(sums[0], sums[1], sums[2]);
+		if (normalize)
+			return sums[3] > 0.0f ? result / sums[3] : glm::vec3(0.0f);
+		return result;
+	}
+
+	void upload()
+	{
+		// Filtering across face edges, without it the blurred mips show the cube's seams
+		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+		if (this->SpecularMap == 0)
+			glGenTextures(1, &this->SpecularMap);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, this->SpecularMap);
+		for (GLint level = 0; level < this->Levels; level++)
+		{
+			int size = std::max(ENVIRONMENT_SIZE >> level, 1);
+			for (int face = 0; face < 6; face++)
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT, &this->levels[level][face * size * size]);
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, this->Levels - 1);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+		if (this->IrradianceMap == 0)
+			glGenTextures(1, &this->IrradianceMap);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, this->IrradianceMap);
+		int size = ENVIRONMENT_IRRADIANCE_SIZE;
+		for (int face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT, &this->irradiance[face * size * size]);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	}
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// Reports files that were written since the last call to Changed(). A background thread waits on inotify
+// where it exists and compares modification times every POLL_MILLISECONDS elsewhere; either way the render
+// loop only picks up the result. Editors that save through a temporary file and a rename are covered too.
+class FileWatcher
+{
+public:
+	static const int POLL_MILLISECONDS = 250;
+
+	FileWatcher() : running(false)
+	{
+	}
+
+	~FileWatcher()
+	{
+		this->Stop();
+	}
+
+	// Files can be added until Start is called
+	void Add(const std::string& path)
+	{
+		if (!this->running)
+			this->files[path] = modificationTime(path);
+	}
+
+	void Start()
+	{
+		if (this->running || this->files.empty())
+			return;
+		this->running = true;
+		this->worker = std::thread(&FileWatcher::run, this);
+	}
+
+	void Stop()
+	{
+		if (!this->running)
+			return;
+		this->running = false;
+		this->worker.join();
+	}
+
+	// Paths written since the previous call, each reported once
+	std::vector<std::string> Changed()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::vector<std::string> changed(this->changed.begin(), this->changed.end());
+		this->changed.clear();
+		return changed;
+	}
+
+private:
+	std::map<std::string, time_t> files;
+	std::set<std::string> changed;
+	std::mutex mutex;
+	std::atomic<bool> running;
+	std::thread worker;
+
+	static time_t modificationTime(const std::string& path)
+	{
+		struct stat info;
+		return stat(path.c_str(), &info) == 0 ? info.st_mtime : 0;
+	}
+
+	void report(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->changed.insert(path);
+	}
+
+	void run()
+	{
+#ifdef __linux__
+		// Watch the directories rather than the files, a rename over a file would end a watch on the file itself
+		int notify = inotify_init1(IN_NONBLOCK);
+		std::map<int, std::string> directories;
+		for (std::map<std::string, time_t>::iterator it = this->files.begin(); notify >= 0 && it != this->files.end(); ++it)
+		{
+			size_t slash = it->first.find_last_of('/');
+			std::string directory = slash == std::string::npos ? "." : it->first.substr(0, slash);
+			int watch = inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (watch >= 0)
+				directories[watch] = slash == std::string::npos ? "" : directory + "/";
+		}
+		if (notify >= 0 && !directories.empty())
+		{
+			char buffer[4096];
+			while (this->running)
+			{
+				pollfd descriptor = { notify, POLLIN, 0 };
+				if (poll(&descriptor, 1, POLL_MILLISECONDS) <= 0)
+					continue;
+				ssize_t length = read(notify, buffer, sizeof(buffer));
+				for (ssize_t offset = 0; offset < length;)
+				{
+					const inotify_event* event = (const inotify_event*)(buffer + offset);
+					if (event->len > 0)
+					{
+						std::string path = directories[event->wd] + event->name;
+						if (this->files.count(path))
+							this->report(path);
+					}
+					offset += sizeof(inotify_event) + event->len;
+				}
+			}
+			close(notify);
+			return;
+		}
+		if (notify >= 0)
+			close(notify);
+#endif
+		while (this->running)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MILLISECONDS));
+			for (std::map<std::string, time_t>::iterator it = this->files.begin(); it != this->files.end(); ++it)
+			{
+				time_t modified = modificationTime(it->first);
+				if (modified != it->second)
+				{
+					it->second = modified;
+					this->report(it->first);
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <iostream>
+
+// GL Includes
+#include <GL/glew.h>
+
+// Benchmark helper: the scene is drawn once more with the SHADER_COUNTERS variants into a float target, where
+// every fragment writes (texture fetches, lights tested, lights shaded, math operations), and the sums are read
+// back. Counts are per visible fragment, the pixels the depth buffer shows covered; the readback stalls, so this
+// only runs when the benchmark line is printed.
+class FragmentCounters
+{
+public:
+	GLfloat Fetches, LightsTested, LightsShaded, Math;
+
+	FragmentCounters(GLsizei width, GLsizei height) : Fetches(0.0f), LightsTested(0.0f), LightsShaded(0.0f), Math(0.0f), width(width), height(height)
+	{
+		glGenTextures(1, &this->texture);
+		glBindTexture(GL_TEXTURE_2D, this->texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glGenRenderbuffers(1, &this->depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glGenFramebuffers(1, &this->framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->texture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::COUNTERS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	~FragmentCounters()
+	{
+		glDeleteFramebuffers(1, &this->framebuffer);
+		glDeleteRenderbuffers(1, &this->depth);
+		glDeleteTextures(1, &this->texture);
+	}
+
+	// Bind and clear, then draw the scene with SHADER_COUNTERS
+	void Begin()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// Reads the target back and averages over the covered pixels, false if nothing was drawn
+	bool End()
+	{
+		std::vector<GLfloat> pixels(this->width * this->height * 4);
+		std::vector<GLfloat> depths(this->width * this->height);
+		glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_FLOAT, &pixels[0]);
+		glReadPixels(0, 0, this->width, this->height, GL_DEPTH_COMPONENT, GL_FLOAT, &depths[0]);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		double sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+		size_t covered = 0;
+		for (size_t i = 0; i < depths.size(); i++)
+			if (depths[i] < 1.0f)
+			{
+				for (int k = 0; k < 4; k++)
+					sums[k] += pixels[i * 4 + k];
+				covered++;
+			}
+		if (covered == 0)
+			return false;
+		this->Fetches = (GLfloat)(sums[0] / covered);
+		this->LightsTested = (GLfloat)(sums[1] / covered);
+		this->LightsShaded = (GLfloat)(sums[2] / covered);
+		this->Math = (GLfloat)(sums[3] / covered);
+		return true;
+	}
+
+private:
+	GLsizei width, height;
+	GLuint framebuffer, texture, depth;
+};
@@ -0,0 +1,301 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+
+// GL Includes
+#include <GL/glew.h>
+
+#include "Json.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+// Offline importer for glTF 2.0 (.gltf with external or embedded buffers, and binary .glb).
+// Every triangle primitive becomes one indexed .mesh file "<prefix>_<mesh>_<primitive>.mesh" holding positions,
+// normals (generated when missing) and the first texture coordinate set, run through the MeshOptimizer passes.
+// Primitives are processed on all hardware threads. Node transforms are not applied, meshes stay in their own space.
+class GltfImporter
+{
+public:
+	static bool Import(const std::string& path, const std::string& outputPrefix)
+	{
+		GltfImporter importer;
+		if (!importer.load(path))
+		{
+			std::cout << "ERROR::GLTF::NOT_LOADED " << path << std::endl;
+			return false;
+		}
+
+		const JsonValue& meshes = importer.document["meshes"];
+		std::vector<std::pair<size_t, size_t> > jobs;
+		for (size_t m = 0; m < meshes.Size(); m++)
+			for (size_t p = 0; p < meshes[m]["primitives"].Size(); p++)
+				jobs.push_back(std::make_pair(m, p));
+
+		std::atomic<size_t> next(0);
+		std::atomic<bool> failed(false);
+		std::mutex logMutex;
+		unsigned int threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned int)jobs.size()));
+		std::vector<std::thread> workers;
+		for (unsigned int t = 0; t < threadCount; t++)
+			workers.push_back(std::thread([&]()
+			{
+				for (size_t job = next++; job < jobs.size(); job = next++)
+				{
+					std::ostringstream name;
+					name << outputPrefix << "_" << jobs[job].first << "_" << jobs[job].second << ".mesh";
+					std::string report;
+					if (!importer.importPrimitive(meshes[jobs[job].first]["primitives"][jobs[job].second], name.str(), report))
+						failed = true;
+					std::lock_guard<std::mutex> lock(logMutex);
+					std::cout << report << std::endl;
+				}
+			}));
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+		return !failed && !jobs.empty();
+	}
+
+private:
+	JsonValue document;
+	std::vector<std::vector<unsigned char> > buffers;
+
+	bool load(const std::string& path)
+	{
+		std::vector<unsigned char> file;
+		if (!readFile(path, file))
+			return false;
+
+		// A .glb is a 12 byte header followed by a JSON chunk and an optional binary chunk
+		std::vector<unsigned char> binaryChunk;
+		const char* json = (const char*)(file.empty() ? NULL : &file[0]);
+		size_t jsonSize = file.size();
+		if (file.size() >= 20 && memcmp(&file[0], "glTF", 4) == 0)
+		{
+			size_t offset = 12;
+			json = NULL;
+			while (offset + 8 <= file.size())
+			{
+				unsigned int chunkLength = readU32(&file[offset]), chunkType = readU32(&file[offset + 4]);
+				offset += 8;
+				if (chunkLength > file.size() - offset)
+					return false;
+				if (chunkType == 0x4E4F534A && json == NULL)		// "JSON"
+				{
+					json = (const char*)&file[offset];
+					jsonSize = chunkLength;
+				}
+				else if (chunkType == 0x004E4942 && binaryChunk.empty())	// "BIN\0"
+					binaryChunk.assign(file.begin() + offset, file.begin() + offset + chunkLength);
+				offset += (chunkLength + 3) & ~3u;
+			}
+		}
+		if (json == NULL || !JsonValue::Parse(json, json + jsonSize, this->document))
+		{
+			std::cout << "ERROR::GLTF::BAD_JSON" << std::endl;
+			return false;
+		}
+
+		std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+		const JsonValue& bufferList = this->document["buffers"];
+		this->buffers.resize(bufferList.Size());
+		for (size_t b = 0; b < bufferList.Size(); b++)
+		{
+			const JsonValue& uri = bufferList[b]["uri"];
+			bool loaded;
+			if (uri.Kind != JsonValue::STRING)
+			{
+				this->buffers[b].swap(binaryChunk);
+				loaded = true;
+			}
+			else if (uri.String.compare(0, 5, "data:") == 0)
+				loaded = decodeBase64(uri.String.substr(uri.String.find(',') + 1), this->buffers[b]);
+			else
+				loaded = readFile(directory + uri.String, this->buffers[b]);
+			if (!loaded || this->buffers[b].size() < (size_t)bufferList[b]["byteLength"].AsNumber())
+			{
+				std::cout << "ERROR::GLTF::BUFFER_NOT_LOADED " << b << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool importPrimitive(const JsonValue& primitive, const std::string& outputPath, std::string& report) const
+	{
+		std::ostringstream log;
+		const JsonValue& attributes = primitive["attributes"];
+		if (primitive["mode"].AsInt(4) != 4 || !attributes.Has("POSITION"))
+		{
+			report = "GLTF::SKIPPED " + outputPath + " (not a triangle list)";
+			return true;
+		}
+
+		std::vector<GLfloat> positions, normals, texCoords;
+		if (!this->readAccessor(attributes["POSITION"].AsInt(-1), 3, positions)
+			|| (attributes.Has("NORMAL") && !this->readAccessor(attributes["NORMAL"].AsInt(-1), 3, normals))
+			|| (attributes.Has("TEXCOORD_0") && !this->readAccessor(attributes["TEXCOORD_0"].AsInt(-1), 2, texCoords)))
+		{
+			report = "ERROR::GLTF::BAD_ACCESSOR in " + outputPath;
+			return false;
+		}
+		size_t vertexCount = positions.size() / 3;
+		std::vector<GLuint> indices;
+		if (primitive.Has("indices"))
+		{
+			if (!this->readIndices(primitive["indices"].AsInt(-1), vertexCount, indices))
+			{
+				report = "ERROR::GLTF::BAD_INDICES in " + outputPath;
+				return false;
+			}
+		}
+		else
+			for (GLuint i = 0; i < vertexCount; i++)
+				indices.push_back(i);
+		indices.resize(indices.size() / 3 * 3);
+
+		std::vector<GLfloat> vertices(vertexCount * MeshOptimizer::VERTEX_FLOATS, 0.0f);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			GLfloat* vertex = &vertices[v * MeshOptimizer::VERTEX_FLOATS];
+			memcpy(vertex, &positions[v * 3], 3 * sizeof(GLfloat));
+			if (normals.size() == positions.size())
+				memcpy(vertex + 3, &normals[v * 3], 3 * sizeof(GLfloat));
+			if (texCoords.size() == vertexCount * 2)
+				memcpy(vertex + 6, &texCoords[v * 2], 2 * sizeof(GLfloat));
+		}
+		if (normals.size() != positions.size())
+		{
+			// Weld first, otherwise every unshared corner would only see its own face
+			MeshOptimizer::Weld(vertices, indices);
+			MeshOptimizer::GenerateNormals(vertices, indices);
+		}
+
+		// glTF asks for counter-clockwise front faces but exporters do not always agree with their own normals
+		size_t flipped = MeshOptimizer::NormalizeWinding(vertices, indices);
+		float acmrBefore = MeshOptimizer::Acmr(indices);
+		MeshOptimizer::Optimize(vertices, indices);
+		log << "GLTF::IMPORTED " << outputPath << ": " << indices.size() / 3 << " triangles, " << vertexCount << " -> "
+			<< vertices.size() / MeshOptimizer::VERTEX_FLOATS << " vertices, ACMR " << acmrBefore << " -> " << MeshOptimizer::Acmr(indices) << ", " << flipped << " triangles flipped";
+		report = log.str();
+		if (!MeshData::FromVertices(vertices, indices).Write(outputPath))
+		{
+			report = "ERROR::GLTF::NOT_WRITTEN " + outputPath;
+			return false;
+		}
+		return true;
+	}
+
+	// Resolves accessor -> buffer view -> buffer, returning the first byte and the element stride
+	const unsigned char* accessorData(const JsonValue& accessor, size_t elementSize, size_t& stride) const
+	{
+		const JsonValue& view = this->document["bufferViews"][accessor["bufferView"].AsInt(-1)];
+		size_t count = accessor["count"].AsInt();
+		int buffer = view["buffer"].AsInt(-1);
+		if (view.Kind != JsonValue::OBJECT || accessor.Has("sparse") || buffer < 0 || (size_t)buffer >= this->buffers.size() || count == 0)
+			return NULL;
+		stride = view["byteStride"].AsInt((int)elementSize);
+		size_t offset = (size_t)view["byteOffset"].AsNumber() + (size_t)accessor["byteOffset"].AsNumber();
+		if (stride < elementSize || offset + (count - 1) * stride + elementSize > this->buffers[buffer].size())
+			return NULL;
+		return &this->buffers[buffer][offset];
+	}
+
+	// Float attributes, plus the normalized integer forms glTF allows for texture coordinates
+	bool readAccessor(int index, int components, std::vector<GLfloat>& out) const
+	{
+		const JsonValue& accessor = this->document["accessors"][index];
+		int componentType = accessor["componentType"].AsInt();
+		size_t componentSize = componentType == GL_FLOAT ? 4 : componentType == GL_UNSIGNED_SHORT ? 2 : componentType == GL_UNSIGNED_BYTE ? 1 : 0;
+		if (componentSize == 0 || (componentType != GL_FLOAT && (components != 2 || !accessor["normalized"].Boolean)))
+			return false;
+		size_t stride;
+		const unsigned char* data = this->accessorData(accessor, componentSize * components, stride);
+		if (data == NULL)
+			return false;
+		size_t count = accessor["count"].AsInt();
+		out.resize(count * components);
+		for (size_t i = 0; i < count; i++)
+			for (int c = 0; c < components; c++)
+			{
+				const unsigned char* value = data + i * stride + c * componentSize;
+				if (componentType == GL_FLOAT)
+					memcpy(&out[i * components + c], value, sizeof(GLfloat));
+				else if (componentType == GL_UNSIGNED_SHORT)
+					out[i * components + c] = (value[0] | (value[1] << 8)) / 65535.0f;
+				else
+					out[i * components + c] = value[0] / 255.0f;
+			}
+		return true;
+	}
+
+	bool readIndices(int index, size_t vertexCount, std::vector<GLuint>& out) const
+	{
+		const JsonValue& accessor = this->document["accessors"][index];
+		int componentType = accessor["componentType"].AsInt();
+		size_t componentSize = componentType == GL_UNSIGNED_INT ? 4 : componentType == GL_UNSIGNED_SHORT ? 2 : componentType == GL_UNSIGNED_BYTE ? 1 : 0;
+		size_t stride;
+		const unsigned char* data = componentSize == 0 ? NULL : this->accessorData(accessor, componentSize, stride);
+		if (data == NULL)
+			return false;
+		size_t count = accessor["count"].AsInt();
+		out.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			const unsigned char* value = data + i * stride;
+			out[i] = componentSize == 4 ? readU32(value) : componentSize == 2 ? (GLuint)(value[0] | (value[1] << 8)) : value[0];
+			if (out[i] >= vertexCount)
+				return false;
+		}
+		return true;
+	}
+
+	static unsigned int readU32(const unsigned char* bytes)
+	{
+		return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+	}
+
+	static bool readFile(const std::string& path, std::vector<unsigned char>& out)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	static bool decodeBase64(const std::string& text, std::vector<unsigned char>& out)
+	{
+		unsigned int bits = 0;
+		int bitCount = 0;
+		for (size_t i = 0; i < text.size() && text[i] != '='; i++)
+		{
+			char c = text[i];
+			int value;
+			if (c >= 'A' && c <= 'Z') value = c - 'A';
+			else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+			else if (c >= '0' && c <= '9') value = c - '0' + 52;
+			else if (c == '+' || c == '-') value = 62;
+			else if (c == '/' || c == '_') value = 63;
+			else return false;
+			bits = (bits << 6) | value;
+			bitCount += 6;
+			if (bitCount >= 8)
+			{
+				bitCount -= 8;
+				out.push_back((unsigned char)(bits >> bitCount));
+			}
+		}
+		return true;
+	}
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+// GL Includes
+#include <GL/glew.h>
+
+// Measures GPU time of a stretch of commands with GL_TIME_ELAPSED queries. Results are read a few frames later
+// from a ring of queries, so reading them never stalls the pipeline; frames whose slot is still busy are skipped.
+// Only one timer can be running at a time (GL does not nest elapsed-time queries).
+class GpuTimer
+{
+public:
+	static const int QUERY_COUNT = 4;
+
+	GpuTimer() : running(false), current(0), totalNanoseconds(0), samples(0), latestNanoseconds(0), fresh(false)
+	{
+		glGenQueries(QUERY_COUNT, this->queries);
+		for (int i = 0; i < QUERY_COUNT; i++)
+			this->pending[i] = false;
+	}
+
+	~GpuTimer()
+	{
+		glDeleteQueries(QUERY_COUNT, this->queries);
+	}
+
+	void Begin()
+	{
+		this->collect();
+		this->running = !this->pending[this->current];
+		if (this->running)
+			glBeginQuery(GL_TIME_ELAPSED, this->queries[this->current]);
+	}
+
+	void End()
+	{
+		if (!this->running)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		this->pending[this->current] = true;
+		this->current = (this->current + 1) % QUERY_COUNT;
+	}
+
+	// Average milliseconds over the results collected since the last call, false if there were none
+	bool Report(double& milliseconds)
+	{
+		this->collect();
+		if (this->samples == 0)
+			return false;
+		milliseconds = this->totalNanoseconds / 1e6 / this->samples;
+		this->Reset();
+		return true;
+	}
+
+	// Milliseconds of the newest result, false if none came in since the last call. Leaves the average to Report
+	bool Latest(double& milliseconds)
+	{
+		this->collect();
+		if (!this->fresh)
+			return false;
+		milliseconds = this->latestNanoseconds / 1e6;
+		this->fresh = false;
+		return true;
+	}
+
+	// Drops collected results, e.g. after switching what is being measured
+	void Reset()
+	{
+		this->totalNanoseconds = 0;
+		this->samples = 0;
+	}
+
+private:
+	GLuint queries[QUERY_COUNT];
+	bool pending[QUERY_COUNT];
+	bool running;
+	int current;
+	GLuint64 totalNanoseconds;
+	GLuint samples;
+	GLuint64 latestNanoseconds;
+	bool fresh;
+
+	// Oldest slot first, so the newest result is the one kept as the latest
+	void collect()
+	{
+		for (int k = 0; k < QUERY_COUNT; k++)
+		{
+			int i = (this->current + k) % QUERY_COUNT;
+			if (!this->pending[i])
+				continue;
+			GLint available = 0;
+			glGetQueryObjectiv(this->queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(this->queries[i], GL_QUERY_RESULT, &elapsed);
+			this->totalNanoseconds += elapsed;
+			this->samples++;
+			this->latestNanoseconds = elapsed;
+			this->fresh = true;
+			this->pending[i] = false;
+		}
+	}
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+// Std. Includes
+#include <cstddef>
+
+// GL Includes
+#include <GL/glew.h>
+
+// 64 bit FNV-1a: start from Hash::Seed and fold in everything the key depends on. Used for the names of the files
+// cached between runs (ProgramCache, EnvironmentMap) and for the frame keys of the DamageTracker.
+class Hash
+{
+public:
+	static const GLuint64 Seed = 14695981039346656037ull;
+
+	static void Bytes(GLuint64& hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "LightmapBaker.h"
+
+// Grid size limit, gkom.vs declares the uniform block with the same constant
+const int PROBE_MAX = 64;
+const int PROBE_RAYS = 256;
+const GLuint PROBE_BINDING = 0;
+// Share of the gathered bounce that is applied. The lights were set up for direct light plus a small flat ambient
+// term and there is no tone mapping, at full strength the bounce off the cyan floor washes everything out
+const GLfloat PROBE_BOUNCE = 0.3f;
+
+// A grid of irradiance probes for the light bounced off the lightmapped surfaces. Each probe gathers the baked
+// colors around it (LightmapBaker::Radiance) into 9 spherical harmonics coefficients, already convolved with the
+// cosine lobe and divided by pi, so "albedo * sum(coefficient * basis(normal))" is the diffuse bounce. The grid
+// lives in a uniform block: gkom.vs interpolates the 8 probes around a vertex trilinearly and evaluates them for
+// its normal (PROBES), which leaves one multiply-add per pixel.
+class IrradianceProbes
+{
+public:
+	glm::ivec3 Counts;
+	glm::vec3 First, Spacing;		// Position of probe (0, 0, 0) and the distance between neighbours
+
+	// Probes sit at the centers of counts cells splitting the box, so none of them lies on a wall
+	IrradianceProbes(const glm::vec3& lower, const glm::vec3& upper, const glm::ivec3& counts) : Counts(counts), buffer(0)
+	{
+		this->Spacing = (upper - lower) / glm::vec3(counts);
+		this->First = lower + this->Spacing * 0.5f;
+		this->coefficients.assign(counts.x * counts.y * counts.z * 9, glm::vec3(0.0f));
+		if (counts.x * counts.y * counts.z > PROBE_MAX || glm::min(counts.x, glm::min(counts.y, counts.z)) < 2)
+			std::cout << "ERROR::PROBES::GRID_SIZE" << std::endl;
+	}
+
+	~IrradianceProbes()
+	{
+		glDeleteBuffers(1, &this->buffer);
+	}
+
+	// Projects what every probe sees onto the basis, probes shared out over all cores
+	void Bake(const LightmapBaker& scene)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		// Evenly spread directions (Fibonacci sphere), the same for every probe
+		std::vector<glm::vec3> directions(PROBE_RAYS);
+		for (int i = 0; i < PROBE_RAYS; i++)
+		{
+			GLfloat z = 1.0f - (i + 0.5f) * 2.0f / PROBE_RAYS;
+			GLfloat r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+			GLfloat phi = i * 2.39996323f;
+			directions[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+		}
+		int probeCount = this->Counts.x * this->Counts.y * this->Counts.z;
+		std::atomic<int> next(0);
+		unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.push_back(std::thread([&]()
+			{
+				for (int probe = next++; probe < probeCount; probe = next++)
+				{
+					glm::ivec3 cell(probe % this->Counts.x, (probe / this->Counts.x) % this->Counts.y, probe / (this->Counts.x * this->Counts.y));
+					glm::vec3 position = this->First + glm::vec3(cell) * this->Spacing;
+					glm::vec3 projected[9];
+					for (int c = 0; c < 9; c++)
+						projected[c] = glm::vec3(0.0f);
+					for (int r = 0; r < PROBE_RAYS; r++)
+					{
+						glm::vec3 radiance = scene.Radiance(position, directions[r]);
+						GLfloat basis[9];
+						Basis(directions[r], basis);
+						for (int c = 0; c < 9; c++)
+							projected[c] += radiance * basis[c];
+					}
+					// Monte Carlo weight 4 pi / rays, cosine lobe pi, 2 pi / 3, pi / 4 per band, then the Lambert 1 / pi and the strength
+					const GLfloat band[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+					for (int c = 0; c < 9; c++)
+						this->coefficients[probe * 9 + c] = projected[c] * (4.0f * 3.14159265f / PROBE_RAYS * PROBE_BOUNCE) * band[c];
+				}
+			}));
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		this->upload();
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "PROBES::BAKED " << probeCount << " probes, " << PROBE_RAYS << " rays each, in " << milliseconds << " ms on " << threadCount << " threads" << std::endl;
+	}
+
+	// Bounce at a point for a unit normal, the same interpolation and basis as gkom.vs
+	glm::vec3 Irradiance(const glm::vec3& position, const glm::vec3& normal) const
+	{
+		glm::vec3 grid = glm::clamp((position - this->First) / this->Spacing, glm::vec3(0.0f), glm::vec3(this->Counts - 1));
+		glm::ivec3 base = glm::min(glm::ivec3(grid), this->Counts - 2);
+		glm::vec3 fraction = grid - glm::vec3(base);
+		GLfloat basis[9];
+		Basis(normal, basis);
+		glm::vec3 result(0.0f);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::ivec3 offset(corner & 1, (corner >> 1) & 1, corner >> 2);
+			glm::vec3 weights = glm::mix(glm::vec3(1.0f) - fraction, fraction, glm::vec3(offset));
+			glm::ivec3 cell = base + offset;
+			int probe = (cell.z * this->Counts.y + cell.y) * this->Counts.x + cell.x;
+			for (int c = 0; c < 9; c++)
+				result += this->coefficients[probe * 9 + c] * (basis[c] * weights.x * weights.y * weights.z);
+		}
+		return glm::max(result, glm::vec3(0.0f));
+	}
+
+	// Attaches the grid's uniform block to program
+	void Bind(GLuint program)
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, PROBE_BINDING, this->buffer);
+		GLuint block = glGetUniformBlockIndex(program, "IrradianceProbes");
+		if (block != GL_INVALID_INDEX)
+			glUniformBlockBinding(program, block, PROBE_BINDING);
+	}
+
+	// Real spherical harmonics up to band 2
+	static void Basis(const glm::vec3& n, GLfloat basis[9])
+	{
+		basis[0] = 0.282095f;
+		basis[1] = 0.488603f * n.y;
+		basis[2] = 0.488603f * n.z;
+		basis[3] = 0.488603f * n.x;
+		basis[4] = 1.092548f * n.x * n.y;
+		basis[5] = 1.092548f * n.y * n.z;
+		basis[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+		basis[7] = 1.092548f * n.x * n.z;
+		basis[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+	}
+
+private:
+	GLuint buffer;
+	std::vector<glm::vec3> coefficients;		// 9 per probe, x fastest, then y, then z
+
+	// std140: first probe, spacing, counts, then 9 vec4 per probe
+	void upload()
+	{
+		std::vector<glm::vec4> block(3 + PROBE_MAX * 9, glm::vec4(0.0f));
+		block[0] = glm::vec4(this->First, 0.0f);
+		block[1] = glm::vec4(this->Spacing, 0.0f);
+		GLint* counts = (GLint*)&block[2];
+		counts[0] = this->Counts.x;
+		counts[1] = this->Counts.y;
+		counts[2] = this->Counts.z;
+		for (size_t i = 0; i < this->coefficients.size() && i < (size_t)PROBE_MAX * 9; i++)
+			block[3 + i] = glm::vec4(this->coefficients[i], 0.0f);
+		if (this->buffer == 0)
+			glGenBuffers(1, &this->buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+		glBufferData(GL_UNIFORM_BUFFER, block.size() * sizeof(glm::vec4), &block[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+};
@@ -0,0 +1,675 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// SSE2 is the baseline for the x86/x64 targets we build, other targets use the scalar path
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JPEG_SIMD 1
+#include <emmintrin.h>
+#endif
+
+// Baseline JPEG decoder for large textures, used by loadTexture before falling back to SOIL.
+// Entropy decoding is split across threads at restart markers (DRI), each block goes through an
+// SSE2 AAN float IDCT straight into its component plane, then upsampling and YCbCr->RGB conversion
+// run on row bands in parallel. Progressive, arithmetic coded, 12-bit and multi-scan files are
+// rejected (NULL result) so the caller can hand them to SOIL.
+class JpegDecoder
+{
+public:
+	// Decodes a file to tightly packed RGB. The pixels are malloc'ed, so SOIL_free_image_data releases them too
+	static unsigned char* Load(const char* path, int* width, int* height)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return NULL;
+		file.seekg(0, std::ios::end);
+		std::streamoff size = file.tellg();
+		if (size < 4)
+			return NULL;
+		std::vector<unsigned char> data((size_t)size);
+		file.seekg(0, std::ios::beg);
+		file.read((char*)&data[0], size);
+		return Decode(&data[0], data.size(), width, height);
+	}
+
+	// Same as Load for an in-memory file
+	static unsigned char* Decode(const unsigned char* data, size_t size, int* width, int* height)
+	{
+		JpegDecoder decoder(data, size);
+		return decoder.decode(width, height);
+	}
+
+private:
+	enum { FAST_BITS = 9 };
+
+	struct Huffman
+	{
+		unsigned char Fast[1 << FAST_BITS];	// Index of the symbol for codes up to FAST_BITS long, 255 otherwise
+		unsigned short Code[256];
+		unsigned char Size[257];
+		unsigned char Values[256];
+		unsigned int MaxCode[18];
+		int Delta[17];
+	};
+
+	struct Component
+	{
+		int Id, H, V, Quant, DcTable, AcTable;
+		int Stride, Rows;		// Plane size, padded to whole MCUs
+		int Width, Height;		// Part of the plane covering the image
+		std::vector<unsigned char> Plane;
+	};
+
+	// MSB-first bit reader over one restart interval of entropy coded data
+	struct BitReader
+	{
+		const unsigned char* Data;
+		const unsigned char* End;
+		unsigned int Buffer;
+		int Bits;
+		bool Marker;
+
+		BitReader(const unsigned char* data, const unsigned char* end) : Data(data), End(end), Buffer(0), Bits(0), Marker(false) {}
+
+		void Fill()
+		{
+			while (this->Bits <= 24)
+			{
+				unsigned int byte = 0;
+				if (!this->Marker && this->Data < this->End)
+				{
+					byte = *this->Data++;
+					if (byte == 0xFF)
+					{
+						// 0xFF00 is a stuffed 0xFF, anything else is a marker and the data ends here
+						if (this->Data < this->End && *this->Data == 0x00)
+							this->Data++;
+						else
+						{
+							this->Marker = true;
+							byte = 0;
+						}
+					}
+				}
+				this->Buffer |= byte << (24 - this->Bits);
+				this->Bits += 8;
+			}
+		}
+
+		int GetBits(int count)
+		{
+			if (this->Bits < count)
+				this->Fill();
+			unsigned int value = this->Buffer >> (32 - count);
+			this->Buffer <<= count;
+			this->Bits -= count;
+			return (int)value;
+		}
+
+		int Decode(const Huffman& table)
+		{
+			if (this->Bits < 16)
+				this->Fill();
+			int k = table.Fast[this->Buffer >> (32 - FAST_BITS)];
+			if (k < 255)
+			{
+				int size = table.Size[k];
+				this->Buffer <<= size;
+				this->Bits -= size;
+				return table.Values[k];
+			}
+			unsigned int top = this->Buffer >> 16;
+			for (k = FAST_BITS + 1; k < 17; k++)
+				if (top < table.MaxCode[k])
+					break;
+			if (k == 17)
+				return -1;
+			int index = (int)(this->Buffer >> (32 - k)) + table.Delta[k];
+			if (index < 0 || index > 255)
+				return -1;
+			this->Buffer <<= k;
+			this->Bits -= k;
+			return table.Values[index];
+		}
+	};
+
+	const unsigned char* data;
+	const unsigned char* end;
+	int width, height;
+	int restartInterval;
+	int hmax, vmax, mcusX, mcusY;
+	float quant[4][64];
+	Huffman dc[4], ac[4];
+	std::vector<Component> components;
+
+	JpegDecoder(const unsigned char* data, size_t size) : data(data), end(data + size), width(0), height(0), restartInterval(0), hmax(1), vmax(1), mcusX(0), mcusY(0) {}
+
+	static const unsigned char* zigzag()
+	{
+		static const unsigned char table[64] = {
+			0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+			12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+			35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+			58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+		return table;
+	}
+
+	static int readWord(const unsigned char* p)
+	{
+		return (p[0] << 8) | p[1];
+	}
+
+	static int extend(int value, int bits)
+	{
+		return value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+	}
+
+	static bool buildHuffman(Huffman& table, const unsigned char* counts, const unsigned char* values, int total)
+	{
+		int k = 0;
+		for (int i = 0; i < 16; i++)
+			for (int j = 0; j < counts[i]; j++)
+				table.Size[k++] = (unsigned char)(i + 1);
+		table.Size[k] = 0;
+		unsigned int code = 0;
+		k = 0;
+		for (int bits = 1; bits <= 16; bits++)
+		{
+			table.Delta[bits] = k - (int)code;
+			while (table.Size[k] == bits)
+				table.Code[k++] = (unsigned short)code++;
+			if (code > (1u << bits))
+				return false;
+			table.MaxCode[bits] = code << (16 - bits);
+			code <<= 1;
+		}
+		table.MaxCode[17] = 0xFFFFFFFF;
+		memcpy(table.Values, values, total);
+		memset(table.Fast, 255, sizeof(table.Fast));
+		for (int i = 0; i < k; i++)
+			if (table.Size[i] <= FAST_BITS)
+			{
+				int first = table.Code[i] << (FAST_BITS - table.Size[i]);
+				int count = 1 << (FAST_BITS - table.Size[i]);
+				for (int j = 0; j < count; j++)
+					table.Fast[first + j] = (unsigned char)i;
+			}
+		return true;
+	}
+
+	// Quantization table in natural order, premultiplied by the AAN IDCT scale factors and the final 1/8
+	void setQuant(int id, const int* zigzagValues)
+	{
+		static const double aan[8] = { 1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379 };
+		for (int i = 0; i < 64; i++)
+		{
+			int natural = zigzag()[i];
+			this->quant[id][natural] = (float)(zigzagValues[i] * aan[natural / 8] * aan[natural % 8] / 8.0);
+		}
+	}
+
+	unsigned char* decode(int* outWidth, int* outHeight)
+	{
+		const unsigned char* p = this->data;
+		if (this->end - p < 4 || p[0] != 0xFF || p[1] != 0xD8)
+			return NULL;
+		p += 2;
+		bool frame = false;
+		while (p + 4 <= this->end)
+		{
+			if (p[0] != 0xFF)
+				return NULL;
+			int marker = p[1];
+			if (marker == 0xFF)
+			{
+				p++;
+				continue;
+			}
+			int length = readWord(p + 2);
+			const unsigned char* segment = p + 4;
+			const unsigned char* next = p + 2 + length;
+			if (length < 2 || next > this->end)
+				return NULL;
+			switch (marker)
+			{
+			case 0xC0: case 0xC1:	// Baseline and extended sequential, Huffman coded
+				if (!this->readFrame(segment, length - 2))
+					return NULL;
+				frame = true;
+				break;
+			case 0xC4:
+				if (!this->readHuffman(segment, next))
+					return NULL;
+				break;
+			case 0xDB:
+				if (!this->readQuant(segment, next))
+					return NULL;
+				break;
+			case 0xDD:
+				this->restartInterval = readWord(segment);
+				break;
+			case 0xDA:
+			{
+				if (!frame || !this->readScan(segment, length - 2))
+					return NULL;
+				unsigned char* pixels = (unsigned char*)malloc((size_t)this->width * this->height * 3);
+				if (pixels == NULL)
+					return NULL;
+				if (!this->decodeScan(next))
+				{
+					free(pixels);
+					return NULL;
+				}
+				this->convert(pixels);
+				*outWidth = this->width;
+				*outHeight = this->height;
+				return pixels;
+			}
+			default:
+				// Every other SOFn (progressive, lossless, arithmetic) is left to the fallback decoder
+				if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+					return NULL;
+				break;
+			}
+			p = next;
+		}
+		return NULL;
+	}
+
+	bool readFrame(const unsigned char* p, int length)
+	{
+		if (length < 6 || p[0] != 8)
+			return false;
+		this->height = readWord(p + 1);
+		this->width = readWord(p + 3);
+		int count = p[5];
+		if (this->width == 0 || this->height == 0 || (count != 1 && count != 3) || length < 6 + count * 3)
+			return false;
+		this->components.resize(count);
+		for (int i = 0; i < count; i++)
+		{
+			Component& c = this->components[i];
+			c.Id = p[6 + i * 3];
+			c.H = count == 1 ? 1 : p[7 + i * 3] >> 4;
+			c.V = count == 1 ? 1 : p[7 + i * 3] & 15;
+			c.Quant = p[8 + i * 3] & 3;
+			if (c.H < 1 || c.V < 1)
+				return false;
+			this->hmax = std::max(this->hmax, c.H);
+			this->vmax = std::max(this->vmax, c.V);
+		}
+		// Upsampling handles 1x and 2x ratios (4:4:4, 4:2:2, 4:4:0, 4:2:0)
+		for (int i = 0; i < count; i++)
+		{
+			Component& c = this->components[i];
+			if ((this->hmax != c.H && this->hmax != 2 * c.H) || (this->vmax != c.V && this->vmax != 2 * c.V))
+				return false;
+		}
+		this->mcusX = (this->width + 8 * this->hmax - 1) / (8 * this->hmax);
+		this->mcusY = (this->height + 8 * this->vmax - 1) / (8 * this->vmax);
+		for (int i = 0; i < count; i++)
+		{
+			Component& c = this->components[i];
+			c.Stride = this->mcusX * c.H * 8;
+			c.Rows = this->mcusY * c.V * 8;
+			c.Width = (this->width * c.H + this->hmax - 1) / this->hmax;
+			c.Height = (this->height * c.V + this->vmax - 1) / this->vmax;
+			c.Plane.resize((size_t)c.Stride * c.Rows);
+		}
+		return true;
+	}
+
+	bool readHuffman(const unsigned char* p, const unsigned char* segmentEnd)
+	{
+		while (p + 17 <= segmentEnd)
+		{
+			int tableClass = p[0] >> 4, id = p[0] & 15;
+			int total = 0;
+			for (int i = 0; i < 16; i++)
+				total += p[1 + i];
+			if (id > 3 || tableClass > 1 || total > 256 || p + 17 + total > segmentEnd)
+				return false;
+			if (!buildHuffman(tableClass == 0 ? this->dc[id] : this->ac[id], p + 1, p + 17, total))
+				return false;
+			p += 17 + total;
+		}
+		return true;
+	}
+
+	bool readQuant(const unsigned char* p, const unsigned char* segmentEnd)
+	{
+		while (p < segmentEnd)
+		{
+			int precision = p[0] >> 4, id = p[0] & 15;
+			int bytes = precision ? 128 : 64;
+			if (id > 3 || p + 1 + bytes > segmentEnd)
+				return false;
+			int values[64];
+			for (int i = 0; i < 64; i++)
+				values[i] = precision ? readWord(p + 1 + i * 2) : p[1 + i];
+			this->setQuant(id, values);
+			p += 1 + bytes;
+		}
+		return true;
+	}
+
+	bool readScan(const unsigned char* p, int length)
+	{
+		int count = p[0];
+		// Only single-scan files where the scan carries every component
+		if (count != (int)this->components.size() || length < 4 + count * 2)
+			return false;
+		for (int i = 0; i < count; i++)
+		{
+			int id = p[1 + i * 2], tables = p[2 + i * 2];
+			Component& c = this->components[i];
+			if (c.Id != id || (tables >> 4) > 3 || (tables & 15) > 3)
+				return false;
+			c.DcTable = tables >> 4;
+			c.AcTable = tables & 15;
+		}
+		return true;
+	}
+
+	// Splits the scan at restart markers and decodes the intervals on worker threads
+	bool decodeScan(const unsigned char* scan)
+	{
+		int total = this->mcusX * this->mcusY;
+		std::vector<const unsigned char*> starts(1, scan);
+		if (this->restartInterval > 0)
+		{
+			for (const unsigned char* p = scan; p + 1 < this->end; p++)
+			{
+				if (p[0] != 0xFF || p[1] == 0x00)
+					continue;
+				if (p[1] < 0xD0 || p[1] > 0xD7)
+					break;
+				starts.push_back(p + 2);
+				p++;
+			}
+			if ((int)starts.size() < (total + this->restartInterval - 1) / this->restartInterval)
+				return false;
+		}
+		int intervals = (int)starts.size();
+		int mcusPerInterval = this->restartInterval > 0 ? this->restartInterval : total;
+
+		int threads = std::max(1, std::min((int)std::thread::hardware_concurrency(), intervals));
+		std::vector<char> ok(threads, 1);
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+		{
+			int first = intervals * t / threads, last = intervals * (t + 1) / threads;
+			workers.push_back(std::thread([this, &starts, &ok, t, first, last, mcusPerInterval, total]()
+			{
+				for (int i = first; i < last && ok[t]; i++)
+					ok[t] = this->decodeInterval(starts[i], i * mcusPerInterval, std::min((i + 1) * mcusPerInterval, total));
+			}));
+		}
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+		return std::find(ok.begin(), ok.end(), 0) == ok.end();
+	}
+
+	bool decodeInterval(const unsigned char* start, int firstMcu, int lastMcu)
+	{
+		BitReader reader(start, this->end);
+		int predictors[3] = { 0, 0, 0 };
+		float block[64];
+		const unsigned char* order = zigzag();
+		for (int mcu = firstMcu; mcu < lastMcu; mcu++)
+		{
+			int mx = mcu % this->mcusX, my = mcu / this->mcusX;
+			for (size_t ci = 0; ci < this->components.size(); ci++)
+			{
+				Component& c = this->components[ci];
+				const float* q = this->quant[c.Quant];
+				for (int v = 0; v < c.V; v++)
+					for (int h = 0; h < c.H; h++)
+					{
+						memset(block, 0, sizeof(block));
+						int t = reader.Decode(this->dc[c.DcTable]);
+						if (t < 0 || t > 16)
+							return false;
+						predictors[ci] += t ? extend(reader.GetBits(t), t) : 0;
+						block[0] = predictors[ci] * q[0];
+						for (int k = 1; k < 64;)
+						{
+							int rs = reader.Decode(this->ac[c.AcTable]);
+							if (rs < 0)
+								return false;
+							int run = rs >> 4, bits = rs & 15;
+							if (bits == 0)
+							{
+								if (run != 15)
+									break;
+								k += 16;
+								continue;
+							}
+							k += run;
+							if (k > 63)
+								return false;
+							int natural = order[k++];
+							block[natural] = extend(reader.GetBits(bits), bits) * q[natural];
+						}
+						int bx = mx * c.H + h, by = my * c.V + v;
+						idct(block, &c.Plane[(size_t)by * 8 * c.Stride + bx * 8], c.Stride);
+					}
+			}
+		}
+		return true;
+	}
+
+	// AAN float IDCT (as jidctflt.c), the dequantization table already holds the scale factors
+#ifdef JPEG_SIMD
+	static void idct1d(__m128* v)
+	{
+		const __m128 r2 = _mm_set1_ps(1.414213562f), c1 = _mm_set1_ps(1.847759065f);
+		const __m128 c2 = _mm_set1_ps(1.082392200f), c3 = _mm_set1_ps(-2.613125930f);
+		// Even part
+		__m128 tmp10 = _mm_add_ps(v[0], v[4]), tmp11 = _mm_sub_ps(v[0], v[4]);
+		__m128 tmp13 = _mm_add_ps(v[2], v[6]);
+		__m128 tmp12 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(v[2], v[6]), r2), tmp13);
+		__m128 tmp0 = _mm_add_ps(tmp10, tmp13), tmp3 = _mm_sub_ps(tmp10, tmp13);
+		__m128 tmp1 = _mm_add_ps(tmp11, tmp12), tmp2 = _mm_sub_ps(tmp11, tmp12);
+		// Odd part
+		__m128 z13 = _mm_add_ps(v[5], v[3]), z10 = _mm_sub_ps(v[5], v[3]);
+		__m128 z11 = _mm_add_ps(v[1], v[7]), z12 = _mm_sub_ps(v[1], v[7]);
+		__m128 tmp7 = _mm_add_ps(z11, z13);
+		tmp11 = _mm_mul_ps(_mm_sub_ps(z11, z13), r2);
+		__m128 z5 = _mm_mul_ps(_mm_add_ps(z10, z12), c1);
+		tmp10 = _mm_sub_ps(_mm_mul_ps(z12, c2), z5);
+		tmp12 = _mm_add_ps(_mm_mul_ps(z10, c3), z5);
+		__m128 tmp6 = _mm_sub_ps(tmp12, tmp7);
+		__m128 tmp5 = _mm_sub_ps(tmp11, tmp6);
+		__m128 tmp4 = _mm_add_ps(tmp10, tmp5);
+		v[0] = _mm_add_ps(tmp0, tmp7); v[7] = _mm_sub_ps(tmp0, tmp7);
+		v[1] = _mm_add_ps(tmp1, tmp6); v[6] = _mm_sub_ps(tmp1, tmp6);
+		v[2] = _mm_add_ps(tmp2, tmp5); v[5] = _mm_sub_ps(tmp2, tmp5);
+		v[4] = _mm_add_ps(tmp3, tmp4); v[3] = _mm_sub_ps(tmp3, tmp4);
+	}
+
+	// Transposes the 8x8 block held as left (columns 0-3) and right (columns 4-7) halves of each row
+	static void transpose(__m128* left, __m128* right)
+	{
+		_MM_TRANSPOSE4_PS(left[0], left[1], left[2], left[3]);
+		_MM_TRANSPOSE4_PS(right[4], right[5], right[6], right[7]);
+		_MM_TRANSPOSE4_PS(right[0], right[1], right[2], right[3]);
+		_MM_TRANSPOSE4_PS(left[4], left[5], left[6], left[7]);
+		for (int i = 0; i < 4; i++)
+			std::swap(right[i], left[4 + i]);
+	}
+
+	static void idct(const float* block, unsigned char* out, int stride)
+	{
+		__m128 left[8], right[8];
+		for (int i = 0; i < 8; i++)
+		{
+			left[i] = _mm_loadu_ps(block + i * 8);
+			right[i] = _mm_loadu_ps(block + i * 8 + 4);
+		}
+		// Columns, then rows on the transposed block
+		idct1d(left);
+		idct1d(right);
+		transpose(left, right);
+		idct1d(left);
+		idct1d(right);
+		transpose(left, right);
+		const __m128 bias = _mm_set1_ps(128.5f);
+		for (int i = 0; i < 8; i++)
+		{
+			__m128i low = _mm_cvttps_epi32(_mm_add_ps(left[i], bias));
+			__m128i high = _mm_cvttps_epi32(_mm_add_ps(right[i], bias));
+			__m128i words = _mm_packs_epi32(low, high);
+			_mm_storel_epi64((__m128i*)(out + i * stride), _mm_packus_epi16(words, words));
+		}
+	}
+#else
+	static void idct1d(float* v, int step)
+	{
+		float tmp10 = v[0] + v[4 * step], tmp11 = v[0] - v[4 * step];
+		float tmp13 = v[2 * step] + v[6 * step];
+		float tmp12 = (v[2 * step] - v[6 * step]) * 1.414213562f - tmp13;
+		float tmp0 = tmp10 + tmp13, tmp3 = tmp10 - tmp13;
+		float tmp1 = tmp11 + tmp12, tmp2 = tmp11 - tmp12;
+		float z13 = v[5 * step] + v[3 * step], z10 = v[5 * step] - v[3 * step];
+		float z11 = v[step] + v[7 * step], z12 = v[step] - v[7 * step];
+		float tmp7 = z11 + z13;
+		tmp11 = (z11 - z13) * 1.414213562f;
+		float z5 = (z10 + z12) * 1.847759065f;
+		tmp10 = 1.082392200f * z12 - z5;
+		tmp12 = -2.613125930f * z10 + z5;
+		float tmp6 = tmp12 - tmp7, tmp5 = tmp11 - tmp6, tmp4 = tmp10 + tmp5;
+		v[0] = tmp0 + tmp7; v[7 * step] = tmp0 - tmp7;
+		v[step] = tmp1 + tmp6; v[6 * step] = tmp1 - tmp6;
+		v[2 * step] = tmp2 + tmp5; v[5 * step] = tmp2 - tmp5;
+		v[4 * step] = tmp3 + tmp4; v[3 * step] = tmp3 - tmp4;
+	}
+
+	static void idct(const float* block, unsigned char* out, int stride)
+	{
+		float w[64];
+		memcpy(w, block, sizeof(w));
+		for (int i = 0; i < 8; i++)
+			idct1d(w + i, 8);
+		for (int i = 0; i < 8; i++)
+		{
+			idct1d(w + i * 8, 1);
+			for (int j = 0; j < 8; j++)
+				out[i * stride + j] = (unsigned char)std::min(std::max(w[i * 8 + j] + 128.5f, 0.0f), 255.0f);
+		}
+	}
+#endif
+
+	// Returns row y of a component at full resolution, with libjpeg style triangle ("fancy") upsampling
+	const unsigned char* upsampleRow(const Component& c, int y, unsigned char* out, int* colsum)
+	{
+		int sx = this->hmax / c.H, sy = this->vmax / c.V;
+		int cy = std::min(y / sy, c.Height - 1);
+		const unsigned char* row = &c.Plane[(size_t)cy * c.Stride];
+		if (sx == 1 && sy == 1)
+			return row;
+		if (sy == 2)
+		{
+			int ny = std::min(std::max((y & 1) ? cy + 1 : cy - 1, 0), c.Height - 1);
+			const unsigned char* neighbour = &c.Plane[(size_t)ny * c.Stride];
+			for (int x = 0; x < c.Width; x++)
+				colsum[x] = 3 * row[x] + neighbour[x];
+		}
+		else
+			for (int x = 0; x < c.Width; x++)
+				colsum[x] = 4 * row[x];
+		if (sx == 2)
+		{
+			// Rounding biases alternate between the two output pixels to avoid a drift, as libjpeg does
+			int leftBias = sy == 2 ? 8 : 4, rightBias = sy == 2 ? 7 : 8;
+			for (int x = 0; x < c.Width; x++)
+			{
+				int left = colsum[std::max(x - 1, 0)], centre = colsum[x], right = colsum[std::min(x + 1, c.Width - 1)];
+				out[2 * x] = (unsigned char)((3 * centre + left + leftBias) >> 4);
+				if (2 * x + 1 < this->width)
+					out[2 * x + 1] = (unsigned char)((3 * centre + right + rightBias) >> 4);
+			}
+		}
+		else
+			for (int x = 0; x < c.Width; x++)
+				out[x] = (unsigned char)((colsum[x] + 2) >> 2);
+		return out;
+	}
+
+	static void toRgb(const unsigned char* y, const unsigned char* cb, const unsigned char* cr, unsigned char* out, int width)
+	{
+		int x = 0;
+#ifdef JPEG_SIMD
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 centre = _mm_set1_ps(128.0f);
+		const __m128 crToR = _mm_set1_ps(1.402f), cbToG = _mm_set1_ps(-0.344136f), crToG = _mm_set1_ps(-0.714136f), cbToB = _mm_set1_ps(1.772f);
+		for (; x + 4 <= width; x += 4)
+		{
+			int ly, lcb, lcr;
+			memcpy(&ly, y + x, 4);
+			memcpy(&lcb, cb + x, 4);
+			memcpy(&lcr, cr + x, 4);
+			__m128 fy = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(ly), zero), zero));
+			__m128 fcb = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(lcb), zero), zero)), centre);
+			__m128 fcr = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(lcr), zero), zero)), centre);
+			__m128i r = _mm_cvtps_epi32(_mm_add_ps(fy, _mm_mul_ps(fcr, crToR)));
+			__m128i g = _mm_cvtps_epi32(_mm_add_ps(fy, _mm_add_ps(_mm_mul_ps(fcb, cbToG), _mm_mul_ps(fcr, crToG))));
+			__m128i b = _mm_cvtps_epi32(_mm_add_ps(fy, _mm_mul_ps(fcb, cbToB)));
+			__m128i blue = _mm_packs_epi32(b, b);
+			unsigned char packed[16];
+			_mm_storeu_si128((__m128i*)packed, _mm_packus_epi16(_mm_packs_epi32(r, g), blue));
+			for (int i = 0; i < 4; i++)
+			{
+				out[(x + i) * 3] = packed[i];
+				out[(x + i) * 3 + 1] = packed[4 + i];
+				out[(x + i) * 3 + 2] = packed[8 + i];
+			}
+		}
+#endif
+		for (; x < width; x++)
+		{
+			float fy = y[x], fcb = cb[x] - 128.0f, fcr = cr[x] - 128.0f;
+			float rgb[3] = { fy + 1.402f * fcr, fy - 0.344136f * fcb - 0.714136f * fcr, fy + 1.772f * fcb };
+			for (int i = 0; i < 3; i++)
+				out[x * 3 + i] = (unsigned char)std::min(std::max(rgb[i] + 0.5f, 0.0f), 255.0f);
+		}
+	}
+
+	// Upsampling and colour conversion on row bands, one band per thread
+	void convert(unsigned char* pixels)
+	{
+		int threads = std::max(1, std::min((int)std::thread::hardware_concurrency(), this->height / 64));
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+		{
+			int first = this->height * t / threads, last = this->height * (t + 1) / threads;
+			workers.push_back(std::thread([this, pixels, first, last]()
+			{
+				std::vector<unsigned char> rows(3 * (this->width + 1));
+				std::vector<int> colsum(this->width + 1);
+				for (int y = first; y < last; y++)
+				{
+					unsigned char* out = pixels + (size_t)y * this->width * 3;
+					const unsigned char* luma = this->upsampleRow(this->components[0], y, &rows[0], &colsum[0]);
+					if (this->components.size() == 1)
+					{
+						for (int x = 0; x < this->width; x++)
+							out[x * 3] = out[x * 3 + 1] = out[x * 3 + 2] = luma[x];
+						continue;
+					}
+					const unsigned char* cb = this->upsampleRow(this->components[1], y, &rows[this->width + 1], &colsum[0]);
+					const unsigned char* cr = this->upsampleRow(this->components[2], y, &rows[2 * (this->width + 1)], &colsum[0]);
+					toRgb(luma, cb, cr, out, this->width);
+				}
+			}));
+		}
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+	}
+};
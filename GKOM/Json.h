@@ -0,0 +1,296 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+// Holds the null value lookups return for whatever is missing. A class template's static member, so the header can
+// define it, and like every namespace scope object it is constructed before main: VS2013 does not make function
+// local statics thread-safe, and the glTF importer looks members up on several threads
+template <typename Value> struct JsonNull
+{
+	static const Value Instance;
+};
+template <typename Value> const Value JsonNull<Value>::Instance;
+
+// Minimal JSON document model and parser, enough for reading glTF files.
+// Objects keep their members in file order, lookups are linear which is fine for glTF sized objects.
+class JsonValue
+{
+public:
+	enum Type { NULL_VALUE, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	Type Kind;
+	bool Boolean;
+	double Number;
+	std::string String;
+	std::vector<JsonValue> Items;		// Array elements or object member values
+	std::vector<std::string> Keys;		// Object member names, parallel to Items
+
+	JsonValue() : Kind(NULL_VALUE), Boolean(false), Number(0.0) {}
+
+	// Member lookup, returns a null value when the member (or the object) does not exist
+	const JsonValue& operator[](const std::string& key) const
+	{
+		if (this->Kind == OBJECT)
+			for (size_t i = 0; i < this->Keys.size(); i++)
+				if (this->Keys[i] == key)
+					return this->Items[i];
+		return null();
+	}
+
+	// Element lookup, returns a null value when out of range
+	const JsonValue& operator[](size_t index) const
+	{
+		return this->Kind == ARRAY && index < this->Items.size() ? this->Items[index] : null();
+	}
+
+	bool Has(const std::string& key) const
+	{
+		return (*this)[key].Kind != NULL_VALUE;
+	}
+
+	size_t Size() const
+	{
+		return this->Kind == ARRAY || this->Kind == OBJECT ? this->Items.size() : 0;
+	}
+
+	double AsNumber(double fallback = 0.0) const
+	{
+		return this->Kind == NUMBER ? this->Number : fallback;
+	}
+
+	int AsInt(int fallback = 0) const
+	{
+		return this->Kind == NUMBER ? (int)this->Number : fallback;
+	}
+
+	// Parses a complete document, false on any syntax error or trailing garbage
+	static bool Parse(const char* begin, const char* end, JsonValue& out)
+	{
+		const char* p = begin;
+		if (!parseValue(p, end, out, 0))
+			return false;
+		skipSpace(p, end);
+		return p == end;
+	}
+
+private:
+	static const JsonValue& null()
+	{
+		return JsonNull<JsonValue>::Instance;
+	}
+
+	static void skipSpace(const char*& p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+			p++;
+	}
+
+	static bool literal(const char*& p, const char* end, const char* word)
+	{
+		size_t length = strlen(word);
+		if ((size_t)(end - p) < length || strncmp(p, word, length) != 0)
+			return false;
+		p += length;
+		return true;
+	}
+
+	static void appendUtf8(std::string& out, unsigned int code)
+	{
+		if (code < 0x80)
+			out += (char)code;
+		else if (code < 0x800)
+		{
+			out += (char)(0xC0 | (code >> 6));
+			out += (char)(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000)
+		{
+			out += (char)(0xE0 | (code >> 12));
+			out += (char)(0x80 | ((code >> 6) & 0x3F));
+			out += (char)(0x80 | (code & 0x3F));
+		}
+		else
+		{
+			out += (char)(0xF0 | (code >> 18));
+			out += (char)(0x80 | ((code >> 12) & 0x3F));
+			out += (char)(0x80 | ((code >> 6) & 0x3F));
+			out += (char)(0x80 | (code & 0x3F));
+		}
+	}
+
+	static bool hex4(const char*& p, const char* end, unsigned int& code)
+	{
+		if (end - p < 4)
+			return false;
+		code = 0;
+		for (int i = 0; i < 4; i++, p++)
+		{
+			char c = *p;
+			code <<= 4;
+			if (c >= '0' && c <= '9') code |= c - '0';
+			else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+			else return false;
+		}
+		return true;
+	}
+
+	static bool parseString(const char*& p, const char* end, std::string& out)
+	{
+		if (p >= end || *p != '"')
+			return false;
+		p++;
+		while (p < end && *p != '"')
+		{
+			char c = *p++;
+			if (c != '\\')
+			{
+				out += c;
+				continue;
+			}
+			if (p >= end)
+				return false;
+			char escape = *p++;
+			switch (escape)
+			{
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+			{
+				unsigned int code;
+				if (!hex4(p, end, code))
+					return false;
+				// Surrogate pair
+				if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+				{
+					p += 2;
+					unsigned int low;
+					if (!hex4(p, end, low))
+						return false;
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUtf8(out, code);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+		if (p >= end)
+			return false;
+		p++;
+		return true;
+	}
+
+	static bool parseValue(const char*& p, const char* end, JsonValue& out, int depth)
+	{
+		skipSpace(p, end);
+		if (p >= end || depth > 256)
+			return false;
+		switch (*p)
+		{
+		case '{':
+		{
+			out.Kind = OBJECT;
+			p++;
+			skipSpace(p, end);
+			if (p < end && *p == '}')
+			{
+				p++;
+				return true;
+			}
+			for (;;)
+			{
+				skipSpace(p, end);
+				out.Keys.push_back(std::string());
+				if (!parseString(p, end, out.Keys.back()))
+					return false;
+				skipSpace(p, end);
+				if (p >= end || *p++ != ':')
+					return false;
+				out.Items.push_back(JsonValue());
+				if (!parseValue(p, end, out.Items.back(), depth + 1))
+					return false;
+				skipSpace(p, end);
+				if (p >= end)
+					return false;
+				if (*p == '}')
+				{
+					p++;
+					return true;
+				}
+				if (*p++ != ',')
+					return false;
+			}
+		}
+		case '[':
+		{
+			out.Kind = ARRAY;
+			p++;
+			skipSpace(p, end);
+			if (p < end && *p == ']')
+			{
+				p++;
+				return true;
+			}
+			for (;;)
+			{
+				out.Items.push_back(JsonValue());
+				if (!parseValue(p, end, out.Items.back(), depth + 1))
+					return false;
+				skipSpace(p, end);
+				if (p >= end)
+					return false;
+				if (*p == ']')
+				{
+					p++;
+					return true;
+				}
+				if (*p++ != ',')
+					return false;
+			}
+		}
+		case '"':
+			out.Kind = STRING;
+			return parseString(p, end, out.String);
+		case 't':
+			out.Kind = BOOLEAN;
+			out.Boolean = true;
+			return literal(p, end, "true");
+		case 'f':
+			out.Kind = BOOLEAN;
+			return literal(p, end, "false");
+		case 'n':
+			return literal(p, end, "null");
+		default:
+		{
+			// strtod needs a terminated string, numbers are short so copy them out
+			char number[64];
+			size_t length = 0;
+			while (p + length < end && length < sizeof(number) - 1 && strchr("+-0123456789.eE", p[length]) != NULL)
+				length++;
+			if (length == 0)
+				return false;
+			memcpy(number, p, length);
+			number[length] = '\0';
+			char* parsed;
+			out.Kind = NUMBER;
+			out.Number = strtod(number, &parsed);
+			if (parsed != number + length)
+				return false;
+			p += length;
+			return true;
+		}
+		}
+	}
+};
@@ -0,0 +1,725 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <tuple>
+#include <functional>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtx/intersect.hpp>
+
+#include "Mesh.h"
+#include "ClusteredLights.h"
+
+const GLsizei LIGHTMAP_SIZE = 512;
+// Texels per world unit to start packing with, halved until every chart fits the atlas
+const GLfloat LIGHTMAP_DENSITY = 32.0f;
+// Empty texels around each chart, filled by dilation so bilinear filtering never reads a neighbouring chart
+const int LIGHTMAP_PADDING = 2;
+// Ambient occlusion rays per texel (a multiple of the packet width) and how far an occluder still counts
+const int LIGHTMAP_AO_RAYS = 32;
+const GLfloat LIGHTMAP_AO_DISTANCE = 1.0f;
+// Rays start this far off the surface so they do not hit the triangle they leave from
+const GLfloat LIGHTMAP_RAY_OFFSET = 1e-3f;
+
+// Bakes the lighting of static geometry into one lightmap atlas on the CPU. The meshes are unwrapped automatically:
+// edge-connected coplanar triangles form a chart, projected onto its plane and shelf packed at a common texel
+// density. Every covered texel then gets the direct diffuse and ambient terms of the static lights (what gkom.frag
+// would compute without a specular map), shadowed and ambient-occluded by rays traced through a BVH of the static
+// triangles, four rays at a time. Texels are shared out over all cores.
+class LightmapBaker
+{
+public:
+	GLuint Texture;
+	GLsizei Size;
+	GLfloat Density;
+
+	LightmapBaker(GLsizei size = LIGHTMAP_SIZE) : Texture(0), Size(size), Density(LIGHTMAP_DENSITY)
+	{
+	}
+
+	~LightmapBaker()
+	{
+		glDeleteTextures(1, &this->Texture);
+	}
+
+	// Adds a static mesh placed by model, returns the index to get its unwrapped version with. albedo is the
+	// average color of its texture, used for the light it bounces (see Radiance)
+	size_t Add(const MeshData& mesh, const glm::mat4& model, const glm::vec3& albedo = glm::vec3(1.0f))
+	{
+		const MeshHeader& h = mesh.Header;
+		glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+		GLuint cornerCount = h.IndexCount > 0 ? h.IndexCount : h.VertexCount;
+		for (GLuint t = 0; t + 2 < cornerCount; t += 3)
+		{
+			Triangle triangle;
+			triangle.Mesh = this->meshes.size();
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint vertex = h.IndexCount > 0 ? mesh.Indices[t + k] : t + k;
+				triangle.Position[k] = glm::vec3(attribute(mesh, vertex, 0));
+				triangle.Normal[k] = glm::vec3(attribute(mesh, vertex, 1));
+				triangle.TexCoords[k] = glm::vec2(attribute(mesh, vertex, 2));
+				triangle.World[k] = glm::vec3(model * glm::vec4(triangle.Position[k], 1.0f));
+				triangle.WorldNormal[k] = glm::normalize(normalMatrix * triangle.Normal[k]);
+			}
+			this->triangles.push_back(triangle);
+		}
+		this->meshes.push_back(MeshData());
+		this->albedos.push_back(albedo);
+		return this->meshes.size() - 1;
+	}
+
+	// Unwraps everything added, traces it on all cores and uploads the result. lights are the static lights,
+	// the shader must then skip exactly these. Without ambient the lights' ambient terms are left out, for when
+	// the ambient comes from elsewhere (EnvironmentMap), the alpha channel always keeps the ambient occlusion.
+	// False if the charts do not fit even at a very low density
+	bool Bake(const std::vector<PointLight>& lights, bool ambient = true)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!this->unwrap())
+		{
+			std::cout << "ERROR::LIGHTMAP::CHARTS_DO_NOT_FIT" << std::endl;
+			return false;
+		}
+		this->buildBvh();
+		this->rasterize();
+
+		// Trace
+		this->texels.assign(this->Size * this->Size, glm::vec4(0.0f));
+		this->covered.assign(this->Size * this->Size, false);
+		std::atomic<size_t> next(0);
+		unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.push_back(std::thread([&]()
+			{
+				const size_t CHUNK = 64;
+				for (size_t first = next.fetch_add(CHUNK); first < this->samples.size(); first = next.fetch_add(CHUNK))
+					for (size_t s = first; s < std::min(first + CHUNK, this->samples.size()); s++)
+						this->texels[this->samples[s].Texel] = this->shade(this->samples[s], lights, ambient);
+			}));
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		for (size_t s = 0; s < this->samples.size(); s++)
+			this->covered[this->samples[s].Texel] = true;
+		this->dilate();
+		this->upload();
+
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "LIGHTMAP::BAKED " << this->samples.size() << " texels at " << this->Density << " per unit, "
+			<< this->triangles.size() << " triangles, " << lights.size() << " lights, in " << milliseconds << " ms on " << threadCount << " threads" << std::endl;
+		return true;
+	}
+
+	// Color the static geometry shows along a ray once baked: lightmap times albedo at the closest surface, black if
+	// the ray hits the back of a surface or leaves the scene
+	glm::vec3 Radiance(const glm::vec3& origin, const glm::vec3& direction) const
+	{
+		GLfloat distance;
+		size_t triangle;
+		glm::vec2 barycentric;
+		if (!this->closestHit(origin, direction, distance, triangle, barycentric))
+			return glm::vec3(0.0f);
+		const Triangle& hit = this->triangles[triangle];
+		glm::vec2 texel = hit.Lightmap[0] * (1.0f - barycentric.x - barycentric.y) + hit.Lightmap[1] * barycentric.x + hit.Lightmap[2] * barycentric.y;
+		int x = glm::clamp((int)texel.x, 0, this->Size - 1), y = glm::clamp((int)texel.y, 0, this->Size - 1);
+		return glm::vec3(this->texels[y * this->Size + x]) * this->albedos[hit.Mesh];
+	}
+
+	// Adds irradiance(position, normal) to every texel and uploads again, e.g. light bounced off the other surfaces
+	void AddIndirect(const std::function<glm::vec3(const glm::vec3&, const glm::vec3&)>& irradiance)
+	{
+		this->covered.assign(this->Size * this->Size, false);
+		for (size_t s = 0; s < this->samples.size(); s++)
+		{
+			this->texels[this->samples[s].Texel] += glm::vec4(irradiance(this->samples[s].Position, this->samples[s].Normal), 0.0f);
+			this->covered[this->samples[s].Texel] = true;
+		}
+		this->dilate();
+		this->upload();
+	}
+
+	// World space box around everything added, valid once baked
+	void Bounds(glm::vec3& lower, glm::vec3& upper) const
+	{
+		lower = this->nodes.empty() ? glm::vec3(0.0f) : this->nodes[0].Lower;
+		upper = this->nodes.empty() ? glm::vec3(0.0f) : this->nodes[0].Upper;
+	}
+
+	// The mesh passed to Add with its lightmap coordinates as attribute 3, unindexed since charts split vertices
+	const MeshData& Unwrapped(size_t mesh) const
+	{
+		return this->meshes[mesh];
+	}
+
+private:
+	struct Triangle
+	{
+		size_t Mesh;
+		glm::vec3 Position[3], Normal[3];
+		glm::vec2 TexCoords[3];
+		glm::vec3 World[3], WorldNormal[3];
+		glm::vec2 Lightmap[3];		// In atlas texels
+	};
+
+	struct Chart
+	{
+		std::vector<size_t> Triangles;
+		glm::vec3 AxisU, AxisV;
+		glm::vec2 Lower, Upper;		// Projected onto the axes, world units
+		int X, Y, Width, Height;	// Atlas rectangle including the padding
+	};
+
+	// A covered texel and the surface point its center maps to
+	struct Sample
+	{
+		size_t Texel;
+		glm::vec3 Position, Normal;
+	};
+
+	// Leaves have Count > 0 and own triangles First .. First + Count - 1, inner nodes have their children at First and First + 1
+	struct BvhNode
+	{
+		glm::vec3 Lower, Upper;
+		GLuint First, Count;
+	};
+
+	// Four rays in structure-of-arrays form, traced together through the BVH
+	struct RayPacket
+	{
+		glm::vec4 OriginX, OriginY, OriginZ;
+		glm::vec4 DirectionX, DirectionY, DirectionZ;
+		glm::vec4 InverseX, InverseY, InverseZ;
+		glm::vec4 Length;
+		int Active;					// Lane bit mask
+
+		RayPacket() : Active(0) {}
+
+		void Set(int lane, const glm::vec3& origin, const glm::vec3& direction, GLfloat length)
+		{
+			this->OriginX[lane] = origin.x;
+			this->OriginY[lane] = origin.y;
+			this->OriginZ[lane] = origin.z;
+			this->DirectionX[lane] = direction.x;
+			this->DirectionY[lane] = direction.y;
+			this->DirectionZ[lane] = direction.z;
+			this->InverseX[lane] = 1.0f / direction.x;
+			this->InverseY[lane] = 1.0f / direction.y;
+			this->InverseZ[lane] = 1.0f / direction.z;
+			this->Length[lane] = length;
+			this->Active |= 1 << lane;
+		}
+	};
+
+	std::vector<Triangle> triangles;
+	std::vector<MeshData> meshes;
+	std::vector<glm::vec3> albedos;
+	std::vector<Chart> charts;
+	std::vector<Sample> samples;
+	std::vector<BvhNode> nodes;
+	std::vector<size_t> bvhTriangles;
+	std::vector<glm::vec4> texels;		// Light in rgb, ambient occlusion in alpha
+	std::vector<bool> covered;
+
+	// Reads one vertex attribute as floats, converting the normalized integer forms imported meshes may use
+	static glm::vec4 attribute(const MeshData& mesh, GLuint vertex, GLuint location)
+	{
+		glm::vec4 value(0.0f);
+		const MeshHeader& h = mesh.Header;
+		for (GLuint i = 0; i < h.AttributeCount; i++)
+		{
+			const VertexAttribute& a = h.Attributes[i];
+			if (a.Location != location)
+				continue;
+			const unsigned char* data = mesh.Vertices + vertex * h.Stride + a.Offset;
+			for (int c = 0; c < a.Components && c < 4; c++)
+			{
+				if (a.Type == GL_FLOAT)
+					value[c] = ((const GLfloat*)data)[c];
+				else if (a.Type == GL_UNSIGNED_SHORT)
+					value[c] = ((const GLushort*)data)[c] / (a.Normalized ? 65535.0f : 1.0f);
+				else if (a.Type == GL_UNSIGNED_BYTE)
+					value[c] = data[c] / (a.Normalized ? 255.0f : 1.0f);
+			}
+		}
+		return value;
+	}
+
+	// 1. Charts: flood fill over shared edges while the face normal stays that of the first triangle
+	bool unwrap()
+	{
+		std::vector<glm::vec3> faceNormals(this->triangles.size());
+		typedef std::tuple<int, int, int, int, int, int> EdgeKey;
+		std::map<EdgeKey, std::vector<size_t> > edges;
+		for (size_t t = 0; t < this->triangles.size(); t++)
+		{
+			const Triangle& triangle = this->triangles[t];
+			glm::vec3 normal = glm::cross(triangle.World[1] - triangle.World[0], triangle.World[2] - triangle.World[0]);
+			faceNormals[t] = glm::length(normal) > 0.0f ? glm::normalize(normal) : triangle.WorldNormal[0];
+			for (int k = 0; k < 3; k++)
+				edges[edgeKey(triangle.World[k], triangle.World[(k + 1) % 3])].push_back(t);
+		}
+
+		this->charts.clear();
+		std::vector<bool> charted(this->triangles.size(), false);
+		for (size_t seed = 0; seed < this->triangles.size(); seed++)
+		{
+			if (charted[seed])
+				continue;
+			Chart chart;
+			glm::vec3 normal = faceNormals[seed];
+			chart.AxisU = glm::normalize(glm::cross(normal, std::fabs(normal.y) < 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+			chart.AxisV = glm::cross(normal, chart.AxisU);
+			charted[seed] = true;
+			std::vector<size_t> open(1, seed);
+			while (!open.empty())
+			{
+				size_t t = open.back();
+				open.pop_back();
+				chart.Triangles.push_back(t);
+				for (int k = 0; k < 3; k++)
+				{
+					const std::vector<size_t>& neighbours = edges[edgeKey(this->triangles[t].World[k], this->triangles[t].World[(k + 1) % 3])];
+					for (size_t n = 0; n < neighbours.size(); n++)
+						if (!charted[neighbours[n]] && glm::dot(faceNormals[neighbours[n]], normal) > 0.999f)
+						{
+							charted[neighbours[n]] = true;
+							open.push_back(neighbours[n]);
+						}
+				}
+			}
+			chart.Lower = glm::vec2(FLT_MAX);
+			chart.Upper = glm::vec2(-FLT_MAX);
+			for (size_t i = 0; i < chart.Triangles.size(); i++)
+				for (int k = 0; k < 3; k++)
+				{
+					const glm::vec3& p = this->triangles[chart.Triangles[i]].World[k];
+					glm::vec2 projected(glm::dot(p, chart.AxisU), glm::dot(p, chart.AxisV));
+					chart.Lower = glm::min(chart.Lower, projected);
+					chart.Upper = glm::max(chart.Upper, projected);
+				}
+			this->charts.push_back(chart);
+		}
+
+		// 2. Pack, tallest charts first, at the highest density that fits
+		for (this->Density = LIGHTMAP_DENSITY; this->Density >= 0.5f; this->Density *= 0.5f)
+			if (this->pack())
+				break;
+		if (this->Density < 0.5f)
+			return false;
+
+		// 3. Lightmap coordinates and the unwrapped meshes
+		std::vector<std::vector<GLfloat> > vertices(this->meshes.size());
+		for (size_t c = 0; c < this->charts.size(); c++)
+		{
+			const Chart& chart = this->charts[c];
+			for (size_t i = 0; i < chart.Triangles.size(); i++)
+			{
+				Triangle& triangle = this->triangles[chart.Triangles[i]];
+				for (int k = 0; k < 3; k++)
+				{
+					glm::vec2 projected(glm::dot(triangle.World[k], chart.AxisU), glm::dot(triangle.World[k], chart.AxisV));
+					triangle.Lightmap[k] = glm::vec2(chart.X + LIGHTMAP_PADDING, chart.Y + LIGHTMAP_PADDING) + (projected - chart.Lower) * this->Density;
+				}
+			}
+		}
+		for (size_t t = 0; t < this->triangles.size(); t++)
+		{
+			const Triangle& triangle = this->triangles[t];
+			for (int k = 0; k < 3; k++)
+			{
+				GLfloat vertex[10] = { triangle.Position[k].x, triangle.Position[k].y, triangle.Position[k].z,
+					triangle.Normal[k].x, triangle.Normal[k].y, triangle.Normal[k].z, triangle.TexCoords[k].x, triangle.TexCoords[k].y,
+					triangle.Lightmap[k].x / this->Size, triangle.Lightmap[k].y / this->Size };
+				vertices[triangle.Mesh].insert(vertices[triangle.Mesh].end(), vertex, vertex + 10);
+			}
+		}
+		for (size_t m = 0; m < this->meshes.size(); m++)
+			this->meshes[m] = MeshData::FromVertices(vertices[m], std::vector<GLuint>(), true);
+		return true;
+	}
+
+	static std::tuple<int, int, int, int, int, int> edgeKey(const glm::vec3& a, const glm::vec3& b)
+	{
+		glm::ivec3 p = glm::ivec3(glm::round(a * 1e4f)), q = glm::ivec3(glm::round(b * 1e4f));
+		if (std::make_tuple(q.x, q.y, q.z) < std::make_tuple(p.x, p.y, p.z))
+			std::swap(p, q);
+		return std::make_tuple(p.x, p.y, p.z, q.x, q.y, q.z);
+	}
+
+	// Shelf packing, false if the atlas is too small at the current density
+	bool pack()
+	{
+		std::vector<size_t> order(this->charts.size());
+		for (size_t c = 0; c < this->charts.size(); c++)
+		{
+			Chart& chart = this->charts[c];
+			glm::vec2 extent = (chart.Upper - chart.Lower) * this->Density;
+			chart.Width = (int)std::ceil(extent.x) + 1 + 2 * LIGHTMAP_PADDING;
+			chart.Height = (int)std::ceil(extent.y) + 1 + 2 * LIGHTMAP_PADDING;
+			order[c] = c;
+		}
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return this->charts[a].Height > this->charts[b].Height; });
+		int x = 0, y = 0, shelfHeight = 0;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			Chart& chart = this->charts[order[i]];
+			if (chart.Width > this->Size)
+				return false;
+			if (x + chart.Width > this->Size)
+			{
+				x = 0;
+				y += shelfHeight;
+				shelfHeight = 0;
+			}
+			if (y + chart.Height > this->Size)
+				return false;
+			chart.X = x;
+			chart.Y = y;
+			x += chart.Width;
+			shelfHeight = std::max(shelfHeight, chart.Height);
+		}
+		return true;
+	}
+
+	// Finds the surface point under every texel center a chart covers
+	void rasterize()
+	{
+		this->samples.clear();
+		for (size_t c = 0; c < this->charts.size(); c++)
+		{
+			const Chart& chart = this->charts[c];
+			for (int y = chart.Y; y < chart.Y + chart.Height; y++)
+				for (int x = chart.X; x < chart.X + chart.Width; x++)
+				{
+					glm::vec2 center(x + 0.5f, y + 0.5f);
+					for (size_t i = 0; i < chart.Triangles.size(); i++)
+					{
+						const Triangle& triangle = this->triangles[chart.Triangles[i]];
+						glm::vec2 e1 = triangle.Lightmap[1] - triangle.Lightmap[0], e2 = triangle.Lightmap[2] - triangle.Lightmap[0], d = center - triangle.Lightmap[0];
+						GLfloat area = e1.x * e2.y - e1.y * e2.x;
+						if (std::fabs(area) < 1e-8f)
+							continue;
+						GLfloat u = (d.x * e2.y - d.y * e2.x) / area, v = (e1.x * d.y - e1.y * d.x) / area;
+						if (u < -1e-4f || v < -1e-4f || u + v > 1.0001f)
+							continue;
+						Sample sample;
+						sample.Texel = y * this->Size + x;
+						sample.Position = triangle.World[0] * (1.0f - u - v) + triangle.World[1] * u + triangle.World[2] * v;
+						sample.Normal = glm::normalize(triangle.WorldNormal[0] * (1.0f - u - v) + triangle.WorldNormal[1] * u + triangle.WorldNormal[2] * v);
+						this->samples.push_back(sample);
+						break;
+					}
+				}
+		}
+	}
+
+	// Same terms as CalcPointLight in gkom.frag minus the specular, plus ambient occlusion on the ambient term,
+	// which also goes out in alpha
+	glm::vec4 shade(const Sample& sample, const std::vector<PointLight>& lights, bool ambient) const
+	{
+		glm::vec3 origin = sample.Position + sample.Normal * LIGHTMAP_RAY_OFFSET;
+
+		// Ambient occlusion: cosine weighted directions, rotated per texel so the pattern does not band
+		glm::vec3 tangent = glm::normalize(glm::cross(sample.Normal, std::fabs(sample.Normal.y) < 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+		glm::vec3 bitangent = glm::cross(sample.Normal, tangent);
+		GLfloat rotation = (GLfloat)((sample.Texel * 2654435761u) % 1024) / 1024.0f * 6.28318531f;
+		int occluded = 0;
+		for (int first = 0; first < LIGHTMAP_AO_RAYS; first += 4)
+		{
+			RayPacket packet;
+			for (int lane = 0; lane < 4; lane++)
+			{
+				int i = first + lane;
+				// Stratified in radius, golden angle in azimuth
+				GLfloat r = std::sqrt((i + 0.5f) / LIGHTMAP_AO_RAYS);
+				GLfloat phi = rotation + i * 2.39996323f;
+				glm::vec3 direction = tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + sample.Normal * std::sqrt(std::max(0.0f, 1.0f - r * r));
+				packet.Set(lane, origin, direction, LIGHTMAP_AO_DISTANCE);
+			}
+			int hits = this->occluded(packet);
+			for (int lane = 0; lane < 4; lane++)
+				occluded += (hits >> lane) & 1;
+		}
+		GLfloat ambientOcclusion = 1.0f - (GLfloat)occluded / LIGHTMAP_AO_RAYS;
+
+		// Direct light, shadow rays for four lights per packet
+		glm::vec3 result(0.0f);
+		for (size_t first = 0; first < lights.size(); first += 4)
+		{
+			RayPacket packet;
+			glm::vec3 direct[4];
+			for (int lane = 0; lane < 4 && first + lane < lights.size(); lane++)
+			{
+				const PointLight& light = lights[first + lane];
+				glm::vec3 toLight = light.Position - sample.Position;
+				GLfloat distance = glm::length(toLight);
+				// The shader skips lights past their radius
+				if (distance > light.Radius || distance <= 0.0f)
+					continue;
+				GLfloat attenuation = 1.0f / (light.Constant + light.Linear * distance + light.Quadratic * distance * distance);
+				if (ambient)
+					result += light.Ambient * attenuation * ambientOcclusion;
+				GLfloat diffuse = glm::dot(sample.Normal, toLight / distance);
+				direct[lane] = light.Diffuse * diffuse * attenuation;
+				// Measured from the offset origin: a light sitting on a surface (the ceiling lamp) must not be hidden by it
+				glm::vec3 toLightFromOrigin = light.Position - origin;
+				GLfloat length = glm::length(toLightFromOrigin);
+				if (diffuse > 0.0f)
+					packet.Set(lane, origin, toLightFromOrigin / length, length - LIGHTMAP_RAY_OFFSET);
+			}
+			int shadowed = this->occluded(packet);
+			for (int lane = 0; lane < 4; lane++)
+				if ((packet.Active >> lane) & 1 && !((shadowed >> lane) & 1))
+					result += direct[lane];
+		}
+		return glm::vec4(result, ambientOcclusion);
+	}
+
+	// Median split along the longest axis of the centroids, up to four triangles per leaf
+	void buildBvh()
+	{
+		this->nodes.clear();
+		this->bvhTriangles.resize(this->triangles.size());
+		for (size_t t = 0; t < this->triangles.size(); t++)
+			this->bvhTriangles[t] = t;
+		BvhNode root;
+		root.First = 0;
+		root.Count = (GLuint)this->triangles.size();
+		this->nodes.push_back(root);
+		std::vector<GLuint> open(1, 0);
+		while (!open.empty())
+		{
+			GLuint index = open.back();
+			open.pop_back();
+			BvhNode node = this->nodes[index];
+			node.Lower = glm::vec3(FLT_MAX);
+			node.Upper = glm::vec3(-FLT_MAX);
+			glm::vec3 centroidLower(FLT_MAX), centroidUpper(-FLT_MAX);
+			for (GLuint i = node.First; i < node.First + node.Count; i++)
+			{
+				const Triangle& triangle = this->triangles[this->bvhTriangles[i]];
+				for (int k = 0; k < 3; k++)
+				{
+					node.Lower = glm::min(node.Lower, triangle.World[k]);
+					node.Upper = glm::max(node.Upper, triangle.World[k]);
+				}
+				glm::vec3 centroid = (triangle.World[0] + triangle.World[1] + triangle.World[2]) / 3.0f;
+				centroidLower = glm::min(centroidLower, centroid);
+				centroidUpper = glm::max(centroidUpper, centroid);
+			}
+			if (node.Count > 4)
+			{
+				glm::vec3 extent = centroidUpper - centroidLower;
+				int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+				GLuint middle = node.First + node.Count / 2;
+				std::nth_element(this->bvhTriangles.begin() + node.First, this->bvhTriangles.begin() + middle, this->bvhTriangles.begin() + node.First + node.Count, [&](size_t a, size_t b)
+				{
+					const Triangle& ta = this->triangles[a];
+					const Triangle& tb = this->triangles[b];
+					return ta.World[0][axis] + ta.World[1][axis] + ta.World[2][axis] < tb.World[0][axis] + tb.World[1][axis] + tb.World[2][axis];
+				});
+				BvhNode left, right;
+				left.First = node.First;
+				left.Count = middle - node.First;
+				right.First = middle;
+				right.Count = node.First + node.Count - middle;
+				node.First = (GLuint)this->nodes.size();
+				node.Count = 0;
+				this->nodes.push_back(left);
+				this->nodes.push_back(right);
+				open.push_back(node.First);
+				open.push_back(node.First + 1);
+			}
+			this->nodes[index] = node;
+		}
+	}
+
+	// Lane mask of the active rays that hit something within their length. The packet descends into every node
+	// one of its rays still enters; a leaf with a single ray left falls back to glm::intersectRayTriangle
+	int occluded(const RayPacket& packet) const
+	{
+		int hits = 0;
+		if (packet.Active == 0 || this->nodes.empty())
+			return hits;
+		GLuint stack[64];
+		int depth = 0;
+		stack[depth++] = 0;
+		while (depth > 0)
+		{
+			const BvhNode& node = this->nodes[stack[--depth]];
+			int live = packet.Active & ~hits;
+			if (live == 0)
+				break;
+			// Slab test, all four lanes at once
+			glm::vec4 x0 = (glm::vec4(node.Lower.x) - packet.OriginX) * packet.InverseX, x1 = (glm::vec4(node.Upper.x) - packet.OriginX) * packet.InverseX;
+			glm::vec4 y0 = (glm::vec4(node.Lower.y) - packet.OriginY) * packet.InverseY, y1 = (glm::vec4(node.Upper.y) - packet.OriginY) * packet.InverseY;
+			glm::vec4 z0 = (glm::vec4(node.Lower.z) - packet.OriginZ) * packet.InverseZ, z1 = (glm::vec4(node.Upper.z) - packet.OriginZ) * packet.InverseZ;
+			glm::vec4 enter = glm::max(glm::max(glm::min(x0, x1), glm::min(y0, y1)), glm::min(z0, z1));
+			glm::vec4 exit = glm::min(glm::min(glm::max(x0, x1), glm::max(y0, y1)), glm::max(z0, z1));
+			int inside = 0;
+			for (int lane = 0; lane < 4; lane++)
+				if (exit[lane] >= std::max(enter[lane], 0.0f) && enter[lane] <= packet.Length[lane])
+					inside |= 1 << lane;
+			inside &= live;
+			if (inside == 0)
+				continue;
+			if (node.Count == 0)
+			{
+				stack[depth++] = node.First;
+				stack[depth++] = node.First + 1;
+				continue;
+			}
+			for (GLuint i = node.First; i < node.First + node.Count && inside != 0; i++)
+			{
+				int hit = intersect(packet, this->triangles[this->bvhTriangles[i]], inside);
+				hits |= hit;
+				inside &= ~hit;
+			}
+		}
+		return hits;
+	}
+
+	// Nearest triangle along a single ray, false if there is none or the ray meets its back
+	bool closestHit(const glm::vec3& origin, const glm::vec3& direction, GLfloat& distance, size_t& triangle, glm::vec2& barycentric) const
+	{
+		distance = FLT_MAX;
+		bool front = false;
+		glm::vec3 inverse = 1.0f / direction;
+		GLuint stack[64];
+		int depth = 0;
+		if (!this->nodes.empty())
+			stack[depth++] = 0;
+		while (depth > 0)
+		{
+			const BvhNode& node = this->nodes[stack[--depth]];
+			glm::vec3 t0 = (node.Lower - origin) * inverse, t1 = (node.Upper - origin) * inverse;
+			glm::vec3 near3 = glm::min(t0, t1), far3 = glm::max(t0, t1);
+			GLfloat enter = std::max(std::max(near3.x, near3.y), near3.z), exit = std::min(std::min(far3.x, far3.y), far3.z);
+			if (exit < std::max(enter, 0.0f) || enter > distance)
+				continue;
+			if (node.Count == 0)
+			{
+				stack[depth++] = node.First;
+				stack[depth++] = node.First + 1;
+				continue;
+			}
+			for (GLuint i = node.First; i < node.First + node.Count; i++)
+			{
+				const Triangle& candidate = this->triangles[this->bvhTriangles[i]];
+				// Both sides: glm::intersectRayTriangle only reports front faces, so try the back with the winding reversed
+				glm::vec3 hit;
+				bool isFront = glm::intersectRayTriangle(origin, direction, candidate.World[0], candidate.World[1], candidate.World[2], hit);
+				if (!isFront && glm::intersectRayTriangle(origin, direction, candidate.World[0], candidate.World[2], candidate.World[1], hit))
+					std::swap(hit.x, hit.y);
+				else if (!isFront)
+					continue;
+				if (hit.z < distance)
+				{
+					distance = hit.z;
+					triangle = this->bvhTriangles[i];
+					barycentric = glm::vec2(hit.x, hit.y);
+					front = isFront;
+				}
+			}
+		}
+		return distance < FLT_MAX && front;
+	}
+
+	// Moller-Trumbore for the lanes in mask, front faces only like glm::intersectRayTriangle
+	static int intersect(const RayPacket& packet, const Triangle& triangle, int mask)
+	{
+		const glm::vec3& v0 = triangle.World[0];
+		if ((mask & (mask - 1)) == 0)
+		{
+			int lane = mask == 1 ? 0 : mask == 2 ? 1 : mask == 4 ? 2 : 3;
+			glm::vec3 origin(packet.OriginX[lane], packet.OriginY[lane], packet.OriginZ[lane]);
+			glm::vec3 direction(packet.DirectionX[lane], packet.DirectionY[lane], packet.DirectionZ[lane]);
+			glm::vec3 barycentric;
+			if (glm::intersectRayTriangle(origin, direction, v0, triangle.World[1], triangle.World[2], barycentric) && barycentric.z < packet.Length[lane])
+				return mask;
+			return 0;
+		}
+		glm::vec3 e1 = triangle.World[1] - v0, e2 = triangle.World[2] - v0;
+		// p = direction x e2, a = e1 . p
+		glm::vec4 px = packet.DirectionY * e2.z - packet.DirectionZ * e2.y;
+		glm::vec4 py = packet.DirectionZ * e2.x - packet.DirectionX * e2.z;
+		glm::vec4 pz = packet.DirectionX * e2.y - packet.DirectionY * e2.x;
+		glm::vec4 a = px * e1.x + py * e1.y + pz * e1.z;
+		glm::vec4 f = glm::vec4(1.0f) / a;
+		// s = origin - v0, u = f (s . p)
+		glm::vec4 sx = packet.OriginX - v0.x, sy = packet.OriginY - v0.y, sz = packet.OriginZ - v0.z;
+		glm::vec4 u = f * (sx * px + sy * py + sz * pz);
+		// q = s x e1, v = f (direction . q), t = f (e2 . q)
+		glm::vec4 qx = sy * e1.z - sz * e1.y;
+		glm::vec4 qy = sz * e1.x - sx * e1.z;
+		glm::vec4 qz = sx * e1.y - sy * e1.x;
+		glm::vec4 v = f * (packet.DirectionX * qx + packet.DirectionY * qy + packet.DirectionZ * qz);
+		glm::vec4 t = f * (qx * e2.x + qy * e2.y + qz * e2.z);
+		int hits = 0;
+		for (int lane = 0; lane < 4; lane++)
+			if ((mask >> lane) & 1 && a[lane] > FLT_EPSILON && u[lane] >= 0.0f && v[lane] >= 0.0f && u[lane] + v[lane] <= 1.0f && t[lane] >= 0.0f && t[lane] < packet.Length[lane])
+				hits |= 1 << lane;
+		return hits;
+	}
+
+	// Grows the charts into their padding, so filtering at chart edges blends with the edge's own lighting
+	void dilate()
+	{
+		for (int pass = 0; pass < LIGHTMAP_PADDING; pass++)
+		{
+			std::vector<glm::vec4> grown = this->texels;
+			std::vector<bool> grownCovered = this->covered;
+			for (int y = 0; y < this->Size; y++)
+				for (int x = 0; x < this->Size; x++)
+				{
+					if (this->covered[y * this->Size + x])
+						continue;
+					glm::vec4 sum(0.0f);
+					int count = 0;
+					for (int dy = -1; dy <= 1; dy++)
+						for (int dx = -1; dx <= 1; dx++)
+						{
+							int nx = x + dx, ny = y + dy;
+							if (nx >= 0 && ny >= 0 && nx < this->Size && ny < this->Size && this->covered[ny * this->Size + nx])
+							{
+								sum += this->texels[ny * this->Size + nx];
+								count++;
+							}
+						}
+					if (count > 0)
+					{
+						grown[y * this->Size + x] = sum / (GLfloat)count;
+						grownCovered[y * this->Size + x] = true;
+					}
+				}
+			this->texels.swap(grown);
+			this->covered.swap(grownCovered);
+		}
+	}
+
+	void upload()
+	{
+		if (this->Texture == 0)
+			glGenTextures(1, &this->Texture);
+		glBindTexture(GL_TEXTURE_2D, this->Texture);
+		// Half floats: several lights can add up past 1
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, this->Size, this->Size, 0, GL_RGBA, GL_FLOAT, &this->texels[0]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+};
@@ -0,0 +1,378 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AssetPack.h"
+#include "MeshOptimizer.h"
+
+const unsigned int MESH_VERSION = 1;
+const unsigned int MESH_MAX_ATTRIBUTES = 8;
+
+// Describes one vertex attribute the way glVertexAttribPointer wants it
+struct VertexAttribute
+{
+	GLuint Location;
+	GLint Components;
+	GLenum Type;
+	GLuint Normalized;
+	GLuint Offset;		// Byte offset inside a vertex
+};
+
+// Fixed size header at the start of every .mesh file, followed by the vertex data and then the (optional) 32-bit indices.
+// Both blocks are 16 byte aligned so a mapped file can be uploaded directly.
+struct MeshHeader
+{
+	char Magic[4];			// "GMSH"
+	GLuint Version;
+	GLuint VertexCount;
+	GLuint IndexCount;		// 0 for non-indexed triangle lists
+	GLuint Stride;
+	GLuint AttributeCount;
+	GLuint VertexOffset;
+	GLuint IndexOffset;
+	GLfloat BoundsMin[3];
+	GLfloat BoundsMax[3];
+	VertexAttribute Attributes[MESH_MAX_ATTRIBUTES];
+};
+
+// CPU side of a mesh: header plus pointers to the vertex and index bytes. The bytes either live in the
+// asset pack mapping (loaded meshes) or in the vectors owned by this object (converted or generated meshes).
+class MeshData
+{
+public:
+	MeshHeader Header;
+	const unsigned char* Vertices;
+	const GLuint* Indices;
+
+	MeshData() : Vertices(NULL), Indices(NULL)
+	{
+		memset(&this->Header, 0, sizeof(this->Header));
+	}
+
+	MeshData(const MeshData& other)
+	{
+		*this = other;
+	}
+
+	MeshData& operator=(const MeshData& other)
+	{
+		this->Header = other.Header;
+		this->ownedVertices = other.ownedVertices;
+		this->ownedIndices = other.ownedIndices;
+		// Owned data has to point at our own copy, borrowed data keeps pointing into the mapping
+		this->Vertices = other.ownedVertices.empty() ? other.Vertices : &this->ownedVertices[0];
+		this->Indices = other.ownedIndices.empty() ? other.Indices : &this->ownedIndices[0];
+		return *this;
+	}
+
+	// Interprets a .mesh file in memory without copying it, false if it is not a mesh this build understands
+	bool Parse(const AssetView& file)
+	{
+		if (!file.IsValid() || file.Size < sizeof(MeshHeader))
+			return false;
+		memcpy(&this->Header, file.Data, sizeof(MeshHeader));
+		const MeshHeader& h = this->Header;
+		if (memcmp(h.Magic, "GMSH", 4) != 0 || h.Version == 0 || h.Version > MESH_VERSION || h.AttributeCount > MESH_MAX_ATTRIBUTES)
+			return false;
+		if ((unsigned long long)h.VertexOffset + (unsigned long long)h.VertexCount * h.Stride > file.Size
+			|| (unsigned long long)h.IndexOffset + (unsigned long long)h.IndexCount * sizeof(GLuint) > file.Size)
+			return false;
+		this->Vertices = file.Data + h.VertexOffset;
+		this->Indices = h.IndexCount > 0 ? (const GLuint*)(file.Data + h.IndexOffset) : NULL;
+		return true;
+	}
+
+	// Builds a mesh from interleaved floats in the scene's standard layout: position, normal, texture coordinates,
+	// followed by lightmap coordinates (attribute 3) when lightmapCoords is set
+	static MeshData FromVertices(const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices = std::vector<GLuint>(), bool lightmapCoords = false)
+	{
+		MeshData mesh;
+		MeshHeader& h = mesh.Header;
+		GLuint floats = lightmapCoords ? 10 : 8;
+		memcpy(h.Magic, "GMSH", 4);
+		h.Version = MESH_VERSION;
+		h.Stride = floats * sizeof(GLfloat);
+		h.VertexCount = (GLuint)(vertices.size() / floats);
+		h.IndexCount = (GLuint)indices.size();
+		VertexAttribute layout[4] = {
+			{ 0, 3, GL_FLOAT, GL_FALSE, 0 },
+			{ 1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat) },
+			{ 2, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat) },
+			{ 3, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat) } };
+		h.AttributeCount = lightmapCoords ? 4 : 3;
+		memcpy(h.Attributes, layout, h.AttributeCount * sizeof(VertexAttribute));
+		h.VertexOffset = align16(sizeof(MeshHeader));
+		h.IndexOffset = h.IndexCount > 0 ? align16(h.VertexOffset + h.VertexCount * h.Stride) : 0;
+
+		glm::vec3 lower(FLT_MAX), upper(-FLT_MAX);
+		for (GLuint i = 0; i < h.VertexCount; i++)
+		{
+			glm::vec3 position(vertices[i * floats], vertices[i * floats + 1], vertices[i * floats + 2]);
+			lower = glm::min(lower, position);
+			upper = glm::max(upper, position);
+		}
+		if (h.VertexCount == 0)
+			lower = upper = glm::vec3(0.0f);
+		for (int i = 0; i < 3; i++)
+		{
+			h.BoundsMin[i] = lower[i];
+			h.BoundsMax[i] = upper[i];
+		}
+
+		mesh.ownedVertices.resize(h.VertexCount * h.Stride);
+		if (!mesh.ownedVertices.empty())
+			memcpy(&mesh.ownedVertices[0], &vertices[0], mesh.ownedVertices.size());
+		mesh.ownedIndices = indices;
+		mesh.Vertices = mesh.ownedVertices.empty() ? NULL : &mesh.ownedVertices[0];
+		mesh.Indices = mesh.ownedIndices.empty() ? NULL : &mesh.ownedIndices[0];
+		return mesh;
+	}
+
+	// Reads the text vertex lists the scene used to keep inline: comma/whitespace separated floats, 8 per vertex
+	// (position, normal, texture coordinates), "//" starts a comment
+	static bool FromText(const std::string& path, MeshData& mesh)
+	{
+		std::ifstream file(path.c_str());
+		if (!file)
+			return false;
+		std::vector<GLfloat> vertices;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			line = line.substr(0, line.find("//"));
+			std::replace(line.begin(), line.end(), ',', ' ');
+			std::istringstream values(line);
+			std::string value;
+			while (values >> value)
+			{
+				char* end;
+				GLfloat number = (GLfloat)strtod(value.c_str(), &end);
+				if (*end != '\0')
+				{
+					std::cout << "ERROR::MESH::BAD_NUMBER " << value << " in " << path << std::endl;
+					return false;
+				}
+				vertices.push_back(number);
+			}
+		}
+		if (vertices.size() % 8 != 0)
+		{
+			std::cout << "ERROR::MESH::INCOMPLETE_VERTEX in " << path << std::endl;
+			return false;
+		}
+		// The hand-written lists mix windings, orient them by their normals so the mesh can be back-face culled
+		std::vector<GLuint> unindexed;
+		MeshOptimizer::NormalizeWinding(vertices, unindexed);
+		mesh = FromVertices(vertices);
+		return true;
+	}
+
+	// Copies vertices and indices still pointing into an asset into storage of our own, so the data outlives the asset
+	void Own()
+	{
+		const MeshHeader& h = this->Header;
+		if (this->ownedVertices.empty() && this->Vertices != NULL)
+		{
+			this->ownedVertices.assign(this->Vertices, this->Vertices + h.VertexCount * h.Stride);
+			this->Vertices = &this->ownedVertices[0];
+		}
+		if (this->ownedIndices.empty() && this->Indices != NULL)
+		{
+			this->ownedIndices.assign(this->Indices, this->Indices + h.IndexCount);
+			this->Indices = &this->ownedIndices[0];
+		}
+	}
+
+	bool Write(const std::string& path) const
+	{
+		std::ofstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		const MeshHeader& h = this->Header;
+		std::vector<char> bytes(h.IndexCount > 0 ? h.IndexOffset + h.IndexCount * sizeof(GLuint) : h.VertexOffset + h.VertexCount * h.Stride, 0);
+		memcpy(&bytes[0], &h, sizeof(MeshHeader));
+		if (h.VertexCount > 0)
+			memcpy(&bytes[h.VertexOffset], this->Vertices, h.VertexCount * h.Stride);
+		if (h.IndexCount > 0)
+			memcpy(&bytes[h.IndexOffset], this->Indices, h.IndexCount * sizeof(GLuint));
+		file.write(&bytes[0], bytes.size());
+		return file.good();
+	}
+
+	// Offline tool: text vertex list -> .mesh
+	static bool Convert(const std::string& source, const std::string& destination)
+	{
+		MeshData mesh;
+		if (!FromText(source, mesh) || !mesh.Write(destination))
+		{
+			std::cout << "ERROR::MESH::CONVERSION_FAILED " << source << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+private:
+	std::vector<unsigned char> ownedVertices;
+	std::vector<GLuint> ownedIndices;
+
+	static GLuint align16(size_t offset)
+	{
+		return (GLuint)((offset + 15) & ~(size_t)15);
+	}
+};
+
+// GPU side of a mesh: the vertex array set up from the attribute descriptors, draw ranges come from the data.
+// Positions are also split out into a tightly packed stream of their own for depth-only (pre-pass, shadow) drawing,
+// which then fetches 12 bytes per vertex instead of the whole interleaved vertex.
+class Mesh
+{
+public:
+	GLuint VAO, VBO, EBO;
+	GLuint DepthVAO, PositionVBO;
+	GLsizei VertexCount;
+	GLsizei IndexCount;
+	glm::vec3 BoundsMin;
+	glm::vec3 BoundsMax;
+
+	Mesh() : VAO(0), VBO(0), EBO(0), DepthVAO(0), PositionVBO(0), VertexCount(0), IndexCount(0) {}
+
+	~Mesh()
+	{
+		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteBuffers(1, &this->VBO);
+		glDeleteBuffers(1, &this->EBO);
+		glDeleteVertexArrays(1, &this->DepthVAO);
+		glDeleteBuffers(1, &this->PositionVBO);
+	}
+
+	// Loads a .mesh from the asset pack (zero-copy from the mapping) or a loose file. Callers that need the
+	// vertices on the CPU as well (e.g. the lightmap baker) get a copy of their own in keep
+	bool Load(const std::string& path, MeshData* keep = NULL)
+	{
+		MeshData data;
+		bool loaded = data.Parse(AssetPack::Default().Read(path));
+		if (loaded)
+		{
+			this->Upload(data);
+			if (keep != NULL)
+			{
+				*keep = data;
+				keep->Own();
+			}
+		}
+		else
+			std::cout << "ERROR::MESH::NOT_LOADED " << path << std::endl;
+		AssetPack::Default().Release(path);
+		return loaded;
+	}
+
+	void Upload(const MeshData& data)
+	{
+		const MeshHeader& h = data.Header;
+		if (this->VAO == 0)
+		{
+			glGenVertexArrays(1, &this->VAO);
+			glGenBuffers(1, &this->VBO);
+		}
+		glBindVertexArray(this->VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+		glBufferData(GL_ARRAY_BUFFER, h.VertexCount * h.Stride, data.Vertices, GL_STATIC_DRAW);
+		for (GLuint i = 0; i < h.AttributeCount; i++)
+		{
+			const VertexAttribute& attribute = h.Attributes[i];
+			glEnableVertexAttribArray(attribute.Location);
+			glVertexAttribPointer(attribute.Location, attribute.Components, attribute.Type, attribute.Normalized ? GL_TRUE : GL_FALSE, h.Stride, (GLvoid*)(size_t)attribute.Offset);
+		}
+		if (h.IndexCount > 0)
+		{
+			if (this->EBO == 0)
+				glGenBuffers(1, &this->EBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, h.IndexCount * sizeof(GLuint), data.Indices, GL_STATIC_DRAW);
+		}
+		glBindVertexArray(0);
+		this->uploadPositions(data);
+		this->VertexCount = h.VertexCount;
+		this->IndexCount = h.IndexCount;
+		this->BoundsMin = glm::vec3(h.BoundsMin[0], h.BoundsMin[1], h.BoundsMin[2]);
+		this->BoundsMax = glm::vec3(h.BoundsMax[0], h.BoundsMax[1], h.BoundsMax[2]);
+	}
+
+	void Draw()
+	{
+		glBindVertexArray(this->VAO);
+		if (this->IndexCount > 0)
+			glDrawElements(GL_TRIANGLES, this->IndexCount, GL_UNSIGNED_INT, 0);
+		else
+			glDrawArrays(GL_TRIANGLES, 0, this->VertexCount);
+		glBindVertexArray(0);
+	}
+
+	void DrawInstanced(GLsizei instances)
+	{
+		glBindVertexArray(this->VAO);
+		if (this->IndexCount > 0)
+			glDrawElementsInstanced(GL_TRIANGLES, this->IndexCount, GL_UNSIGNED_INT, 0, instances);
+		else
+			glDrawArraysInstanced(GL_TRIANGLES, 0, this->VertexCount, instances);
+		glBindVertexArray(0);
+	}
+
+	// Draws with only the position stream bound, for passes that write depth alone
+	void DrawDepth()
+	{
+		glBindVertexArray(this->DepthVAO != 0 ? this->DepthVAO : this->VAO);
+		if (this->IndexCount > 0)
+			glDrawElements(GL_TRIANGLES, this->IndexCount, GL_UNSIGNED_INT, 0);
+		else
+			glDrawArrays(GL_TRIANGLES, 0, this->VertexCount);
+		glBindVertexArray(0);
+	}
+
+private:
+	Mesh(const Mesh&);
+	Mesh& operator=(const Mesh&);
+
+	// Copies the float positions (attribute 0) out of the interleaved vertices; other position formats keep using the full VAO
+	void uploadPositions(const MeshData& data)
+	{
+		const MeshHeader& h = data.Header;
+		const VertexAttribute* position = NULL;
+		for (GLuint i = 0; i < h.AttributeCount; i++)
+			if (h.Attributes[i].Location == 0 && h.Attributes[i].Type == GL_FLOAT)
+				position = &h.Attributes[i];
+		if (position == NULL || h.VertexCount == 0)
+			return;
+		std::vector<GLfloat> positions(h.VertexCount * position->Components);
+		for (GLuint v = 0; v < h.VertexCount; v++)
+			memcpy(&positions[v * position->Components], data.Vertices + v * h.Stride + position->Offset, position->Components * sizeof(GLfloat));
+
+		if (this->DepthVAO == 0)
+		{
+			glGenVertexArrays(1, &this->DepthVAO);
+			glGenBuffers(1, &this->PositionVBO);
+		}
+		glBindVertexArray(this->DepthVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->PositionVBO);
+		glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(GLfloat), &positions[0], GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, position->Components, GL_FLOAT, GL_FALSE, position->Components * sizeof(GLfloat), (GLvoid*)0);
+		// Shares the index buffer with the full vertex array
+		if (h.IndexCount > 0)
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+		glBindVertexArray(0);
+	}
+};
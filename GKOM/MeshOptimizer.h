@@ -0,0 +1,354 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Hash.h"
+
+// Import-time optimization passes for indexed triangle lists in the scene's vertex layout
+// (8 floats per vertex: position, normal, texture coordinates). Run in the order of Optimize():
+// weld, vertex cache order, overdraw order, then vertex fetch order.
+class MeshOptimizer
+{
+public:
+	static const int VERTEX_FLOATS = 8;
+
+	static void Optimize(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+	{
+		Weld(vertices, indices);
+		OptimizeVertexCache(indices, (GLuint)(vertices.size() / VERTEX_FLOATS));
+		OptimizeOverdraw(indices, vertices);
+		OptimizeVertexFetch(vertices, indices);
+	}
+
+	// Flips every triangle whose winding disagrees with its vertex normals, so counter-clockwise means front facing and
+	// the mesh can be back-face culled. Works on unindexed lists too (swapping vertex data). Returns the flipped count.
+	static size_t NormalizeWinding(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+	{
+		size_t flipped = 0;
+		size_t triangleCount = indices.empty() ? vertices.size() / VERTEX_FLOATS / 3 : indices.size() / 3;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			GLuint corners[3];
+			for (int k = 0; k < 3; k++)
+				corners[k] = indices.empty() ? (GLuint)(t * 3 + k) : indices[t * 3 + k];
+			glm::vec3 a = position(vertices, corners[0]), b = position(vertices, corners[1]), c = position(vertices, corners[2]);
+			glm::vec3 normal = normalAt(vertices, corners[0]) + normalAt(vertices, corners[1]) + normalAt(vertices, corners[2]);
+			if (glm::dot(glm::cross(b - a, c - a), normal) >= 0.0f)
+				continue;
+			if (indices.empty())
+				std::swap_ranges(vertices.begin() + corners[1] * VERTEX_FLOATS, vertices.begin() + (corners[1] + 1) * VERTEX_FLOATS, vertices.begin() + corners[2] * VERTEX_FLOATS);
+			else
+				std::swap(indices[t * 3 + 1], indices[t * 3 + 2]);
+			flipped++;
+		}
+		return flipped;
+	}
+
+	// Merges bitwise identical vertices (after folding -0 into 0); an empty index list means an unindexed list
+	static void Weld(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+	{
+		GLuint count = (GLuint)(vertices.size() / VERTEX_FLOATS);
+		if (indices.empty())
+			for (GLuint i = 0; i < count; i++)
+				indices.push_back(i);
+		for (size_t i = 0; i < vertices.size(); i++)
+			if (vertices[i] == 0.0f)
+				vertices[i] = 0.0f;
+
+		// Open addressing hash table over vertex contents
+		size_t buckets = 1;
+		while (buckets < count * 2)
+			buckets *= 2;
+		std::vector<GLuint> table(buckets, 0xFFFFFFFF);
+		std::vector<GLuint> remap(count);
+		std::vector<GLfloat> welded;
+		welded.reserve(vertices.size());
+		for (GLuint v = 0; v < count; v++)
+		{
+			const GLfloat* vertex = &vertices[v * VERTEX_FLOATS];
+			size_t slot = hashVertex(vertex) & (buckets - 1);
+			for (;;)
+			{
+				GLuint existing = table[slot];
+				if (existing == 0xFFFFFFFF)
+				{
+					GLuint index = (GLuint)(welded.size() / VERTEX_FLOATS);
+					table[slot] = index;
+					welded.insert(welded.end(), vertex, vertex + VERTEX_FLOATS);
+					remap[v] = index;
+					break;
+				}
+				if (memcmp(&welded[existing * VERTEX_FLOATS], vertex, VERTEX_FLOATS * sizeof(GLfloat)) == 0)
+				{
+					remap[v] = existing;
+					break;
+				}
+				slot = (slot + 1) & (buckets - 1);
+			}
+		}
+		for (size_t i = 0; i < indices.size(); i++)
+			indices[i] = remap[indices[i]];
+		vertices.swap(welded);
+	}
+
+	// Tom Forsyth's linear-speed vertex cache optimization: greedily emits the triangle with the best
+	// score, where vertex scores reward recent cache use and low remaining valence
+	static void OptimizeVertexCache(std::vector<GLuint>& indices, GLuint vertexCount)
+	{
+		const int CACHE_SIZE = 32;
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return;
+
+		// Vertex -> live triangles adjacency, packed per vertex
+		std::vector<GLuint> valence(vertexCount, 0), offsets(vertexCount + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			valence[indices[i]]++;
+		for (GLuint v = 0; v < vertexCount; v++)
+			offsets[v + 1] = offsets[v] + valence[v];
+		std::vector<GLuint> adjacency(triangleCount * 3), fill(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int k = 0; k < 3; k++)
+				adjacency[fill[indices[t * 3 + k]]++] = (GLuint)t;
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount), triangleScore(triangleCount, 0.0f);
+		std::vector<char> emitted(triangleCount, 0);
+		for (GLuint v = 0; v < vertexCount; v++)
+			vertexScore[v] = forsythScore(-1, valence[v], CACHE_SIZE);
+		for (size_t t = 0; t < triangleCount; t++)
+			triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+		std::vector<GLuint> result;
+		result.reserve(indices.size());
+		std::vector<GLuint> cache, nextCache;
+		size_t cursor = 0;
+		int best = (int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+		while (result.size() < indices.size())
+		{
+			if (best < 0)
+			{
+				// Nothing in the cache has live triangles left, continue with the next unemitted one
+				while (emitted[cursor])
+					cursor++;
+				best = (int)cursor;
+			}
+			const GLuint* triangle = &indices[best * 3];
+			result.insert(result.end(), triangle, triangle + 3);
+			emitted[best] = 1;
+
+			nextCache.assign(triangle, triangle + 3);
+			for (int k = 0; k < 3; k++)
+			{
+				// Drop the triangle from its vertices' live lists
+				GLuint v = triangle[k];
+				GLuint* first = &adjacency[offsets[v]];
+				GLuint* last = first + valence[v];
+				GLuint* found = std::find(first, last, (GLuint)best);
+				if (found != last)
+				{
+					*found = *(last - 1);
+					valence[v]--;
+				}
+			}
+			for (size_t i = 0; i < cache.size(); i++)
+				if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+					nextCache.push_back(cache[i]);
+
+			// Rescore every vertex that entered, moved in or fell out of the cache and the triangles using them
+			best = -1;
+			float bestScore = -1.0f;
+			for (size_t i = 0; i < nextCache.size(); i++)
+			{
+				GLuint v = nextCache[i];
+				cachePosition[v] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+				vertexScore[v] = forsythScore(cachePosition[v], valence[v], CACHE_SIZE);
+			}
+			for (size_t i = 0; i < nextCache.size(); i++)
+			{
+				GLuint v = nextCache[i];
+				for (GLuint j = offsets[v]; j < offsets[v] + valence[v]; j++)
+				{
+					GLuint t = adjacency[j];
+					float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+					triangleScore[t] = score;
+					if (score > bestScore)
+					{
+						bestScore = score;
+						best = (int)t;
+					}
+				}
+			}
+			if (nextCache.size() > (size_t)CACHE_SIZE)
+				nextCache.resize(CACHE_SIZE);
+			cache.swap(nextCache);
+		}
+		indices.swap(result);
+	}
+
+	// Overdraw-aware ordering (after Sander et al. 2007): the cache optimized order is cut into clusters where
+	// the post-transform cache was cold anyway (a triangle missing on all three vertices), then clusters facing
+	// away from the mesh centre are drawn first, since they are the ones likely to occlude the rest
+	static void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<GLfloat>& vertices, int cacheSize = 16)
+	{
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount < 2)
+			return;
+		std::vector<size_t> clusterStarts;
+		std::vector<GLuint> fifo;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			int misses = 0;
+			for (int k = 0; k < 3; k++)
+				if (fifoAccess(fifo, indices[t * 3 + k], cacheSize))
+					misses++;
+			if (t == 0 || misses == 3)
+				clusterStarts.push_back(t);
+		}
+		clusterStarts.push_back(triangleCount);
+
+		glm::vec3 meshCentre(0.0f);
+		float meshArea = 0.0f;
+		std::vector<glm::vec3> centres(clusterStarts.size() - 1), normals(clusterStarts.size() - 1);
+		for (size_t c = 0; c + 1 < clusterStarts.size(); c++)
+		{
+			glm::vec3 centre(0.0f), normal(0.0f);
+			float area = 0.0f;
+			for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+			{
+				glm::vec3 a = position(vertices, indices[t * 3]), b = position(vertices, indices[t * 3 + 1]), d = position(vertices, indices[t * 3 + 2]);
+				glm::vec3 cross = glm::cross(b - a, d - a);
+				float triangleArea = glm::length(cross);
+				centre += (a + b + d) * (triangleArea / 3.0f);
+				normal += cross;
+				area += triangleArea;
+			}
+			meshCentre += centre;
+			meshArea += area;
+			centres[c] = area > 0.0f ? centre / area : position(vertices, indices[clusterStarts[c] * 3]);
+			normals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+		}
+		if (meshArea > 0.0f)
+			meshCentre /= meshArea;
+
+		std::vector<std::pair<float, size_t> > order;
+		for (size_t c = 0; c + 1 < clusterStarts.size(); c++)
+			order.push_back(std::make_pair(-glm::dot(centres[c] - meshCentre, normals[c]), c));
+		std::stable_sort(order.begin(), order.end());
+
+		std::vector<GLuint> result;
+		result.reserve(indices.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			size_t c = order[i].second;
+			result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+		}
+		indices.swap(result);
+	}
+
+	// Renumbers vertices in order of first use so the vertex fetch walks memory linearly, unused vertices are dropped
+	static void OptimizeVertexFetch(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+	{
+		std::vector<GLuint> remap(vertices.size() / VERTEX_FLOATS, 0xFFFFFFFF);
+		std::vector<GLfloat> ordered;
+		ordered.reserve(vertices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			GLuint& v = remap[indices[i]];
+			if (v == 0xFFFFFFFF)
+			{
+				v = (GLuint)(ordered.size() / VERTEX_FLOATS);
+				ordered.insert(ordered.end(), vertices.begin() + indices[i] * VERTEX_FLOATS, vertices.begin() + (indices[i] + 1) * VERTEX_FLOATS);
+			}
+			indices[i] = v;
+		}
+		vertices.swap(ordered);
+	}
+
+	// Average cache miss ratio (transformed vertices per triangle) for a FIFO post-transform cache
+	static float Acmr(const std::vector<GLuint>& indices, int cacheSize = 16)
+	{
+		if (indices.size() < 3)
+			return 0.0f;
+		std::vector<GLuint> fifo;
+		size_t misses = 0;
+		for (size_t i = 0; i < indices.size(); i++)
+			if (fifoAccess(fifo, indices[i], cacheSize))
+				misses++;
+		return (float)misses / (indices.size() / 3);
+	}
+
+	// Smooth, area weighted normals for meshes that do not carry their own
+	static void GenerateNormals(std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices)
+	{
+		std::vector<glm::vec3> accumulated(vertices.size() / VERTEX_FLOATS, glm::vec3(0.0f));
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			glm::vec3 a = position(vertices, indices[t]), b = position(vertices, indices[t + 1]), c = position(vertices, indices[t + 2]);
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			for (int k = 0; k < 3; k++)
+				accumulated[indices[t + k]] += normal;
+		}
+		for (size_t v = 0; v < accumulated.size(); v++)
+		{
+			glm::vec3 n = glm::length(accumulated[v]) > 0.0f ? glm::normalize(accumulated[v]) : glm::vec3(0.0f, 1.0f, 0.0f);
+			vertices[v * VERTEX_FLOATS + 3] = n.x;
+			vertices[v * VERTEX_FLOATS + 4] = n.y;
+			vertices[v * VERTEX_FLOATS + 5] = n.z;
+		}
+	}
+
+private:
+	static glm::vec3 position(const std::vector<GLfloat>& vertices, GLuint index)
+	{
+		return glm::vec3(vertices[index * VERTEX_FLOATS], vertices[index * VERTEX_FLOATS + 1], vertices[index * VERTEX_FLOATS + 2]);
+	}
+
+	static glm::vec3 normalAt(const std::vector<GLfloat>& vertices, GLuint index)
+	{
+		return glm::vec3(vertices[index * VERTEX_FLOATS + 3], vertices[index * VERTEX_FLOATS + 4], vertices[index * VERTEX_FLOATS + 5]);
+	}
+
+	static size_t hashVertex(const GLfloat* vertex)
+	{
+		GLuint64 hash = Hash::Seed;
+		Hash::Bytes(hash, vertex, VERTEX_FLOATS * sizeof(GLfloat));
+		return (size_t)hash;
+	}
+
+	static float forsythScore(int cachePosition, GLuint valence, int cacheSize)
+	{
+		if (valence == 0)
+			return -1.0f;
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices get a fixed score so the next triangle does not always reuse the same edge
+			if (cachePosition < 3)
+				score = 0.75f;
+			else
+				score = pow(1.0f - (cachePosition - 3) / (float)(cacheSize - 3), 1.5f);
+		}
+		return score + 2.0f / sqrt((float)valence);
+	}
+
+	// Returns true on a miss, pushing the vertex into the FIFO
+	static bool fifoAccess(std::vector<GLuint>& fifo, GLuint vertex, int cacheSize)
+	{
+		if (std::find(fifo.begin(), fifo.end(), vertex) != fifo.end())
+			return false;
+		fifo.insert(fifo.begin(), vertex);
+		if ((int)fifo.size() > cacheSize)
+			fifo.pop_back();
+		return true;
+	}
+};
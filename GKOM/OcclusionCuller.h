@@ -0,0 +1,204 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Mesh.h"
+#include "Primitives.h"
+
+enum OcclusionMode
+{
+	OCCLUSION_OFF,
+	OCCLUSION_QUERIES,		// Hardware queries with conditional rendering, this class
+	OCCLUSION_SOFTWARE,		// Occluders rasterized into a Hi-Z pyramid on the CPU (SoftwareOcclusion.h)
+	OCCLUSION_MODE_COUNT
+};
+
+// Frames a visible object is drawn without being tested again
+const int OCCLUSION_INTERVAL = 8;
+// Boxes reaching closer to the camera than this (view space depth, the near plane) are cut open by it and cannot be tested
+const GLfloat OCCLUSION_MIN_DEPTH = 0.1f;
+
+// Hardware occlusion culling. Once the occluders' depth is down, Test draws an object's box (no color or depth
+// writes) inside a GL_ANY_SAMPLES_PASSED query, and the object's draws between BeginConditional and EndConditional
+// are rendered conditionally on it with GL_QUERY_NO_WAIT: the GPU drops them when no sample of the box passed,
+// and draws them when it does not have the answer yet, so the CPU never waits. The results are read back a frame
+// later without stalling and only decide which objects are tested (temporal coherence):
+//   - an object last found hidden is tested every frame, its draws depend on that frame's test;
+//   - an object last found visible is drawn unconditionally for OCCLUSION_INTERVAL frames before the next test,
+//     the tests of different objects spread over those frames.
+// A query still busy when its object is tested again is reused, the object then just counts as hidden for
+// another frame. Within a scissored partial redraw an object outside the scissor is hidden, which is right there.
+class OcclusionCuller
+{
+public:
+	bool Enabled;
+
+	OcclusionCuller() : Enabled(true), program(0), tests(0), frames(0)
+	{
+		this->box.Upload(Primitives::Box(glm::vec3(1.0f)));
+	}
+
+	~OcclusionCuller()
+	{
+		for (size_t i = 0; i < this->objects.size(); i++)
+			glDeleteQueries(1, &this->objects[i].Query);
+	}
+
+	// Collects the results that came in and starts a frame. program draws the boxes: a depth shader with model,
+	// view and projection uniforms (depth.vs)
+	void BeginFrame(GLuint program, const glm::mat4& view, const glm::mat4& projection)
+	{
+		this->program = program;
+		this->view = view;
+		this->projection = projection;
+		for (size_t i = 0; i < this->objects.size(); i++)
+		{
+			ObjectState& object = this->objects[i];
+			if (object.Pending)
+			{
+				GLint available = 0;
+				glGetQueryObjectiv(object.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available)
+				{
+					GLuint passed = 0;
+					glGetQueryObjectuiv(object.Query, GL_QUERY_RESULT, &passed);
+					object.Visible = passed != 0;
+					object.Pending = false;
+				}
+			}
+			object.Tested = false;
+			object.Age++;
+		}
+		this->frames++;
+	}
+
+	// Tests the object in slot id (the same one every frame) with the model space box lower .. upper against the
+	// depth drawn so far, when it is due. Leaves the default depth and color state behind, and program in use
+	void Test(size_t id, const glm::mat4& model, const glm::vec3& lower, const glm::vec3& upper)
+	{
+		if (!this->Enabled)
+			return;
+		if (id >= this->objects.size())
+			this->add(id + 1);
+		ObjectState& object = this->objects[id];
+		if (object.Tested || (object.Visible && object.Age < OCCLUSION_INTERVAL))
+			return;
+		object.Age = 0;
+		glm::mat4 boxModel = model * glm::scale(glm::translate(glm::mat4(), (lower + upper) * 0.5f), upper - lower);
+		if (this->crossesNearPlane(boxModel))
+		{
+			object.Visible = true;
+			return;
+		}
+
+		glUseProgram(this->program);
+		glUniformMatrix4fv(glGetUniformLocation(this->program, "model"), 1, GL_FALSE, glm::value_ptr(boxModel));
+		glUniformMatrix4fv(glGetUniformLocation(this->program, "view"), 1, GL_FALSE, glm::value_ptr(this->view));
+		glUniformMatrix4fv(glGetUniformLocation(this->program, "projection"), 1, GL_FALSE, glm::value_ptr(this->projection));
+		// Any face of the box may be the one that shows
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+		glDisable(GL_CULL_FACE);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, object.Query);
+		this->box.DrawDepth();
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		glEnable(GL_CULL_FACE);
+		glDepthMask(GL_TRUE);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		object.Tested = true;
+		object.Pending = true;
+		this->tests++;
+	}
+
+	// Draws up to EndConditional are dropped when the object was tested this frame and found hidden
+	void BeginConditional(size_t id)
+	{
+		if (this->isConditional(id))
+			glBeginConditionalRender(this->objects[id].Query, GL_QUERY_NO_WAIT);
+	}
+
+	void EndConditional(size_t id)
+	{
+		if (this->isConditional(id))
+			glEndConditionalRender();
+	}
+
+	// Objects the latest results found hidden
+	size_t Hidden() const
+	{
+		size_t hidden = 0;
+		for (size_t i = 0; i < this->objects.size(); i++)
+			if (!this->objects[i].Visible)
+				hidden++;
+		return hidden;
+	}
+
+	size_t Objects() const
+	{
+		return this->objects.size();
+	}
+
+	// Boxes tested per frame since the last call
+	double TestsPerFrame()
+	{
+		double perFrame = this->frames > 0 ? (double)this->tests / this->frames : 0.0;
+		this->tests = 0;
+		this->frames = 0;
+		return perFrame;
+	}
+
+private:
+	struct ObjectState
+	{
+		GLuint Query;
+		bool Visible, Pending, Tested;
+		int Age;
+	};
+
+	std::vector<ObjectState> objects;
+	Mesh box;
+	GLuint program;
+	glm::mat4 view, projection;
+	size_t tests, frames;
+
+	// New objects count as visible with staggered ages, so their first tests (and every later one while they stay
+	// visible) fall on different frames
+	void add(size_t count)
+	{
+		for (size_t i = this->objects.size(); i < count; i++)
+		{
+			ObjectState object;
+			glGenQueries(1, &object.Query);
+			object.Visible = true;
+			object.Pending = false;
+			object.Tested = false;
+			object.Age = OCCLUSION_INTERVAL - (int)(i % OCCLUSION_INTERVAL);
+			this->objects.push_back(object);
+		}
+	}
+
+	bool isConditional(size_t id) const
+	{
+		return this->Enabled && id < this->objects.size() && this->objects[id].Tested;
+	}
+
+	// Whether a corner of the unit box centered on the origin lies in front of the near plane
+	bool crossesNearPlane(const glm::mat4& boxModel) const
+	{
+		glm::mat4 modelView = this->view * boxModel;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec4 position(corner & 1 ? 0.5f : -0.5f, corner & 2 ? 0.5f : -0.5f, corner & 4 ? 0.5f : -0.5f, 1.0f);
+			if (-(modelView * position).z < OCCLUSION_MIN_DEPTH)
+				return true;
+		}
+		return false;
+	}
+};
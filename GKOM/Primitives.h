@@ -0,0 +1,307 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+const int LOD_MAX_LEVELS = 6;
+// Largest silhouette error, in pixels, a level may show before the next finer one is used
+const GLfloat LOD_PIXEL_ERROR = 1.0f;
+// Relative margin around the switch sizes so objects hovering at a boundary do not flip every frame
+const GLfloat LOD_HYSTERESIS = 0.15f;
+
+// One level of a LOD chain. MaxPixels is the largest projected bounding sphere diameter (in pixels) at which
+// the level's geometric error stays under LOD_PIXEL_ERROR; the finest level has no limit.
+struct PrimitiveLod
+{
+	MeshData Data;
+	GLfloat MaxPixels;
+};
+
+// Procedural meshes in the scene's vertex layout, centred on the origin and wound counter-clockwise from outside
+class Primitives
+{
+public:
+	// Cylinder along the Z axis with optional end caps
+	static MeshData Cylinder(GLfloat radius, GLfloat height, GLuint segments, bool caps = true)
+	{
+		segments = std::max(segments, 3u);
+		std::vector<GLfloat> vertices;
+		std::vector<GLuint> indices;
+		const GLfloat PI = 3.14159265358979f;
+		for (GLuint ring = 0; ring < 2; ring++)
+			for (GLuint j = 0; j <= segments; j++)
+			{
+				GLfloat angle = 2.0f * PI * j / segments;
+				GLfloat c = cos(angle), s = sin(angle);
+				addVertex(vertices, glm::vec3(radius * c, radius * s, (ring - 0.5f) * height), glm::vec3(c, s, 0.0f), glm::vec2((GLfloat)j / segments, (GLfloat)ring));
+			}
+		for (GLuint j = 0; j < segments; j++)
+			addQuad(indices, j, j + 1, segments + 2 + j, segments + 1 + j);
+
+		if (caps)
+			for (int side = -1; side <= 1; side += 2)
+			{
+				GLuint centre = (GLuint)(vertices.size() / MeshOptimizer::VERTEX_FLOATS);
+				glm::vec3 normal(0.0f, 0.0f, (GLfloat)side);
+				addVertex(vertices, normal * (height * 0.5f), normal, glm::vec2(0.5f, 0.5f));
+				for (GLuint j = 0; j < segments; j++)
+				{
+					GLfloat angle = 2.0f * PI * j / segments;
+					GLfloat c = cos(angle), s = sin(angle);
+					addVertex(vertices, glm::vec3(radius * c, radius * s, side * height * 0.5f), normal, glm::vec2(0.5f + 0.5f * c, 0.5f + 0.5f * s));
+				}
+				for (GLuint j = 0; j < segments; j++)
+				{
+					GLuint a = centre + 1 + j, b = centre + 1 + (j + 1) % segments;
+					indices.push_back(centre);
+					indices.push_back(side > 0 ? a : b);
+					indices.push_back(side > 0 ? b : a);
+				}
+			}
+		return finish(vertices, indices);
+	}
+
+	// UV sphere, rings from pole to pole and segments around the Y axis
+	static MeshData Sphere(GLfloat radius, GLuint segments, GLuint rings)
+	{
+		segments = std::max(segments, 3u);
+		rings = std::max(rings, 2u);
+		std::vector<GLfloat> vertices;
+		std::vector<GLuint> indices;
+		const GLfloat PI = 3.14159265358979f;
+		for (GLuint i = 0; i <= rings; i++)
+			for (GLuint j = 0; j <= segments; j++)
+			{
+				GLfloat theta = PI * i / rings, phi = 2.0f * PI * j / segments;
+				glm::vec3 normal(sin(theta) * cos(phi), cos(theta), -sin(theta) * sin(phi));
+				addVertex(vertices, normal * radius, normal, glm::vec2((GLfloat)j / segments, 1.0f - (GLfloat)i / rings));
+			}
+		for (GLuint i = 0; i < rings; i++)
+			for (GLuint j = 0; j < segments; j++)
+			{
+				// The pole rings collapse to a point, so only one triangle of their quads has any area
+				GLuint a = i * (segments + 1) + j, b = a + segments + 1, c = b + 1, d = a + 1;
+				GLuint lower[3] = { a, b, c }, upper[3] = { a, c, d };
+				if (i + 1 < rings)
+					indices.insert(indices.end(), lower, lower + 3);
+				if (i > 0)
+					indices.insert(indices.end(), upper, upper + 3);
+			}
+		return finish(vertices, indices);
+	}
+
+	static MeshData Box(const glm::vec3& size)
+	{
+		return BeveledBox(size, 0.0f, 0);
+	}
+
+	// Box whose edges and corners are rounded with the given radius, each rounded edge is split into 2 * segments
+	// slices. Every face is a grid that gets pushed onto the rounded shape, so faces, edges and corners share vertices.
+	static MeshData BeveledBox(const glm::vec3& size, GLfloat bevel, GLuint segments)
+	{
+		glm::vec3 half = size * 0.5f;
+		bevel = std::min(bevel, std::min(half.x, std::min(half.y, half.z)));
+		if (bevel <= 0.0f)
+			segments = 0;
+		glm::vec3 inner = half - glm::vec3(segments > 0 ? bevel : 0.0f);
+
+		// Axis of the face normal and the two in-plane axes, ordered so cross(u, v) points out of the face on both sides
+		const int faces[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 2, 0 }, { 1, 0, 2 }, { 2, 0, 1 }, { 2, 1, 0 } };
+		std::vector<GLfloat> vertices;
+		std::vector<GLuint> indices;
+		for (int face = 0; face < 6; face++)
+		{
+			int n = faces[face][0], u = faces[face][1], v = faces[face][2];
+			GLfloat sign = face % 2 == 0 ? 1.0f : -1.0f;
+			std::vector<GLfloat> us = axisSamples(half[u], bevel, segments), vs = axisSamples(half[v], bevel, segments);
+			GLuint first = (GLuint)(vertices.size() / MeshOptimizer::VERTEX_FLOATS);
+			for (size_t j = 0; j < vs.size(); j++)
+				for (size_t i = 0; i < us.size(); i++)
+				{
+					glm::vec3 point, faceNormal;
+					point[n] = sign * half[n];
+					point[u] = us[i];
+					point[v] = vs[j];
+					faceNormal[n] = sign;
+					glm::vec3 core = glm::clamp(point, -inner, inner);
+					glm::vec3 position = point, normal = faceNormal;
+					if (segments > 0)
+					{
+						normal = glm::normalize(point - core);
+						position = core + normal * bevel;
+					}
+					addVertex(vertices, position, normal, glm::vec2((us[i] + half[u]) / size[u], (vs[j] + half[v]) / size[v]));
+				}
+			GLuint columns = (GLuint)us.size();
+			for (GLuint j = 0; j + 1 < vs.size(); j++)
+				for (GLuint i = 0; i + 1 < columns; i++)
+				{
+					GLuint a = first + j * columns + i;
+					addQuad(indices, a, a + 1, a + columns + 1, a + columns);
+				}
+		}
+		return finish(vertices, indices);
+	}
+
+	// LOD chain of cylinders, the finest has maxSegments sides and every further level halves them (down to 6)
+	static std::vector<PrimitiveLod> CylinderLods(GLfloat radius, GLfloat height, GLuint maxSegments, int levels)
+	{
+		std::vector<PrimitiveLod> chain;
+		GLfloat sphere = sqrt(radius * radius + height * height * 0.25f);
+		for (GLuint segments = maxSegments; (int)chain.size() < std::min(levels, LOD_MAX_LEVELS) && segments >= 6; segments /= 2)
+		{
+			// Chord sagitta of one side against the true circle
+			GLfloat error = radius * (1.0f - cos(3.14159265358979f / segments));
+			PrimitiveLod lod = { Cylinder(radius, height, segments), maxPixels(chain.empty(), sphere, error) };
+			chain.push_back(lod);
+		}
+		return chain;
+	}
+
+	// LOD chain of beveled boxes, every further level halves the bevel segments and the coarsest is a plain box
+	static std::vector<PrimitiveLod> BeveledBoxLods(const glm::vec3& size, GLfloat bevel, GLuint maxSegments, int levels)
+	{
+		std::vector<PrimitiveLod> chain;
+		GLfloat sphere = glm::length(size) * 0.5f;
+		for (GLuint segments = maxSegments; (int)chain.size() < std::min(levels, LOD_MAX_LEVELS); segments /= 2)
+		{
+			// A plain box misses the rounding by the corner gap, a beveled one by the sagitta of one slice
+			GLfloat error = segments == 0 ? bevel * (sqrt(2.0f) - 1.0f) : bevel * (1.0f - cos(3.14159265358979f / (8.0f * segments)));
+			PrimitiveLod lod = { BeveledBox(size, bevel, segments), maxPixels(chain.empty(), sphere, error) };
+			chain.push_back(lod);
+			if (segments == 0)
+				break;
+		}
+		return chain;
+	}
+
+private:
+	static void addVertex(std::vector<GLfloat>& vertices, const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texCoords)
+	{
+		GLfloat vertex[8] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, texCoords.x, texCoords.y };
+		vertices.insert(vertices.end(), vertex, vertex + 8);
+	}
+
+	static void addQuad(std::vector<GLuint>& indices, GLuint a, GLuint b, GLuint c, GLuint d)
+	{
+		GLuint quad[6] = { a, b, c, a, c, d };
+		indices.insert(indices.end(), quad, quad + 6);
+	}
+
+	// Grid lines along one face axis: the flat middle is a single span, each rounded end gets segments
+	// slices at equal angles of the 45 degrees this face covers
+	static std::vector<GLfloat> axisSamples(GLfloat half, GLfloat bevel, GLuint segments)
+	{
+		std::vector<GLfloat> samples;
+		if (segments == 0)
+		{
+			samples.push_back(-half);
+			samples.push_back(half);
+			return samples;
+		}
+		GLfloat flat = half - bevel;
+		for (int i = (int)segments; i >= 0; i--)
+			samples.push_back(-flat - bevel * tan(0.785398163f * i / segments));
+		for (GLuint i = 0; i <= segments; i++)
+			samples.push_back(flat + bevel * tan(0.785398163f * i / segments));
+		// With no flat part the two middle lines coincide
+		if (flat <= 0.0f)
+			samples.erase(samples.begin() + segments);
+		return samples;
+	}
+
+	static GLfloat maxPixels(bool finest, GLfloat sphereRadius, GLfloat error)
+	{
+		if (finest || error <= 0.0f)
+			return FLT_MAX;
+		// error / diameter of the sphere is the fraction of the projected size it covers on screen
+		return LOD_PIXEL_ERROR * 2.0f * sphereRadius / error;
+	}
+
+	static MeshData finish(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+	{
+		MeshOptimizer::Optimize(vertices, indices);
+		return MeshData::FromVertices(vertices, indices);
+	}
+};
+
+// A chain of meshes for one object plus the state of its level selection
+class LodMesh
+{
+public:
+	Mesh Levels[LOD_MAX_LEVELS];
+	GLfloat MaxPixels[LOD_MAX_LEVELS];
+	int LevelCount;
+	int Current;
+	// Bounding sphere in model space
+	glm::vec3 Center;
+	GLfloat Radius;
+
+	LodMesh() : LevelCount(0), Current(0), Radius(0.0f) {}
+
+	void Upload(const std::vector<PrimitiveLod>& chain)
+	{
+		this->LevelCount = std::min((int)chain.size(), LOD_MAX_LEVELS);
+		for (int i = 0; i < this->LevelCount; i++)
+		{
+			this->Levels[i].Upload(chain[i].Data);
+			this->MaxPixels[i] = chain[i].MaxPixels;
+		}
+		this->Current = 0;
+		if (this->LevelCount > 0)
+		{
+			this->Center = (this->Levels[0].BoundsMin + this->Levels[0].BoundsMax) * 0.5f;
+			this->Radius = glm::length(this->Levels[0].BoundsMax - this->Levels[0].BoundsMin) * 0.5f;
+		}
+	}
+
+	// Projected diameter of the bounding sphere in pixels. fovy is the value handed to glm::perspective
+	// (this GLM takes it in radians, so Camera::Zoom is used exactly as the projection matrix uses it).
+	GLfloat ProjectedSize(const glm::mat4& model, const glm::mat4& view, GLfloat fovy, GLfloat viewportHeight) const
+	{
+		glm::vec3 centre = glm::vec3(view * model * glm::vec4(this->Center, 1.0f));
+		GLfloat scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		GLfloat radius = this->Radius * scale;
+		GLfloat distance = glm::length(centre);
+		if (distance <= radius)
+			return FLT_MAX;
+		// Tangent of the sphere's angular radius against the tangent of half the field of view
+		return viewportHeight * radius / sqrt(distance * distance - radius * radius) / fabs(tan(fovy * 0.5f));
+	}
+
+	// Picks the coarsest level that stays within the pixel error, only leaving the current level once
+	// the size has moved past the switch point by the hysteresis margin
+	int Select(const glm::mat4& model, const glm::mat4& view, GLfloat fovy, GLfloat viewportHeight)
+	{
+		if (this->LevelCount == 0)
+			return 0;
+		GLfloat size = this->ProjectedSize(model, view, fovy, viewportHeight);
+		while (this->Current > 0 && size > this->MaxPixels[this->Current] * (1.0f + LOD_HYSTERESIS))
+			this->Current--;
+		while (this->Current + 1 < this->LevelCount && size < this->MaxPixels[this->Current + 1] * (1.0f - LOD_HYSTERESIS))
+			this->Current++;
+		return this->Current;
+	}
+
+	void Draw()
+	{
+		if (this->LevelCount > 0)
+			this->Levels[this->Current].Draw();
+	}
+
+	void DrawDepth()
+	{
+		if (this->LevelCount > 0)
+			this->Levels[this->Current].DrawDepth();
+	}
+};
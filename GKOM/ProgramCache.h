@@ -0,0 +1,107 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+// GL Includes
+#include <GL/glew.h>
+
+#include "Hash.h"
+
+// Linked program binaries (GL_ARB_get_program_binary) kept on disk between runs, so a launch with unchanged
+// shaders skips compiling and linking. Files are named after a hash of the sources, the #defines and the
+// driver's vendor, renderer and version strings; a driver that rejects a binary anyway just gets it recompiled.
+class ProgramCache
+{
+public:
+	static bool Supported()
+	{
+		if (!GLEW_ARB_get_program_binary)
+			return false;
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	// Hash of everything that changes the compiled program
+	static GLuint64 Key(const GLchar* vertexCode, GLint vertexLength, const GLchar* fragmentCode, GLint fragmentLength, const std::string& defines, const GLchar* geometryCode = "", GLint geometryLength = 0)
+	{
+		GLuint64 hash = Hash::Seed;
+		Hash::Bytes(hash, vertexCode, vertexLength);
+		Hash::Bytes(hash, fragmentCode, fragmentLength);
+		Hash::Bytes(hash, geometryCode, geometryLength);
+		Hash::Bytes(hash, defines.data(), defines.size());
+		const GLenum strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (int i = 0; i < 3; i++)
+		{
+			const char* value = (const char*)glGetString(strings[i]);
+			if (value != NULL)
+				Hash::Bytes(hash, value, strlen(value));
+		}
+		return hash;
+	}
+
+	// Loads the cached binary into program, true if the driver accepted it and the program is linked
+	static bool Load(GLuint program, GLuint64 key)
+	{
+		std::ifstream file(path(key).c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		FileHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || memcmp(header.Magic, "GPRB", 4) != 0 || header.Key != key)
+			return false;
+		std::vector<char> binary(header.Length);
+		if (header.Length == 0 || !file.read(&binary[0], header.Length))
+			return false;
+		glProgramBinary(program, header.Format, &binary[0], header.Length);
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		return success != 0;
+	}
+
+	// Stores a successfully linked program, which must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	static void Save(GLuint program, GLuint64 key)
+	{
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+		FileHeader header;
+		memcpy(header.Magic, "GPRB", 4);
+		header.Format = 0;
+		header.Length = 0;
+		header.Padding = 0;
+		header.Key = key;
+		std::vector<char> binary(length);
+		glGetProgramBinary(program, length, NULL, &header.Format, &binary[0]);
+		header.Length = (GLuint)length;
+		std::ofstream file(path(key).c_str(), std::ios::binary);
+		file.write((const char*)&header, sizeof(header));
+		file.write(&binary[0], length);
+		if (!file.good())
+			std::cout << "ERROR::SHADER::PROGRAM_CACHE_NOT_WRITTEN" << std::endl;
+	}
+
+private:
+	struct FileHeader
+	{
+		char Magic[4];			// "GPRB"
+		GLenum Format;
+		GLuint Length;
+		GLuint Padding;
+		GLuint64 Key;
+	};
+
+	// Written to the working directory next to the shaders
+	static std::string path(GLuint64 key)
+	{
+		char name[64];
+		sprintf(name, "programcache_%016llx.bin", (unsigned long long)key);
+		return name;
+	}
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+// Std. Includes
+#include <algorithm>
+
+// GL Includes
+#include <GL/glew.h>
+
+// One step of the quality ladder
+struct QualityLevel
+{
+	GLfloat RenderScale;		// Share of the window's width and height that is shaded, below 1 with temporal upsampling
+	GLfloat LodBias;			// Levels of detail picked as if the screen were 2^LodBias times smaller
+	int ShadowInterval;			// Frames between redraws of the moving casters' shadows
+	int WorkshopLights;			// Lamps around the workshop when they are on
+};
+
+// Best first. Each step gives up a little of several things rather than a lot of one
+const QualityLevel QUALITY_LEVELS[] =
+{
+	{ 1.0f, 0.0f, 1, 256 },
+	{ 0.875f, 0.0f, 1, 256 },
+	{ 0.75f, 0.0f, 2, 192 },
+	{ 0.75f, 1.0f, 2, 128 },
+	{ 0.625f, 1.0f, 3, 96 },
+	{ 0.5f, 2.0f, 4, 64 },
+};
+const int QUALITY_LEVEL_COUNT = sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]);
+
+// Weight of the newest frame in the smoothed frame time
+const double QUALITY_SMOOTHING = 0.15;
+// The smoothed time is kept under this share of the budget, what is left absorbs spikes
+const double QUALITY_HEADROOM = 0.85;
+// Quality only goes up again when the better level is predicted to stay under the headroom...
+const int QUALITY_RAISE_FRAMES = 60;
+// ...for this many frames, doubled every time a raise had to be taken back soon after (up to the maximum)
+const int QUALITY_RAISE_FRAMES_MAX = 960;
+// Frames ignored after a change: timer results arrive a few frames late (GpuTimer::QUERY_COUNT)
+const int QUALITY_SETTLE_FRAMES = 4;
+
+// Closed loop quality control for a frame time budget. Every drawn frame reports its GPU and CPU time, the
+// larger one is smoothed (damping), and the level moves along QUALITY_LEVELS:
+//   - down as soon as the smoothed time passes the headroom, or any single frame the budget;
+//   - up only after a long calm stretch in which the better level, predicted from the cost ratio between the
+//     two measured at the last step down (the share of pixels before that), stays under the headroom. Going
+//     up needs room for the whole ratio, so a level that just failed is not tried again at once (hysteresis),
+//     and a raise that gets taken back soon after makes the next one wait twice as long.
+// The caller applies Settings() to the frame.
+class QualityGovernor
+{
+public:
+	GLfloat BudgetMilliseconds;
+	int Level;
+
+	QualityGovernor(GLfloat budgetMilliseconds) : BudgetMilliseconds(budgetMilliseconds), Level(0)
+	{
+		this->Reset();
+	}
+
+	const QualityLevel& Settings() const
+	{
+		return QUALITY_LEVELS[this->Level];
+	}
+
+	// Back to the best level, e.g. when the governor is switched on
+	void Reset()
+	{
+		this->Level = 0;
+		this->smoothed = -1.0;
+		this->settle = QUALITY_SETTLE_FRAMES;
+		this->calmFrames = 0;
+		this->raiseFrames = QUALITY_RAISE_FRAMES;
+		this->sinceRaise = QUALITY_RAISE_FRAMES_MAX;
+		this->droppedFrom = -1;
+		for (int i = 0; i + 1 < QUALITY_LEVEL_COUNT; i++)
+		{
+			GLfloat pixels = QUALITY_LEVELS[i].RenderScale / QUALITY_LEVELS[i + 1].RenderScale;
+			this->ratios[i] = std::max((double)(pixels * pixels), 1.2);
+		}
+	}
+
+	// Feeds the times of a drawn frame, true when the level changed
+	bool Update(double gpuMilliseconds, double cpuMilliseconds)
+	{
+		this->sinceRaise = std::min(this->sinceRaise + 1, QUALITY_RAISE_FRAMES_MAX);
+		if (this->settle > 0)
+		{
+			this->settle--;
+			return false;
+		}
+		double frame = std::max(gpuMilliseconds, cpuMilliseconds);
+		this->smoothed = this->smoothed < 0.0 ? frame : this->smoothed + (frame - this->smoothed) * QUALITY_SMOOTHING;
+		// First time of the level just stepped down to: what the step saved
+		if (this->droppedFrom >= 0)
+		{
+			this->ratios[this->droppedFrom] = std::max(this->droppedTime / std::max(frame, 0.01), 1.0);
+			this->droppedFrom = -1;
+		}
+
+		if ((this->smoothed > this->BudgetMilliseconds * QUALITY_HEADROOM || frame > this->BudgetMilliseconds) && this->Level + 1 < QUALITY_LEVEL_COUNT)
+		{
+			// Taken back soon after going up: that level does not fit, try it again less often
+			if (this->sinceRaise < this->raiseFrames * 2)
+				this->raiseFrames = std::min(this->raiseFrames * 2, QUALITY_RAISE_FRAMES_MAX);
+			this->droppedFrom = this->Level;
+			this->droppedTime = this->smoothed;
+			return this->change(this->Level + 1);
+		}
+		if (this->Level > 0 && this->smoothed * this->ratios[this->Level - 1] < this->BudgetMilliseconds * QUALITY_HEADROOM)
+		{
+			if (++this->calmFrames >= this->raiseFrames)
+			{
+				this->sinceRaise = 0;
+				return this->change(this->Level - 1);
+			}
+		}
+		else
+			this->calmFrames = 0;
+		return false;
+	}
+
+	// Smoothed frame time in milliseconds, negative before the first measurement
+	double Smoothed() const
+	{
+		return this->smoothed;
+	}
+
+private:
+	double smoothed;
+	int settle, calmFrames, raiseFrames, sinceRaise;
+	// ratios[i]: time of level i over time of level i + 1
+	double ratios[QUALITY_LEVEL_COUNT];
+	int droppedFrom;
+	double droppedTime;
+
+	// The frames after a change still show the old level's times, they are skipped and the smoothing starts over
+	bool change(int level)
+	{
+		this->Level = level;
+		this->smoothed = -1.0;
+		this->settle = QUALITY_SETTLE_FRAMES;
+		this->calmFrames = 0;
+		return true;
+	}
+};
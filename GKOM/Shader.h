@@ -2,97 +2,244 @@
 #define SHADER_H
 
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <chrono>
 
 #include <GL/glew.h>
 
+#include "AssetPack.h"
+#include "ProgramCache.h"
+#include "FileWatcher.h"
+
+// Functions and declarations every fragment shader shares, inserted after the defines (see setSource)
+const GLchar* const SHADER_COMMON_PATH = "common.frag";
+
 class Shader
 {
 public:
 	GLuint Program;
-	// Constructor generates the shader on the fly
-	Shader(const GLchar* vertexPath, const GLchar* fragmentPath)
+	// Constructor generates the shader on the fly, defines (lines of "#define NAME value") go right after #version,
+	// followed in the fragment stage by common.frag. The geometry stage is optional
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const std::string& defines = "", const GLchar* geometryPath = NULL)
+		: vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath != NULL ? geometryPath : ""), defines(defines)
+	{
+		Build initial = this->startBuild();
+		this->finishBuild(initial);
+		this->Program = initial.Program;
+	}
+	// Uses the current shader
+	void Use()
+	{
+		glUseProgram(this->Program);
+	}
+
+	// Registers the source files with a watcher, see Reload
+	void Watch(FileWatcher& watcher) const
+	{
+		watcher.Add(this->vertexPath);
+		watcher.Add(this->fragmentPath);
+		if (!this->geometryPath.empty())
+			watcher.Add(this->geometryPath);
+		watcher.Add(SHADER_COMMON_PATH);
+	}
+
+	// Starts rebuilding the program if it is made from path. The build runs on the driver's compiler threads
+	// where GL_ARB_parallel_shader_compile is available; Update swaps it in once it has linked.
+	// Reloads read loose files, an asset packed into gkom.pak always wins over them
+	void Reload(const std::string& path)
 	{
-		// 1. Retrieve the vertex/fragment source code from filePath
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		// ensures ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::badbit);
-		try
+		if (path != this->vertexPath && path != this->fragmentPath && (this->geometryPath.empty() || path != this->geometryPath) && path != SHADER_COMMON_PATH)
+			return;
+		this->discardBuild();
+		AssetPack::Default().Release(path);
+		this->pending = this->startBuild();
+	}
+
+	// Call once per frame: true when a reloaded program replaced Program, whose uniforms then need setting again.
+	// A build that fails to compile or link is reported and dropped, the old program stays in use
+	bool Update()
+	{
+		if (this->pending.Program == 0)
+			return false;
+		if (GLEW_ARB_parallel_shader_compile && this->pending.Vertex != 0)
 		{
-			// Open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// Read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// Convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+			GLint complete = GL_FALSE;
+			glGetProgramiv(this->pending.Program, GL_COMPLETION_STATUS_ARB, &complete);
+			if (!complete)
+				return false;
 		}
-		catch (std::ifstream::failure e)
+		bool linked = this->finishBuild(this->pending);
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->pending.Started).count();
+		if (!linked)
 		{
+			std::cout << "ERROR::SHADER::RELOAD_FAILED " << this->vertexPath << " " << this->fragmentPath << ", keeping the previous program" << std::endl;
+			this->discardBuild();
+			return false;
+		}
+		std::cout << "SHADER::RELOADED " << this->vertexPath << " " << this->fragmentPath << " in " << milliseconds << " ms" << std::endl;
+		glDeleteProgram(this->Program);
+		this->Program = this->pending.Program;
+		this->pending = Build();
+		return true;
+	}
+
+private:
+	// A program on its way through compile and link, the shader objects live until the result has been checked
+	struct Build
+	{
+		GLuint Program, Vertex, Fragment, Geometry;
+		bool Cached;
+		GLuint64 CacheKey;
+		std::chrono::steady_clock::time_point Started;
+
+		Build() : Program(0), Vertex(0), Fragment(0), Geometry(0), Cached(false), CacheKey(0) {}
+	};
+
+	std::string vertexPath, fragmentPath, geometryPath, defines;
+	Build pending;
+
+	// Issues everything up to glLinkProgram without asking for results, so a parallel compiler is not waited on
+	Build startBuild()
+	{
+		Build build;
+		build.Started = std::chrono::steady_clock::now();
+		// 1. Retrieve the vertex/fragment source code from the asset pack (or the loose files), no copies are made
+		AssetView vertexSource = AssetPack::Default().Read(this->vertexPath);
+		AssetView fragmentSource = AssetPack::Default().Read(this->fragmentPath);
+		if (!vertexSource.IsValid() || !fragmentSource.IsValid())
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		const GLchar* vShaderCode = vertexSource.IsValid() ? (const GLchar*)vertexSource.Data : "";
+		const GLchar * fShaderCode = fragmentSource.IsValid() ? (const GLchar*)fragmentSource.Data : "";
+		GLint vShaderLength = (GLint)vertexSource.Size;
+		GLint fShaderLength = (GLint)fragmentSource.Size;
+		AssetView geometrySource;
+		if (!this->geometryPath.empty())
+		{
+			geometrySource = AssetPack::Default().Read(this->geometryPath);
+			if (!geometrySource.IsValid())
+				std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const GLchar* vShaderCode = vertexCode.c_str();
-		const GLchar * fShaderCode = fragmentCode.c_str();
-		// 2. Compile shaders
-		GLuint vertex, fragment;
+		const GLchar* gShaderCode = geometrySource.IsValid() ? (const GLchar*)geometrySource.Data : "";
+		GLint gShaderLength = (GLint)geometrySource.Size;
+		AssetView commonSource = AssetPack::Default().Read(SHADER_COMMON_PATH);
+		if (!commonSource.IsValid())
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << SHADER_COMMON_PATH << std::endl;
+		const GLchar* commonCode = commonSource.IsValid() ? (const GLchar*)commonSource.Data : "";
+		GLint commonLength = (GLint)commonSource.Size;
+		// 2. Reuse the program linked by an earlier run when the sources and the driver are unchanged
+		build.Program = glCreateProgram();
+		build.Cached = ProgramCache::Supported();
+		build.CacheKey = build.Cached ? ProgramCache::Key(vShaderCode, vShaderLength, fShaderCode, fShaderLength, this->defines + std::string(commonCode, commonLength), gShaderCode, gShaderLength) : 0;
+		if (build.Cached && ProgramCache::Load(build.Program, build.CacheKey))
+			return build;
+		// 3. Compile shaders
+		// Vertex Shader
+		build.Vertex = glCreateShader(GL_VERTEX_SHADER);
+		setSource(build.Vertex, vShaderCode, vShaderLength, this->defines);
+		glCompileShader(build.Vertex);
+		// Fragment Shader
+		build.Fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		setSource(build.Fragment, fShaderCode, fShaderLength, this->defines, commonCode, commonLength);
+		glCompileShader(build.Fragment);
+		// Geometry Shader
+		if (!this->geometryPath.empty())
+		{
+			build.Geometry = glCreateShader(GL_GEOMETRY_SHADER);
+			setSource(build.Geometry, gShaderCode, gShaderLength, this->defines);
+			glCompileShader(build.Geometry);
+		}
+		// Shader Program
+		glAttachShader(build.Program, build.Vertex);
+		glAttachShader(build.Program, build.Fragment);
+		if (build.Geometry != 0)
+			glAttachShader(build.Program, build.Geometry);
+		if (build.Cached)
+			glProgramParameteri(build.Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(build.Program);
+		return build;
+	}
+
+	// Checks the results (blocking if the compiler is still busy), prints errors and stores a new binary in the cache
+	bool finishBuild(Build& build)
+	{
+		if (build.Vertex == 0)
+			return true;
 		GLint success;
 		GLchar infoLog[512];
-		// Vertex Shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
 		// Print compile errors if any
-		glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+		glGetShaderiv(build.Vertex, GL_COMPILE_STATUS, &success);
 		if (!success)
 		{
-			glGetShaderInfoLog(vertex, 512, NULL, infoLog);
+			glGetShaderInfoLog(build.Vertex, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 		}
-		// Fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		// Print compile errors if any
-		glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+		glGetShaderiv(build.Fragment, GL_COMPILE_STATUS, &success);
 		if (!success)
 		{
-			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
+			glGetShaderInfoLog(build.Fragment, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
 		}
-		// Shader Program
-		this->Program = glCreateProgram();
-		glAttachShader(this->Program, vertex);
-		glAttachShader(this->Program, fragment);
-		glLinkProgram(this->Program);
+		if (build.Geometry != 0)
+		{
+			glGetShaderiv(build.Geometry, GL_COMPILE_STATUS, &success);
+			if (!success)
+			{
+				glGetShaderInfoLog(build.Geometry, 512, NULL, infoLog);
+				std::cout << "ERROR::SHADER::GEOMETRY::COMPILATION_FAILED\n" << infoLog << std::endl;
+			}
+		}
 		// Print linking errors if any
-		glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
+		glGetProgramiv(build.Program, GL_LINK_STATUS, &success);
 		if (!success)
 		{
-			glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
+			glGetProgramInfoLog(build.Program, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
 		}
+		else if (build.Cached)
+			ProgramCache::Save(build.Program, build.CacheKey);
 		// Delete the shaders as they're linked into our program now and no longer necessery
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
+		glDeleteShader(build.Vertex);
+		glDeleteShader(build.Fragment);
+		if (build.Geometry != 0)
+			glDeleteShader(build.Geometry);
+		build.Vertex = build.Fragment = build.Geometry = 0;
+		return success != 0;
+	}
 
+	void discardBuild()
+	{
+		if (this->pending.Vertex != 0)
+		{
+			glDeleteShader(this->pending.Vertex);
+			glDeleteShader(this->pending.Fragment);
+			if (this->pending.Geometry != 0)
+				glDeleteShader(this->pending.Geometry);
+		}
+		if (this->pending.Program != 0)
+			glDeleteProgram(this->pending.Program);
+		this->pending = Build();
 	}
-	// Uses the current shader
-	void Use()
+
+	// Splits the source after its #version line and hands GL the pieces (defines, then the common code), so neither
+	// file is ever copied. The #lines keep compiler messages pointing at the lines of the files: source string 1
+	// is common.frag, 0 the shader's own file
+	static void setSource(GLuint shader, const GLchar* code, GLint length, const std::string& defines, const GLchar* common = "", GLint commonLength = 0)
 	{
-		glUseProgram(this->Program);
+		if (defines.empty() && commonLength == 0)
+		{
+			glShaderSource(shader, 1, &code, &length);
+			return;
+		}
+		GLint versionEnd = 0;
+		if (length >= 8 && std::string(code, 8) == "#version")
+			while (versionEnd < length && code[versionEnd++] != '\n')
+				;
+		std::string inserted = defines + (commonLength > 0 ? "#line 1 1\n" : "");
+		std::string resumed = std::string(commonLength > 0 ? "\n" : "") + (versionEnd > 0 ? "#line 2 0\n" : "#line 1 0\n");
+		const GLchar* pieces[5] = { code, inserted.c_str(), common, resumed.c_str(), code + versionEnd };
+		GLint lengths[5] = { versionEnd, (GLint)inserted.size(), commonLength, (GLint)resumed.size(), length - versionEnd };
+		glShaderSource(shader, 5, pieces, lengths);
 	}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,140 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+
+// GL Includes
+#include <GL/glew.h>
+
+#include "Shader.h"
+
+// Features a draw can ask for, each becomes a #define in the variant compiled for it
+enum ShaderFeature
+{
+	SHADER_SPECULAR_MAP = 1 << 0,     // sample material.specular, otherwise the specular term is compiled out
+	SHADER_VIRTUAL_TEXTURE = 1 << 1,  // diffuse comes from the virtual texture instead of material.diffuse
+	SHADER_COUNTERS = 1 << 2,         // benchmark: output per fragment work counts instead of a color (FragmentCounters.h)
+	SHADER_SHADOWS = 1 << 3,          // sample the point light shadow maps (ShadowMaps.h)
+	SHADER_LIGHTMAP = 1 << 4,         // static surface: the baked lights come from the lightmap (LightmapBaker.h)
+	SHADER_PROBES = 1 << 5,           // add the bounce light of the probe grid (IrradianceProbes.h)
+	SHADER_ENVIRONMENT = 1 << 6,      // ambient from the prefiltered sky cubes instead of the lights (EnvironmentMap.h)
+	SHADER_MOTION_VECTORS = 1 << 7,   // also write the screen motion since the last frame (TemporalUpsampler.h)
+};
+
+// Bits 8 and up of a key carry a light count: the shader then loops over exactly that many lights (LIGHT_COUNT)
+// instead of reading the light clusters
+const GLuint SHADER_LIGHT_COUNT_SHIFT = 8;
+
+// Compiles one vertex/fragment pair into specialized variants on demand. Each key (feature bits and light count)
+// is compiled the first time it is asked for and kept, so only the variants the scene actually uses are built.
+class ShaderPermutations
+{
+public:
+	ShaderPermutations(const GLchar* vertexPath, const GLchar* fragmentPath) : vertexPath(vertexPath), fragmentPath(fragmentPath)
+	{
+	}
+
+	static GLuint Key(GLuint features, GLuint lightCount = 0)
+	{
+		return features | (lightCount << SHADER_LIGHT_COUNT_SHIFT);
+	}
+
+	// Sampler units are set once on every variant when it is compiled
+	void SetSampler(const std::string& name, GLint unit)
+	{
+		this->samplers.push_back(std::make_pair(name, unit));
+		for (std::map<GLuint, Shader>::iterator it = this->variants.begin(); it != this->variants.end(); ++it)
+			this->applySamplers(it->second.Program);
+	}
+
+	Shader& Get(GLuint key)
+	{
+		std::map<GLuint, Shader>::iterator it = this->variants.find(key);
+		if (it == this->variants.end())
+		{
+			it = this->variants.insert(std::make_pair(key, Shader(this->vertexPath.c_str(), this->fragmentPath.c_str(), Defines(key)))).first;
+			this->applySamplers(it->second.Program);
+		}
+		return it->second;
+	}
+
+	// Makes the variant current and returns its program
+	GLuint Use(GLuint key)
+	{
+		Shader& shader = this->Get(key);
+		shader.Use();
+		return shader.Program;
+	}
+
+	// Hot reload, see Shader: every compiled variant shares the two source files and common.frag
+	void Watch(FileWatcher& watcher) const
+	{
+		watcher.Add(this->vertexPath);
+		watcher.Add(this->fragmentPath);
+		watcher.Add(SHADER_COMMON_PATH);
+	}
+
+	void Reload(const std::string& path)
+	{
+		for (std::map<GLuint, Shader>::iterator it = this->variants.begin(); it != this->variants.end(); ++it)
+			it->second.Reload(path);
+	}
+
+	// Swaps in the variants whose rebuild has linked and gives them their sampler units back, true if any was swapped
+	bool Update()
+	{
+		bool swapped = false;
+		for (std::map<GLuint, Shader>::iterator it = this->variants.begin(); it != this->variants.end(); ++it)
+			if (it->second.Update())
+			{
+				this->applySamplers(it->second.Program);
+				swapped = true;
+			}
+		return swapped;
+	}
+
+	size_t VariantCount() const
+	{
+		return this->variants.size();
+	}
+
+	static std::string Defines(GLuint key)
+	{
+		std::ostringstream defines;
+		if (key & SHADER_SPECULAR_MAP)
+			defines << "#define SPECULAR_MAP\n";
+		if (key & SHADER_VIRTUAL_TEXTURE)
+			defines << "#define VIRTUAL_TEXTURE\n";
+		if (key & SHADER_COUNTERS)
+			defines << "#define COUNTERS\n";
+		if (key & SHADER_SHADOWS)
+			defines << "#define SHADOWS\n";
+		if (key & SHADER_LIGHTMAP)
+			defines << "#define LIGHTMAP\n";
+		if (key & SHADER_PROBES)
+			defines << "#define PROBES\n";
+		if (key & SHADER_ENVIRONMENT)
+			defines << "#define ENVIRONMENT\n";
+		if (key & SHADER_MOTION_VECTORS)
+			defines << "#define MOTION_VECTORS\n";
+		if (key >> SHADER_LIGHT_COUNT_SHIFT)
+			defines << "#define LIGHT_COUNT " << (key >> SHADER_LIGHT_COUNT_SHIFT) << "\n";
+		return defines.str();
+	}
+
+private:
+	std::string vertexPath, fragmentPath;
+	std::vector<std::pair<std::string, GLint> > samplers;
+	std::map<GLuint, Shader> variants;
+
+	// Leaves program current, every draw makes its variant current first anyway
+	void applySamplers(GLuint program)
+	{
+		glUseProgram(program);
+		for (size_t i = 0; i < this->samplers.size(); i++)
+			glUniform1i(glGetUniformLocation(program, this->samplers[i].first.c_str()), this->samplers[i].second);
+	}
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "ClusteredLights.h"
+
+// Lights 0 .. SHADOW_LIGHTS - 1 cast shadows, gkom.frag and light_volume.frag have the same constant
+const int SHADOW_LIGHTS = 3;
+const GLsizei SHADOW_SIZE = 512;
+const GLfloat SHADOW_NEAR = 0.05f;
+
+// Cube shadow maps for point lights, split into a cached static layer and a per frame dynamic layer.
+// The static casters are rendered into the static cube once, and again only when the light moves. Every frame
+// the static cube is blitted into the dynamic one and just the dynamic casters are drawn on top; frames where
+// nothing dynamic moved keep the previous result. Cubes store distance to the light / far (far = light radius)
+// and are sampled with hardware comparison; shadow_depth.gs draws all six faces in one pass.
+class ShadowMaps
+{
+public:
+	ShadowMaps(GLsizei size = SHADOW_SIZE) : size(size), count(0)
+	{
+		glGenTextures(SHADOW_LIGHTS, this->staticMaps);
+		glGenTextures(SHADOW_LIGHTS, this->dynamicMaps);
+		glGenFramebuffers(SHADOW_LIGHTS, this->staticFramebuffers);
+		glGenFramebuffers(SHADOW_LIGHTS, this->dynamicFramebuffers);
+		glGenFramebuffers(2, this->blitFramebuffers);
+		for (int i = 0; i < SHADOW_LIGHTS; i++)
+		{
+			createCube(this->staticMaps[i]);
+			createCube(this->dynamicMaps[i]);
+			attachLayered(this->staticFramebuffers[i], this->staticMaps[i]);
+			attachLayered(this->dynamicFramebuffers[i], this->dynamicMaps[i]);
+			this->valid[i] = false;
+			this->farPlanes[i] = 1.0f;
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, this->blitFramebuffers[i]);
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	~ShadowMaps()
+	{
+		glDeleteFramebuffers(SHADOW_LIGHTS, this->staticFramebuffers);
+		glDeleteFramebuffers(SHADOW_LIGHTS, this->dynamicFramebuffers);
+		glDeleteFramebuffers(2, this->blitFramebuffers);
+		glDeleteTextures(SHADOW_LIGHTS, this->staticMaps);
+		glDeleteTextures(SHADOW_LIGHTS, this->dynamicMaps);
+	}
+
+	// Brings the maps of the first SHADOW_LIGHTS lights up to date. The callbacks draw the casters with
+	// positions only, setting "model" on the program they are given. dynamicChanged tells whether any dynamic
+	// caster moved since the previous call.
+	void Update(const std::vector<PointLight>& lights, GLuint program, const std::function<void(GLuint)>& drawStatic, const std::function<void(GLuint)>& drawDynamic, bool dynamicChanged)
+	{
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glViewport(0, 0, this->size, this->size);
+		glUseProgram(program);
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+
+		this->count = std::min((int)lights.size(), SHADOW_LIGHTS);
+		for (int i = 0; i < this->count; i++)
+		{
+			const PointLight& light = lights[i];
+			bool staticChanged = !this->valid[i] || light.Position != this->positions[i] || std::max(light.Radius, SHADOW_NEAR * 2.0f) != this->farPlanes[i];
+			if (staticChanged)
+			{
+				this->positions[i] = light.Position;
+				this->farPlanes[i] = std::max(light.Radius, SHADOW_NEAR * 2.0f);
+				this->valid[i] = true;
+				this->setLight(program, i);
+				glBindFramebuffer(GL_FRAMEBUFFER, this->staticFramebuffers[i]);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				drawStatic(program);
+			}
+			if (!staticChanged && !dynamicChanged)
+				continue;
+			// Static layer into the dynamic cube, face by face, then the moving casters on top of it
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, this->blitFramebuffers[0]);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->blitFramebuffers[1]);
+			for (int face = 0; face < 6; face++)
+			{
+				glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->staticMaps[i], 0);
+				glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->dynamicMaps[i], 0);
+				glBlitFramebuffer(0, 0, this->size, this->size, 0, 0, this->size, this->size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			}
+			this->setLight(program, i);
+			glBindFramebuffer(GL_FRAMEBUFFER, this->dynamicFramebuffers[i]);
+			drawDynamic(program);
+		}
+
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	// Binds the dynamic cubes to firstUnit .. firstUnit + SHADOW_LIGHTS - 1 with their far planes;
+	// shadowCount is 0 when shadows are off
+	void Bind(GLuint program, GLint firstUnit, bool enabled = true)
+	{
+		for (int i = 0; i < SHADOW_LIGHTS; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, this->dynamicMaps[i]);
+			std::string index = "[" + std::to_string(i) + "]";
+			glUniform1i(glGetUniformLocation(program, ("shadowMaps" + index).c_str()), firstUnit + i);
+			glUniform1f(glGetUniformLocation(program, ("shadowFar" + index).c_str()), this->farPlanes[i]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(program, "shadowCount"), enabled ? this->count : 0);
+	}
+
+	// Binds the static cubes (the static casters alone) to firstUnit .. firstUnit + SHADOW_LIGHTS - 1 as
+	// staticShadowMaps, for lightmapped surfaces whose bake already has those shadows; they share Bind's far planes
+	void BindStatic(GLuint program, GLint firstUnit)
+	{
+		for (int i = 0; i < SHADOW_LIGHTS; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, this->staticMaps[i]);
+			glUniform1i(glGetUniformLocation(program, ("staticShadowMaps[" + std::to_string(i) + "]").c_str()), firstUnit + i);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+private:
+	GLsizei size;
+	int count;
+	GLuint staticMaps[SHADOW_LIGHTS], dynamicMaps[SHADOW_LIGHTS];
+	GLuint staticFramebuffers[SHADOW_LIGHTS], dynamicFramebuffers[SHADOW_LIGHTS], blitFramebuffers[2];
+	glm::vec3 positions[SHADOW_LIGHTS];
+	GLfloat farPlanes[SHADOW_LIGHTS];
+	bool valid[SHADOW_LIGHTS];
+
+	void createCube(GLuint texture)
+	{
+		glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+		for (int face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, this->size, this->size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		// Linear filtering with comparison gives 2x2 PCF for free
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	}
+
+	void attachLayered(GLuint framebuffer, GLuint texture)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+	}
+
+	// View-projection of the six faces in GL's cube map orientation, plus the distance normalization
+	void setLight(GLuint program, int index)
+	{
+		const glm::vec3& p = this->positions[index];
+		glm::mat4 projection = glm::perspective(1.57079633f, 1.0f, SHADOW_NEAR, this->farPlanes[index]);
+		const glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+		const glm::vec3 ups[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+		glm::mat4 matrices[6];
+		for (int face = 0; face < 6; face++)
+			matrices[face] = projection * glm::lookAt(p, p + directions[face], ups[face]);
+		glUniformMatrix4fv(glGetUniformLocation(program, "shadowMatrices"), 6, GL_FALSE, glm::value_ptr(matrices[0]));
+		glUniform3f(glGetUniformLocation(program, "lightPos"), p.x, p.y, p.z);
+		glUniform1f(glGetUniformLocation(program, "farPlane"), this->farPlanes[index]);
+	}
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Mesh.h"
+#include "Primitives.h"
+
+// Background cubemap drawn after the opaque geometry. skybox.vs puts every vertex on the far plane (z = w) and the
+// box is tested with GL_LEQUAL against the cleared depth, so early-Z rejects each pixel the scene already covers
+// and the sky only runs its single fetch where nothing else was drawn.
+class Skybox
+{
+public:
+	Skybox()
+	{
+		this->box.Upload(Primitives::Box(glm::vec3(2.0f)));
+	}
+
+	// Leaves the default depth state (GL_LESS, writes on) behind
+	void Draw(GLuint program, GLuint cubemap, const glm::mat4& view, const glm::mat4& projection)
+	{
+		glUseProgram(program);
+		// Rotation only: the sky stays around the camera
+		glm::mat4 rotation = glm::mat4(glm::mat3(view));
+		glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(rotation));
+		glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+		glUniform1i(glGetUniformLocation(program, "sky"), 0);
+		// Seen from inside, so the front faces are the ones to drop
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(GL_FALSE);
+		glCullFace(GL_FRONT);
+		this->box.Draw();
+		glCullFace(GL_BACK);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	}
+
+private:
+	Mesh box;
+};
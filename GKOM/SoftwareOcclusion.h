@@ -0,0 +1,394 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+// SSE2 is the baseline for the x86/x64 targets we build, other targets use the scalar path
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HIZ_SIMD 1
+#include <emmintrin.h>
+#endif
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// Depth buffer the occluders are rasterized into: a multiple of the SIMD width, halving evenly down to 4x3
+const int HIZ_WIDTH = 256;
+const int HIZ_HEIGHT = 192;
+const int HIZ_LEVELS = 7;
+// Workers at most, each rasterizes a band of rows
+const int HIZ_MAX_THREADS = 4;
+// Pixels added around a tested box, for the jitter of upsampled frames
+const int HIZ_MARGIN = 1;
+
+// Software occlusion culling, independent of the GPU. Static occluders (AddOccluder) are kept as world space
+// triangles; each frame the workers rasterize them into a small depth buffer, one band of rows per worker
+// (SSE2, four pixels at a time), build a pyramid holding the farthest depth of every 2x2 block above it, and
+// test the boxes given to Object against the level where a box covers no more than a few texels. Everything
+// is conservative: a pixel only takes an occluder's depth when the triangle covers all of it, at the farthest
+// depth the triangle has inside it, and a box is hidden only when its nearest point lies behind the farthest
+// occluder depth over its whole rectangle. Boxes off the screen are hidden too, boxes cut by the near plane
+// never. Start hands the frame to the workers and returns, the first IsHidden waits for them: started once the
+// frame's transforms are known, the culling runs while the frame is set up, and hidden objects are never
+// submitted to GL.
+class SoftwareOcclusion
+{
+public:
+	bool Enabled;
+
+	SoftwareOcclusion() : Enabled(false), generation(0), remaining(0), done(true), quit(false), totalMicroseconds(0), waitedMicroseconds(0), frames(0)
+	{
+		for (int level = 0; level < HIZ_LEVELS; level++)
+			this->levels[level].assign((HIZ_WIDTH >> level) * (HIZ_HEIGHT >> level), 1.0f);
+		this->threadCount = std::max(1, std::min((int)std::thread::hardware_concurrency(), HIZ_MAX_THREADS));
+		for (int t = 0; t < this->threadCount; t++)
+			this->workers.push_back(std::thread(&SoftwareOcclusion::work, this, t));
+	}
+
+	~SoftwareOcclusion()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->quit = true;
+		}
+		this->started.notify_all();
+		for (size_t i = 0; i < this->workers.size(); i++)
+			this->workers[i].join();
+	}
+
+	// A mesh that never moves and hides what is behind it. Only float positions (attribute 0) are read
+	void AddOccluder(const MeshData& mesh, const glm::mat4& model)
+	{
+		this->wait();
+		const MeshHeader& h = mesh.Header;
+		const VertexAttribute* position = NULL;
+		for (GLuint i = 0; i < h.AttributeCount; i++)
+			if (h.Attributes[i].Location == 0 && h.Attributes[i].Type == GL_FLOAT && h.Attributes[i].Components >= 3)
+				position = &h.Attributes[i];
+		if (position == NULL || mesh.Vertices == NULL)
+			return;
+		GLuint cornerCount = h.IndexCount > 0 ? h.IndexCount : h.VertexCount;
+		for (GLuint t = 0; t + 2 < cornerCount; t += 3)
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint vertex = h.IndexCount > 0 ? mesh.Indices[t + k] : t + k;
+				const GLfloat* p = (const GLfloat*)(mesh.Vertices + vertex * h.Stride + position->Offset);
+				this->triangles.push_back(glm::vec3(model * glm::vec4(p[0], p[1], p[2], 1.0f)));
+			}
+	}
+
+	// The box of the object in slot id (the same one every frame) for the next Start, in model space
+	void Object(size_t id, const glm::mat4& model, const glm::vec3& lower, const glm::vec3& upper)
+	{
+		this->wait();
+		if (id >= this->objects.size())
+		{
+			this->objects.resize(id + 1);
+			this->hidden.resize(id + 1, 0);
+		}
+		ObjectBox& object = this->objects[id];
+		object.Model = model;
+		object.Lower = lower;
+		object.Upper = upper;
+	}
+
+	// Starts culling the frame seen through viewProjection on the workers. Disabled, nothing is hidden
+	void Start(const glm::mat4& viewProjection)
+	{
+		this->wait();
+		if (!this->Enabled)
+		{
+			std::fill(this->hidden.begin(), this->hidden.end(), 0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->viewProjection = viewProjection;
+			this->startTime = std::chrono::steady_clock::now();
+			this->remaining = this->threadCount;
+			this->done = false;
+			this->generation++;
+		}
+		this->started.notify_all();
+	}
+
+	// Whether the object in slot id is hidden this frame, waits for the workers if they are still at it
+	bool IsHidden(size_t id)
+	{
+		this->wait();
+		return id < this->hidden.size() && this->hidden[id] != 0;
+	}
+
+	// Objects found hidden by the last frame culled
+	size_t Hidden()
+	{
+		this->wait();
+		return (size_t)std::count(this->hidden.begin(), this->hidden.end(), (char)1);
+	}
+
+	size_t Objects() const
+	{
+		return this->objects.size();
+	}
+
+	int Threads() const
+	{
+		return this->threadCount;
+	}
+
+	// Average milliseconds per frame the workers took and the render thread waited for them since the last call,
+	// false if no frame was culled since
+	bool Report(double& milliseconds, double& waitedMilliseconds)
+	{
+		this->wait();
+		if (this->frames == 0)
+			return false;
+		milliseconds = this->totalMicroseconds / 1000.0 / this->frames;
+		waitedMilliseconds = this->waitedMicroseconds / 1000.0 / this->frames;
+		this->totalMicroseconds = 0;
+		this->waitedMicroseconds = 0;
+		this->frames = 0;
+		return true;
+	}
+
+private:
+	struct ObjectBox
+	{
+		glm::mat4 Model;
+		glm::vec3 Lower, Upper;
+	};
+
+	// Occluder triangles in world space, three corners each
+	std::vector<glm::vec3> triangles;
+	std::vector<ObjectBox> objects;
+	std::vector<char> hidden;
+	// levels[0] is the depth buffer (window depth 0 .. 1, 1 where nothing was drawn), level k is 2^k times smaller
+	std::vector<float> levels[HIZ_LEVELS];
+	glm::mat4 viewProjection;
+	std::chrono::steady_clock::time_point startTime;
+
+	// Worker state, guarded by mutex
+	std::vector<std::thread> workers;
+	int threadCount;
+	std::mutex mutex;
+	std::condition_variable started, finished;
+	unsigned int generation;
+	int remaining;
+	bool done, quit;
+	long long totalMicroseconds, waitedMicroseconds;
+	int frames;
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		if (this->done)
+			return;
+		std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+		this->finished.wait(lock, [this]() { return this->done; });
+		this->waitedMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count();
+	}
+
+	// Rasterizes its band every frame, the last worker done with its band builds the pyramid and tests the boxes
+	void work(int index)
+	{
+		unsigned int seen = 0;
+		int first = HIZ_HEIGHT * index / this->threadCount, last = HIZ_HEIGHT * (index + 1) / this->threadCount;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->started.wait(lock, [&]() { return this->quit || this->generation != seen; });
+				if (this->quit)
+					return;
+				seen = this->generation;
+			}
+			this->rasterize(first, last);
+			bool lastDone;
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				lastDone = --this->remaining == 0;
+			}
+			if (!lastDone)
+				continue;
+			this->buildPyramid();
+			this->testObjects();
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->totalMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->startTime).count();
+				this->frames++;
+				this->done = true;
+			}
+			this->finished.notify_all();
+		}
+	}
+
+	// Window position in depth buffer pixels and depth of a clip space position in front of the camera
+	static glm::vec3 toScreen(const glm::vec4& clip)
+	{
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		return glm::vec3((ndc.x * 0.5f + 0.5f) * HIZ_WIDTH, (ndc.y * 0.5f + 0.5f) * HIZ_HEIGHT, ndc.z * 0.5f + 0.5f);
+	}
+
+	// Clears rows first .. last - 1 and draws every occluder triangle into them, cut at the near plane (z = -w)
+	void rasterize(int first, int last)
+	{
+		std::fill(this->levels[0].begin() + first * HIZ_WIDTH, this->levels[0].begin() + last * HIZ_WIDTH, 1.0f);
+		for (size_t t = 0; t + 2 < this->triangles.size(); t += 3)
+		{
+			glm::vec4 corners[3];
+			for (int k = 0; k < 3; k++)
+				corners[k] = this->viewProjection * glm::vec4(this->triangles[t + k], 1.0f);
+			// A triangle loses one corner to the plane or two, what is left has three or four
+			glm::vec4 polygon[4];
+			int count = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const glm::vec4& a = corners[k];
+				const glm::vec4& b = corners[(k + 1) % 3];
+				GLfloat da = a.z + a.w, db = b.z + b.w;
+				if (da >= 0.0f)
+					polygon[count++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f))
+					polygon[count++] = a + (b - a) * (da / (da - db));
+			}
+			if (count < 3)
+				continue;
+			glm::vec3 screen[4];
+			for (int k = 0; k < count; k++)
+				screen[k] = toScreen(polygon[k]);
+			for (int k = 1; k + 1 < count; k++)
+				this->rasterizeTriangle(screen[0], screen[k], screen[k + 1], first, last);
+		}
+	}
+
+	void rasterizeTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, int first, int last)
+	{
+		// Counter-clockwise is the front like in GL, the back faces (the floor from below) hide nothing
+		GLfloat area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (!(area > 0.0f))
+			return;
+		int minX = std::max((int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))), 0);
+		int maxX = std::min((int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))), HIZ_WIDTH - 1);
+		int minY = std::max((int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))), first);
+		int maxY = std::min((int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))), last - 1);
+		if (minX > maxX || minY > maxY)
+			return;
+
+		// Edge functions A x + B y + C, positive inside. Edge k faces corner k, so its value over the area is that
+		// corner's barycentric weight and the depth plane follows from them
+		const glm::vec3* v[3] = { &v0, &v1, &v2 };
+		GLfloat a[3], b[3], c[3];
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec3& from = *v[(k + 1) % 3];
+			const glm::vec3& to = *v[(k + 2) % 3];
+			a[k] = from.y - to.y;
+			b[k] = to.x - from.x;
+			c[k] = -(a[k] * from.x + b[k] * from.y);
+		}
+		GLfloat zA = (a[0] * v0.z + a[1] * v1.z + a[2] * v2.z) / area;
+		GLfloat zB = (b[0] * v0.z + b[1] * v1.z + b[2] * v2.z) / area;
+		// The farthest depth of the plane over a pixel, taken at its center
+		GLfloat zC = (c[0] * v0.z + c[1] * v1.z + c[2] * v2.z) / area + 0.5f * (std::abs(zA) + std::abs(zB));
+		// Pixels count only when the whole square is inside: each edge is tested at the pixel's worst corner
+		for (int k = 0; k < 3; k++)
+			c[k] -= 0.5f * (std::abs(a[k]) + std::abs(b[k]));
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			float* row = &this->levels[0][y * HIZ_WIDTH];
+			GLfloat py = y + 0.5f;
+			int x = minX & ~3;
+#ifdef HIZ_SIMD
+			const __m128 zero = _mm_setzero_ps(), four = _mm_set1_ps(4.0f);
+			__m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+			__m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]), za = _mm_set1_ps(zA);
+			__m128 r0 = _mm_set1_ps(b[0] * py + c[0]), r1 = _mm_set1_ps(b[1] * py + c[1]), r2 = _mm_set1_ps(b[2] * py + c[2]);
+			__m128 rz = _mm_set1_ps(zB * py + zC);
+			for (; x <= maxX; x += 4, px = _mm_add_ps(px, four))
+			{
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero)), _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(old, _mm_add_ps(_mm_mul_ps(za, px), rz));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+#endif
+			for (; x <= maxX; x++)
+			{
+				GLfloat px = x + 0.5f;
+				if (a[0] * px + b[0] * py + c[0] >= 0.0f && a[1] * px + b[1] * py + c[1] >= 0.0f && a[2] * px + b[2] * py + c[2] >= 0.0f)
+					row[x] = std::min(row[x], zA * px + zB * py + zC);
+			}
+		}
+	}
+
+	void buildPyramid()
+	{
+		for (int level = 1; level < HIZ_LEVELS; level++)
+		{
+			int width = HIZ_WIDTH >> level, height = HIZ_HEIGHT >> level;
+			const std::vector<float>& below = this->levels[level - 1];
+			std::vector<float>& above = this->levels[level];
+			for (int y = 0; y < height; y++)
+				for (int x = 0; x < width; x++)
+				{
+					int i = (2 * y) * (2 * width) + 2 * x;
+					above[y * width + x] = std::max(std::max(below[i], below[i + 1]), std::max(below[i + 2 * width], below[i + 2 * width + 1]));
+				}
+		}
+	}
+
+	void testObjects()
+	{
+		for (size_t id = 0; id < this->objects.size(); id++)
+		{
+			const ObjectBox& object = this->objects[id];
+			glm::mat4 transform = this->viewProjection * object.Model;
+			glm::vec3 lower(1e9f), upper(-1e9f);
+			bool clipped = false;
+			for (int corner = 0; corner < 8 && !clipped; corner++)
+			{
+				glm::vec3 position(corner & 1 ? object.Upper.x : object.Lower.x, corner & 2 ? object.Upper.y : object.Lower.y, corner & 4 ? object.Upper.z : object.Lower.z);
+				glm::vec4 clip = transform * glm::vec4(position, 1.0f);
+				clipped = clip.z < -clip.w;
+				glm::vec3 screen = toScreen(clip);
+				lower = glm::min(lower, screen);
+				upper = glm::max(upper, screen);
+			}
+			if (clipped)
+			{
+				this->hidden[id] = 0;
+				continue;
+			}
+			int x0 = std::max((int)std::floor(lower.x) - HIZ_MARGIN, 0), x1 = std::min((int)std::ceil(upper.x) + HIZ_MARGIN, HIZ_WIDTH);
+			int y0 = std::max((int)std::floor(lower.y) - HIZ_MARGIN, 0), y1 = std::min((int)std::ceil(upper.y) + HIZ_MARGIN, HIZ_HEIGHT);
+			if (x0 >= x1 || y0 >= y1)
+			{
+				this->hidden[id] = 1;
+				continue;
+			}
+			// The level where the rectangle spans at most 2 texels each way, so at most 3x3 of them are read
+			int level = 0;
+			while (level + 1 < HIZ_LEVELS && std::max(x1 - x0, y1 - y0) > (2 << level))
+				level++;
+			int width = HIZ_WIDTH >> level;
+			float farthest = 0.0f;
+			for (int y = y0 >> level; y <= (y1 - 1) >> level; y++)
+				for (int x = x0 >> level; x <= (x1 - 1) >> level; x++)
+					farthest = std::max(farthest, this->levels[level][y * width + x]);
+			this->hidden[id] = lower.z > farthest ? 1 : 0;
+		}
+	}
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+// Std. Includes
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Length of the jitter sequence, one sub-pixel offset per frame
+const int TEMPORAL_JITTER_SAMPLES = 8;
+// Lowest render scale, a quarter of the pixels
+const GLfloat TEMPORAL_MIN_SCALE = 0.5f;
+// Frames drawn after the last change before the picture is left to stand, twice round the jitter sequence
+const int TEMPORAL_SETTLE_FRAMES = 16;
+// Share of a sample landing right on a pixel's center, the history keeps the rest
+const GLfloat TEMPORAL_FEEDBACK = 0.1f;
+
+// Temporal upsampling: the scene is shaded at a reduced resolution, each frame with its projection shifted by a
+// different sub-pixel offset, and the full resolution frame is rebuilt from these samples over time. Resolve
+// (taa_resolve.frag) reprojects the last result with the per-pixel motion the scene shaders write (MOTION_VECTORS),
+// clamps it to the range of the new samples around the pixel, so what was uncovered or lit differently does not
+// ghost, and blends in the sample nearest to the pixel. The scene target is allocated at the output size and
+// rendered in its lower left RenderWidth x RenderHeight corner, so changing the scale reallocates nothing.
+class TemporalUpsampler
+{
+public:
+	GLuint SceneFramebuffer, ColorTexture, MotionTexture, DepthTexture;
+	GLsizei RenderWidth, RenderHeight;
+	GLfloat Scale;
+
+	TemporalUpsampler(GLsizei width, GLsizei height, GLfloat scale = 0.75f) : Scale(0.0f), width(width), height(height), frame(0), current(0), historyValid(false)
+	{
+		glGenTextures(1, &this->ColorTexture);
+		glGenTextures(1, &this->MotionTexture);
+		glGenTextures(1, &this->DepthTexture);
+		createTarget(this->ColorTexture, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, GL_LINEAR);
+		createTarget(this->MotionTexture, GL_RG16F, GL_RG, GL_FLOAT, GL_NEAREST);
+		createTarget(this->DepthTexture, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, GL_NEAREST);
+
+		glGenFramebuffers(1, &this->SceneFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->SceneFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->ColorTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->MotionTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->DepthTexture, 0);
+		const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::TEMPORAL::SCENE_INCOMPLETE" << std::endl;
+
+		// Two histories: the last result is read while the new one is written
+		glGenTextures(2, this->historyTextures);
+		glGenFramebuffers(2, this->historyFramebuffers);
+		for (int i = 0; i < 2; i++)
+		{
+			createTarget(this->historyTextures[i], GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_LINEAR);
+			glBindFramebuffer(GL_FRAMEBUFFER, this->historyFramebuffers[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->historyTextures[i], 0);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				std::cout << "ERROR::TEMPORAL::HISTORY_INCOMPLETE" << std::endl;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glGenVertexArrays(1, &this->fullscreenVAO);
+		this->SetScale(scale);
+	}
+
+	~TemporalUpsampler()
+	{
+		glDeleteFramebuffers(1, &this->SceneFramebuffer);
+		glDeleteFramebuffers(2, this->historyFramebuffers);
+		GLuint textures[3] = { this->ColorTexture, this->MotionTexture, this->DepthTexture };
+		glDeleteTextures(3, textures);
+		glDeleteTextures(2, this->historyTextures);
+		glDeleteVertexArrays(1, &this->fullscreenVAO);
+	}
+
+	// Share of the output width and height that is shaded, TEMPORAL_MIN_SCALE .. 1. A new scale starts over
+	void SetScale(GLfloat scale)
+	{
+		scale = std::min(std::max(scale, TEMPORAL_MIN_SCALE), 1.0f);
+		if (scale == this->Scale)
+			return;
+		this->Scale = scale;
+		this->RenderWidth = std::max((GLsizei)std::floor(this->width * scale + 0.5f), 1);
+		this->RenderHeight = std::max((GLsizei)std::floor(this->height * scale + 0.5f), 1);
+		this->Reset();
+	}
+
+	// Forgets the history, the next frame shows only its own samples
+	void Reset()
+	{
+		this->historyValid = false;
+	}
+
+	// This frame's sample offset in render pixels, -0.5 .. 0.5 (Halton sequence in bases 2 and 3)
+	glm::vec2 Jitter() const
+	{
+		int index = this->frame % TEMPORAL_JITTER_SAMPLES + 1;
+		return glm::vec2(halton(index, 2), halton(index, 3)) - 0.5f;
+	}
+
+	// projection shifted by this frame's jitter
+	glm::mat4 Jittered(const glm::mat4& projection) const
+	{
+		glm::vec2 jitter = this->Jitter();
+		glm::mat4 jittered = projection;
+		jittered[2][0] += jitter.x * 2.0f / this->RenderWidth;
+		jittered[2][1] += jitter.y * 2.0f / this->RenderHeight;
+		return jittered;
+	}
+
+	// Binds the scene target with the viewport on the render size and clears it, no motion where nothing is drawn
+	void BeginScene(const glm::vec3& clearColor)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, this->SceneFramebuffer);
+		glViewport(0, 0, this->RenderWidth, this->RenderHeight);
+		const GLfloat color[4] = { clearColor.x, clearColor.y, clearColor.z, 1.0f };
+		const GLfloat still[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 0, color);
+		glClearBufferfv(GL_COLOR, 1, still);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	// Rebuilds the full resolution frame from the scene target's color and the given motion and depth (the scene
+	// target's own or the G-buffer's) into target, and restores the full viewport
+	void Resolve(GLuint program, GLuint target, GLuint motionTexture, GLuint depthTexture)
+	{
+		int next = 1 - this->current;
+		glBindFramebuffer(GL_FRAMEBUFFER, this->historyFramebuffers[next]);
+		glViewport(0, 0, this->width, this->height);
+		glUseProgram(program);
+		const GLuint textures[4] = { this->ColorTexture, motionTexture, depthTexture, this->historyTextures[this->current] };
+		const char* names[4] = { "current", "motion", "depth", "history" };
+		for (int i = 0; i < 4; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glUniform1i(glGetUniformLocation(program, names[i]), i);
+		}
+		glm::vec2 jitter = this->Jitter();
+		glUniform1i(glGetUniformLocation(program, "historyValid"), this->historyValid);
+		glUniform2f(glGetUniformLocation(program, "renderSize"), (GLfloat)this->RenderWidth, (GLfloat)this->RenderHeight);
+		glUniform2f(glGetUniformLocation(program, "outputSize"), (GLfloat)this->width, (GLfloat)this->height);
+		glUniform2f(glGetUniformLocation(program, "jitter"), jitter.x, jitter.y);
+		glUniform1f(glGetUniformLocation(program, "feedback"), TEMPORAL_FEEDBACK);
+		glDisable(GL_DEPTH_TEST);
+		glBindVertexArray(this->fullscreenVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glEnable(GL_DEPTH_TEST);
+		for (int i = 3; i >= 0; i--)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, this->historyFramebuffers[next]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+		glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+		this->current = next;
+		this->historyValid = true;
+		this->frame++;
+	}
+
+private:
+	GLsizei width, height;
+	int frame, current;
+	bool historyValid;
+	GLuint historyFramebuffers[2], historyTextures[2];
+	GLuint fullscreenVAO;
+
+	void createTarget(GLuint texture, GLenum internalFormat, GLenum format, GLenum type, GLint filter)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, this->width, this->height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	static GLfloat halton(int index, int base)
+	{
+		GLfloat result = 0.0f, fraction = 1.0f;
+		for (; index > 0; index /= base)
+		{
+			fraction /= base;
+			result += fraction * (index % base);
+		}
+		return result;
+	}
+};
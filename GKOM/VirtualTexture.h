@@ -0,0 +1,551 @@
+#pragma once
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// GL Includes
+#include <GL/glew.h>
+#include <SOIL.h>
+
+// Feedback buffer is rendered at 1/FEEDBACK_SCALE of the window resolution
+const GLint FEEDBACK_SCALE = 8;
+// Upper bound of tiles copied into the cache each frame, keeps the upload cost per frame flat
+const GLint MAX_UPLOADS_PER_FRAME = 8;
+
+// A software-managed virtual texture that works on plain GL 3.3 (no ARB_sparse_texture).
+// The texture is split into square tiles per mip level and stored on disk as "<prefix>_<mip>_<x>_<y>.tga".
+// Only the tiles that the feedback pass requests are kept in a fixed-size tile cache texture,
+// an indirection page table (one texel per page and mip) tells the shader where each tile lives.
+class VirtualTexture
+{
+public:
+	// Virtual texture layout
+	GLint VirtualSize;	// Texels per side at mip 0
+	GLint TileSize;		// Payload texels per tile side
+	GLint Border;		// Filtering border stored around every tile
+	GLint MipCount;		// Number of page table levels, the coarsest one holds a single page
+	// Physical tile cache
+	GLint CacheTiles;	// Tile slots per side of the cache texture
+	GLuint CacheTexture;
+	GLuint PageTableTexture;
+	// Set by Update when tiles went into the cache, the textured geometry then looks different
+	bool Uploaded;
+
+	// Constructor opens the "<prefix>.vt" descriptor and starts the tile loader thread
+	VirtualTexture(const std::string& prefix, GLint cacheTiles = 16) : VirtualSize(0), TileSize(0), Border(0), MipCount(0), CacheTiles(cacheTiles),
+		CacheTexture(0), PageTableTexture(0), Uploaded(false), prefix(prefix), valid(false), frame(0), feedbackFrames(0), quit(false), feedbackFBO(0), feedbackDepth(0), feedbackColor(0),
+		feedbackWidth(0), feedbackHeight(0)
+	{
+		std::ifstream descriptor((prefix + ".vt").c_str());
+		std::string magic;
+		if (!(descriptor >> magic >> this->VirtualSize >> this->TileSize >> this->Border >> this->MipCount) || magic != "GKOMVT")
+			return;
+		if (this->pages() > 256 || this->MipCount <= 0)
+		{
+			std::cout << "ERROR::VIRTUAL_TEXTURE::UNSUPPORTED_LAYOUT " << prefix << std::endl;
+			return;
+		}
+
+		// Tile cache, no mipmaps: every tile is already the right level of detail
+		GLint cacheSize = this->CacheTiles * this->slotSize();
+		glGenTextures(1, &this->CacheTexture);
+		glBindTexture(GL_TEXTURE_2D, this->CacheTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, cacheSize, cacheSize, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		// Page table, one RGBA8 texel per page: cache slot x, cache slot y, resident mip, valid
+		glGenTextures(1, &this->PageTableTexture);
+		glBindTexture(GL_TEXTURE_2D, this->PageTableTexture);
+		this->pageTable.resize(this->MipCount);
+		for (GLint mip = 0; mip < this->MipCount; mip++)
+		{
+			GLint pages = this->pages() >> mip;
+			this->pageTable[mip].assign(pages * pages * 4, 0);
+			glTexImage2D(GL_TEXTURE_2D, mip, GL_RGBA8, pages, pages, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, this->MipCount - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// The coarsest tile is loaded up front and pinned, so every lookup has a fallback
+		this->slots.resize(this->CacheTiles * this->CacheTiles);
+		GLuint rootKey = makeKey(this->MipCount - 1, 0, 0);
+		unsigned char* root = this->loadTile(rootKey);
+		if (root == NULL)
+		{
+			std::cout << "ERROR::VIRTUAL_TEXTURE::ROOT_TILE_NOT_FOUND " << prefix << std::endl;
+			return;
+		}
+		this->uploadTile(0, rootKey, root);
+		this->slots[0].Pinned = true;
+		SOIL_free_image_data(root);
+		this->updatePageTable();
+
+		this->valid = true;
+		this->loader = std::thread(&VirtualTexture::loaderMain, this);
+	}
+
+	~VirtualTexture()
+	{
+		if (this->loader.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->quit = true;
+			}
+			this->wake.notify_all();
+			this->loader.join();
+		}
+		for (size_t i = 0; i < this->loaded.size(); i++)
+			SOIL_free_image_data(this->loaded[i].Pixels);
+		glDeleteTextures(1, &this->CacheTexture);
+		glDeleteTextures(1, &this->PageTableTexture);
+		glDeleteFramebuffers(1, &this->feedbackFBO);
+		glDeleteRenderbuffers(1, &this->feedbackDepth);
+		glDeleteTextures(1, &this->feedbackColor);
+		if (this->feedbackColor != 0)
+			glDeleteBuffers(2, this->feedbackPBO);
+	}
+
+	// False when the tile set is missing, callers then fall back to a regular texture
+	bool IsValid()
+	{
+		return this->valid;
+	}
+
+	// Binds the low resolution feedback target, the caller then draws the virtually textured geometry with the feedback shader
+	void BeginFeedback(GLsizei width, GLsizei height)
+	{
+		GLsizei feedbackWidth = std::max(width / FEEDBACK_SCALE, 1), feedbackHeight = std::max(height / FEEDBACK_SCALE, 1);
+		if (this->feedbackColor == 0 || feedbackWidth != this->feedbackWidth || feedbackHeight != this->feedbackHeight)
+			this->createFeedbackTarget(feedbackWidth, feedbackHeight);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->feedbackFBO);
+		glViewport(0, 0, this->feedbackWidth, this->feedbackHeight);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// Starts an asynchronous readback of the feedback buffer and restores the default framebuffer
+	void EndFeedback(GLsizei width, GLsizei height)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, this->feedbackPBO[this->frame % 2]);
+		glReadPixels(0, 0, this->feedbackWidth, this->feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, width, height);
+		this->feedbackFrames++;
+	}
+
+	// Consumes last frame's feedback, queues missing tiles for the loader and uploads the tiles it finished.
+	// True while the picture is still changing: tiles were uploaded, or some are still requested or loading and
+	// the cache has a slot to put them in. Tiles that failed to load are not requested again
+	bool Update()
+	{
+		std::set<GLuint> requested;
+		// Read the buffer written one frame ago, so the map does not wait for the GPU
+		if (this->feedbackFrames > 1)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, this->feedbackPBO[(this->frame + 1) % 2]);
+			const unsigned char* texels = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+			if (texels != NULL)
+			{
+				for (GLsizei i = 0; i < this->feedbackWidth * this->feedbackHeight; i++)
+				{
+					const unsigned char* texel = texels + i * 4;
+					if (texel[3] != 0 && texel[2] < this->MipCount)
+						requested.insert(makeKey(texel[2], texel[0], texel[1]));
+				}
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+
+		// Touch resident tiles and collect the missing ones, coarse mips first so the image sharpens progressively.
+		// With every slot taken by tiles in view nothing is requested, the loaded tiles would have nowhere to go
+		std::vector<GLuint> missing;
+		for (std::set<GLuint>::iterator it = requested.begin(); it != requested.end(); ++it)
+		{
+			std::map<GLuint, GLint>::iterator resident = this->resident.find(*it);
+			if (resident != this->resident.end())
+				this->slots[resident->second].LastUsed = this->frame;
+			else if (this->failed.count(*it) == 0)
+				missing.push_back(*it);
+		}
+		if (this->freeSlot() < 0)
+			missing.clear();
+		std::sort(missing.begin(), missing.end(), [](GLuint a, GLuint b) { return (a >> 16) > (b >> 16); });
+
+		std::vector<LoadedTile> finished;
+		bool pending, streaming;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			// Requests that are no longer visible are dropped instead of loaded late
+			this->requests.clear();
+			for (size_t i = 0; i < missing.size(); i++)
+				if (this->inFlight.count(missing[i]) == 0)
+					this->requests.push_back(missing[i]);
+			GLint uploads = std::min((GLint)this->loaded.size(), MAX_UPLOADS_PER_FRAME);
+			finished.assign(this->loaded.begin(), this->loaded.begin() + uploads);
+			this->loaded.erase(this->loaded.begin(), this->loaded.begin() + uploads);
+			for (size_t i = 0; i < finished.size(); i++)
+				this->inFlight.erase(finished[i].Key);
+			pending = !this->requests.empty();
+			streaming = pending || !this->inFlight.empty() || !this->loaded.empty();
+		}
+		if (pending)
+			this->wake.notify_one();
+
+		this->Uploaded = false;
+		for (size_t i = 0; i < finished.size(); i++)
+		{
+			if (finished[i].Pixels == NULL)
+			{
+				std::cout << "ERROR::VIRTUAL_TEXTURE::TILE_NOT_LOADED " << tilePath(this->prefix, finished[i].Key) << std::endl;
+				this->failed.insert(finished[i].Key);
+				continue;
+			}
+			GLint slot = this->resident.count(finished[i].Key) == 0 ? this->findSlot() : -1;
+			if (slot >= 0)
+			{
+				this->uploadTile(slot, finished[i].Key, finished[i].Pixels);
+				this->Uploaded = true;
+			}
+			SOIL_free_image_data(finished[i].Pixels);
+		}
+		if (this->Uploaded)
+			this->updatePageTable();
+		streaming = streaming && this->freeSlot() >= 0;
+		this->frame++;
+		return this->Uploaded || streaming;
+	}
+
+	// Sets the layout uniforms used by both the feedback and the shading pass
+	void SetUniforms(GLuint program, GLfloat lodBias = 0.0f)
+	{
+		glUniform1f(glGetUniformLocation(program, "vtVirtualSize"), (GLfloat)this->VirtualSize);
+		glUniform1f(glGetUniformLocation(program, "vtTileSize"), (GLfloat)this->TileSize);
+		glUniform1f(glGetUniformLocation(program, "vtBorder"), (GLfloat)this->Border);
+		glUniform1f(glGetUniformLocation(program, "vtMaxMip"), (GLfloat)(this->MipCount - 1));
+		glUniform1f(glGetUniformLocation(program, "vtCacheSize"), (GLfloat)(this->CacheTiles * this->slotSize()));
+		glUniform1f(glGetUniformLocation(program, "vtLodBias"), lodBias);
+	}
+
+	// Lod bias the feedback shader needs to request the mips the full resolution pass will sample
+	GLfloat FeedbackLodBias()
+	{
+		return -log2((GLfloat)FEEDBACK_SCALE);
+	}
+
+	// Binds the cache and the page table to the given texture units for the shading pass
+	void Bind(GLuint program, GLint cacheUnit, GLint pageTableUnit)
+	{
+		glActiveTexture(GL_TEXTURE0 + cacheUnit);
+		glBindTexture(GL_TEXTURE_2D, this->CacheTexture);
+		glActiveTexture(GL_TEXTURE0 + pageTableUnit);
+		glBindTexture(GL_TEXTURE_2D, this->PageTableTexture);
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(program, "vtCache"), cacheUnit);
+		glUniform1i(glGetUniformLocation(program, "vtPageTable"), pageTableUnit);
+		this->SetUniforms(program);
+	}
+
+	// Offline step: cuts an image into the tile set the runtime streams from. The whole source has to fit in
+	// system memory here, only the runtime is limited to the cache. Virtual size is the smallest power of two
+	// multiple of the tile size covering the source, mips are box filtered and borders wrap like GL_REPEAT.
+	static bool BuildTiles(const char* sourcePath, const std::string& prefix, GLint tileSize = 128, GLint border = 1)
+	{
+		// The border is copied from the neighbouring tiles, it has to leave most of a tile its own
+		if (tileSize <= 0 || border < 0 || border >= tileSize / 2)
+		{
+			std::cout << "ERROR::VIRTUAL_TEXTURE::INVALID_TILE_LAYOUT tile " << tileSize << ", border " << border << std::endl;
+			return false;
+		}
+		int width, height;
+		unsigned char* source = SOIL_load_image(sourcePath, &width, &height, 0, SOIL_LOAD_RGB);
+		if (source == NULL)
+		{
+			std::cout << "ERROR::VIRTUAL_TEXTURE::SOURCE_NOT_LOADED " << sourcePath << std::endl;
+			return false;
+		}
+		GLint size = tileSize;
+		while (size < std::max(width, height) && size / tileSize < 256)
+			size *= 2;
+
+		// Bilinear resample of the source to the square virtual size
+		std::vector<unsigned char> level(size * size * 3);
+		for (GLint y = 0; y < size; y++)
+			for (GLint x = 0; x < size; x++)
+			{
+				GLfloat u = (x + 0.5f) * width / size - 0.5f, v = (y + 0.5f) * height / size - 0.5f;
+				GLint x0 = std::max((GLint)floor(u), 0), y0 = std::max((GLint)floor(v), 0);
+				GLint x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+				GLfloat fx = std::max(u - x0, 0.0f), fy = std::max(v - y0, 0.0f);
+				for (GLint c = 0; c < 3; c++)
+				{
+					GLfloat top = source[(y0 * width + x0) * 3 + c] * (1 - fx) + source[(y0 * width + x1) * 3 + c] * fx;
+					GLfloat bottom = source[(y1 * width + x0) * 3 + c] * (1 - fx) + source[(y1 * width + x1) * 3 + c] * fx;
+					level[(y * size + x) * 3 + c] = (unsigned char)(top * (1 - fy) + bottom * fy + 0.5f);
+				}
+			}
+		SOIL_free_image_data(source);
+
+		GLint slot = tileSize + 2 * border, mipCount = 0;
+		std::vector<unsigned char> tile(slot * slot * 3);
+		for (GLint levelSize = size; levelSize >= tileSize; levelSize /= 2, mipCount++)
+		{
+			GLint pages = levelSize / tileSize;
+			for (GLint ty = 0; ty < pages; ty++)
+				for (GLint tx = 0; tx < pages; tx++)
+				{
+					for (GLint y = 0; y < slot; y++)
+						for (GLint x = 0; x < slot; x++)
+						{
+							GLint sx = (tx * tileSize + x - border + levelSize) % levelSize;
+							GLint sy = (ty * tileSize + y - border + levelSize) % levelSize;
+							for (GLint c = 0; c < 3; c++)
+								tile[(y * slot + x) * 3 + c] = level[(sy * levelSize + sx) * 3 + c];
+						}
+					if (!SOIL_save_image(tilePath(prefix, makeKey(mipCount, tx, ty)).c_str(), SOIL_SAVE_TYPE_TGA, slot, slot, 3, &tile[0]))
+					{
+						std::cout << "ERROR::VIRTUAL_TEXTURE::TILE_NOT_SAVED " << tilePath(prefix, makeKey(mipCount, tx, ty)) << std::endl;
+						return false;
+					}
+				}
+			// Box filter down to the next mip
+			GLint half = levelSize / 2;
+			for (GLint y = 0; y < half; y++)
+				for (GLint x = 0; x < half; x++)
+					for (GLint c = 0; c < 3; c++)
+					{
+						GLint sum = level[((2 * y) * levelSize + 2 * x) * 3 + c] + level[((2 * y) * levelSize + 2 * x + 1) * 3 + c]
+							+ level[((2 * y + 1) * levelSize + 2 * x) * 3 + c] + level[((2 * y + 1) * levelSize + 2 * x + 1) * 3 + c];
+						level[(y * half + x) * 3 + c] = (unsigned char)((sum + 2) / 4);
+					}
+		}
+
+		std::ofstream descriptor((prefix + ".vt").c_str());
+		descriptor << "GKOMVT " << size << " " << tileSize << " " << border << " " << mipCount << std::endl;
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		GLuint Key;
+		GLint LastUsed;
+		bool Used;
+		bool Pinned;
+		Slot() : Key(0), LastUsed(-1), Used(false), Pinned(false) {}
+	};
+	struct LoadedTile
+	{
+		GLuint Key;
+		unsigned char* Pixels;
+	};
+
+	std::string prefix;
+	bool valid;
+	// Cache bookkeeping, owned by the render thread
+	std::vector<Slot> slots;
+	std::map<GLuint, GLint> resident;
+	// Tiles the loader could not read
+	std::set<GLuint> failed;
+	std::vector<std::vector<unsigned char> > pageTable;
+	GLint frame;
+	GLint feedbackFrames;
+	// Loader thread state, guarded by mutex
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<GLuint> requests;
+	std::set<GLuint> inFlight;
+	std::deque<LoadedTile> loaded;
+	bool quit;
+	// Feedback target
+	GLuint feedbackFBO, feedbackDepth, feedbackColor;
+	GLuint feedbackPBO[2];
+	GLsizei feedbackWidth, feedbackHeight;
+
+	GLint pages()
+	{
+		return this->VirtualSize / this->TileSize;
+	}
+
+	GLint slotSize()
+	{
+		return this->TileSize + 2 * this->Border;
+	}
+
+	static GLuint makeKey(GLint mip, GLint x, GLint y)
+	{
+		return (mip << 16) | (y << 8) | x;
+	}
+
+	static std::string tilePath(const std::string& prefix, GLuint key)
+	{
+		std::stringstream path;
+		path << prefix << "_" << (key >> 16) << "_" << (key & 0xFF) << "_" << ((key >> 8) & 0xFF) << ".tga";
+		return path.str();
+	}
+
+	unsigned char* loadTile(GLuint key)
+	{
+		int width, height;
+		unsigned char* pixels = SOIL_load_image(tilePath(this->prefix, key).c_str(), &width, &height, 0, SOIL_LOAD_RGB);
+		if (pixels != NULL && (width != this->slotSize() || height != this->slotSize()))
+		{
+			SOIL_free_image_data(pixels);
+			pixels = NULL;
+		}
+		return pixels;
+	}
+
+	void loaderMain()
+	{
+		for (;;)
+		{
+			LoadedTile tile;
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->wake.wait(lock, [this] { return this->quit || !this->requests.empty(); });
+				if (this->quit)
+					return;
+				tile.Key = this->requests.front();
+				this->requests.pop_front();
+				this->inFlight.insert(tile.Key);
+			}
+			// Disk read and decode happen outside the lock
+			tile.Pixels = this->loadTile(tile.Key);
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->loaded.push_back(tile);
+		}
+	}
+
+	// Returns a free slot or the least recently used one that was not requested this or the last frame, -1 when
+	// there is none
+	GLint freeSlot()
+	{
+		GLint best = -1;
+		for (GLint i = 0; i < (GLint)this->slots.size(); i++)
+		{
+			if (!this->slots[i].Used)
+				return i;
+			if (this->slots[i].Pinned || this->slots[i].LastUsed >= this->frame - 1)
+				continue;
+			if (best < 0 || this->slots[i].LastUsed < this->slots[best].LastUsed)
+				best = i;
+		}
+		return best;
+	}
+
+	// Returns a free slot or evicts the least recently used one, see freeSlot
+	GLint findSlot()
+	{
+		GLint slot = this->freeSlot();
+		if (slot >= 0 && this->slots[slot].Used)
+			this->resident.erase(this->slots[slot].Key);
+		return slot;
+	}
+
+	void uploadTile(GLint slot, GLuint key, const unsigned char* pixels)
+	{
+		GLint size = this->slotSize();
+		glBindTexture(GL_TEXTURE_2D, this->CacheTexture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % this->CacheTiles) * size, (slot / this->CacheTiles) * size, size, size, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		this->slots[slot].Key = key;
+		this->slots[slot].Used = true;
+		this->slots[slot].LastUsed = this->frame;
+		this->resident[key] = slot;
+	}
+
+	// Rebuilds the indirection table: resident pages point at their slot, the others inherit their parent's entry
+	void updatePageTable()
+	{
+		glBindTexture(GL_TEXTURE_2D, this->PageTableTexture);
+		for (GLint mip = this->MipCount - 1; mip >= 0; mip--)
+		{
+			GLint pages = this->pages() >> mip;
+			std::vector<unsigned char>& level = this->pageTable[mip];
+			for (GLint y = 0; y < pages; y++)
+				for (GLint x = 0; x < pages; x++)
+				{
+					unsigned char* entry = &level[(y * pages + x) * 4];
+					std::map<GLuint, GLint>::iterator it = this->resident.find(makeKey(mip, x, y));
+					if (it != this->resident.end())
+					{
+						entry[0] = (unsigned char)(it->second % this->CacheTiles);
+						entry[1] = (unsigned char)(it->second / this->CacheTiles);
+						entry[2] = (unsigned char)mip;
+						entry[3] = 255;
+					}
+					else if (mip < this->MipCount - 1)
+					{
+						const unsigned char* parent = &this->pageTable[mip + 1][((y / 2) * (pages / 2) + x / 2) * 4];
+						std::copy(parent, parent + 4, entry);
+					}
+				}
+			glTexSubImage2D(GL_TEXTURE_2D, mip, 0, 0, pages, pages, GL_RGBA, GL_UNSIGNED_BYTE, &level[0]);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void createFeedbackTarget(GLsizei width, GLsizei height)
+	{
+		if (this->feedbackColor != 0)
+		{
+			glDeleteFramebuffers(1, &this->feedbackFBO);
+			glDeleteRenderbuffers(1, &this->feedbackDepth);
+			glDeleteTextures(1, &this->feedbackColor);
+			glDeleteBuffers(2, this->feedbackPBO);
+		}
+		this->feedbackWidth = width;
+		this->feedbackHeight = height;
+		this->feedbackFrames = 0;
+
+		glGenTextures(1, &this->feedbackColor);
+		glBindTexture(GL_TEXTURE_2D, this->feedbackColor);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glGenRenderbuffers(1, &this->feedbackDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->feedbackDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &this->feedbackFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->feedbackFBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->feedbackColor, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->feedbackDepth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::VIRTUAL_TEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		glGenBuffers(2, this->feedbackPBO);
+		for (GLint i = 0; i < 2; i++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, this->feedbackPBO[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+};
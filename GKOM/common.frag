@@ -0,0 +1,98 @@
+// Shared by every fragment shader: Shader.h inserts this file after the defines, before the shader's own source.
+// Parts that need uniforms are switched on by the same defines as in the shaders using them
+
+// COUNTERS (benchmark only, gkom.frag): instead of a color, write per fragment (texture fetches, lights tested,
+// lights shaded, math). Math tallies the arithmetic operators and built-in functions of the shading code, a vector
+// operation counting once
+#ifdef COUNTERS
+vec4 counters = vec4(0.0);
+#define COUNT(fetches, tested, shaded, math) counters += vec4(fetches, tested, shaded, math)
+#else
+#define COUNT(fetches, tested, shaded, math)
+#endif
+
+// Cube shadow maps of lights 0 .. shadowCount - 1 (distance / shadowFar), SHADOW_LIGHTS has to match ShadowMaps.h
+#ifdef SHADOWS
+#define SHADOW_LIGHTS 3
+#define SHADOW_BIAS 0.01
+uniform samplerCubeShadow shadowMaps[SHADOW_LIGHTS];
+uniform float shadowFar[SHADOW_LIGHTS];
+uniform int shadowCount;
+#endif
+
+// Virtual texture, replaces material.diffuse
+#ifdef VIRTUAL_TEXTURE
+uniform sampler2D vtCache;
+uniform sampler2D vtPageTable;
+uniform float vtVirtualSize;
+uniform float vtTileSize;
+uniform float vtBorder;
+uniform float vtMaxMip;
+uniform float vtCacheSize;
+#endif
+
+#ifdef SHADOWS
+// One lookup in a light's cube map
+float ShadowTest(samplerCubeShadow map, float far, vec3 toLight, float distance)
+{
+    COUNT(1, 0, 0, 3);
+    return texture(map, vec4(-toLight, (distance - SHADOW_BIAS) / far));
+}
+#endif
+
+// Fraction of the light reaching the fragment. Sampler arrays only take constant indices in GLSL 330, hence the chain
+float Shadow(int index, vec3 toLight, float distance)
+{
+#ifdef SHADOWS
+    if (index >= shadowCount)
+        return 1.0;
+    if (index == 0)
+        return ShadowTest(shadowMaps[0], shadowFar[0], toLight, distance);
+    if (index == 1)
+        return ShadowTest(shadowMaps[1], shadowFar[1], toLight, distance);
+    return ShadowTest(shadowMaps[2], shadowFar[2], toLight, distance);
+#else
+    return 1.0;
+#endif
+}
+
+// Material diffuse color at texCoords, from the virtual texture instead of diffuse with VIRTUAL_TEXTURE
+vec3 DiffuseColor(sampler2D diffuse, vec2 texCoords)
+{
+#ifndef VIRTUAL_TEXTURE
+    COUNT(1, 0, 0, 0);
+    return vec3(texture(diffuse, texCoords));
+#else
+    COUNT(2, 0, 0, 27);
+    // Mip from the derivatives of the virtual texel position, same formula as vt_feedback.frag
+    vec2 texel = texCoords * vtVirtualSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float mip = clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy)))), 0.0, vtMaxMip);
+    vec2 uv = fract(texCoords);
+    float pages = vtVirtualSize / vtTileSize;
+    // Page table entry: cache slot, mip of the tile actually resident (a coarser one while streaming)
+    vec4 entry = texelFetch(vtPageTable, ivec2(uv * pages) >> int(mip), int(mip)) * 255.0;
+    vec2 inTile = fract(uv * pages / exp2(entry.z));
+    vec2 cacheTexel = entry.xy * (vtTileSize + 2.0 * vtBorder) + vtBorder + inTile * vtTileSize;
+    return textureLod(vtCache, cacheTexel / vtCacheSize, 0.0).rgb;
+#endif
+}
+
+// G-buffer normals (DeferredRenderer.h), octahedral mapping: project onto |x|+|y|+|z| = 1 and fold the lower half
+// over the diagonals
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return (n.z >= 0.0 ? n.xy : folded) * 0.5 + 0.5;
+}
+
+vec3 DecodeNormal(vec2 encoded)
+{
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
@@ -0,0 +1,47 @@
+#version 330 core
+in vec2 TexCoords;
+
+out vec4 color;
+
+uniform sampler2D accumulation;
+uniform sampler2D depth;
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform vec3 clearColor;
+
+// Image based ambient, the same lookups as gkom.frag (ENVIRONMENT) for the G-buffer's surfaces
+uniform bool environmentLighting;
+uniform samplerCube environmentMap;
+uniform samplerCube irradianceMap;
+uniform float environmentLevels;
+uniform float environmentIntensity;
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+uniform vec3 viewPos;
+uniform float shininess;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float fragDepth = texelFetch(depth, pixel, 0).r;
+    vec4 clip = vec4(gl_FragCoord.xy / viewportSize * 2.0 - 1.0, fragDepth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 viewDir = normalize(viewPos - world.xyz / world.w);
+    // Nothing was drawn where depth is still cleared: the sky there, as skybox.frag draws it in the forward path,
+    // or the forward path's clear color without one
+    if (fragDepth == 1.0)
+    {
+        color = vec4(environmentLighting ? textureLod(environmentMap, -viewDir, 0.0).rgb : clearColor, 1.0);
+        return;
+    }
+    vec3 result = texelFetch(accumulation, pixel, 0).rgb;
+    if (environmentLighting)
+    {
+        vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+        vec3 normal = DecodeNormal(texelFetch(gNormal, pixel, 0).rg);
+        float lod = clamp(environmentLevels - 1.0 - 0.5 * log2(max(shininess, 1.0)), 0.0, environmentLevels - 1.0);
+        vec3 ambient = albedo.rgb * texture(irradianceMap, normal).rgb + albedo.a * textureLod(environmentMap, reflect(-viewDir, normal), lod).rgb;
+        result += ambient * environmentIntensity;
+    }
+    color = vec4(result, 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+
+// Must match gkom.vs bit for bit, the lighting pass tests its depth with GL_EQUAL against ours
+invariant gl_Position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+
+void main()
+{
+    gl_Position = projection * view *  model * vec4(position, 1.0f);
+}
@@ -0,0 +1,43 @@
+#version 330 core
+in vec2 TexCoords;
+
+out vec4 color;
+
+uniform sampler2D scene;
+uniform vec2 texelSize;
+
+// FXAA, the single pass console variant: the luma gradient of the 4 diagonal neighbours gives the edge direction,
+// the pixel is then blurred along it over a span that grows the flatter the gradient is
+const float FXAA_SPAN_MAX = 8.0;
+const float FXAA_REDUCE_MUL = 1.0 / 8.0;
+const float FXAA_REDUCE_MIN = 1.0 / 128.0;
+
+float Luma(vec3 rgb)
+{
+    return dot(rgb, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy * texelSize;
+    vec3 rgbM = texture(scene, uv).rgb;
+    float lumaNW = Luma(textureOffset(scene, uv, ivec2(-1, 1)).rgb);
+    float lumaNE = Luma(textureOffset(scene, uv, ivec2(1, 1)).rgb);
+    float lumaSW = Luma(textureOffset(scene, uv, ivec2(-1, -1)).rgb);
+    float lumaSE = Luma(textureOffset(scene, uv, ivec2(1, -1)).rgb);
+    float lumaM = Luma(rgbM);
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * FXAA_REDUCE_MUL, FXAA_REDUCE_MIN);
+    float scale = 1.0 / (min(abs(direction.x), abs(direction.y)) + reduce);
+    direction = clamp(direction * scale, vec2(-FXAA_SPAN_MAX), vec2(FXAA_SPAN_MAX)) * texelSize;
+
+    // Two taps close to the pixel, then two more at the ends of the span. The wider blur is used unless it
+    // reached past the neighbourhood's range, i.e. crossed another edge
+    vec3 rgbA = 0.5 * (texture(scene, uv + direction * (1.0 / 3.0 - 0.5)).rgb + texture(scene, uv + direction * (2.0 / 3.0 - 0.5)).rgb);
+    vec3 rgbB = rgbA * 0.5 + 0.25 * (texture(scene, uv - direction * 0.5).rgb + texture(scene, uv + direction * 0.5).rgb);
+    float lumaB = Luma(rgbB);
+    color = vec4(lumaB < lumaMin || lumaB > lumaMax ? rgbA : rgbB, 1.0);
+}
@@ -0,0 +1,38 @@
+#version 330 core
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+// G-buffer of the deferred path, see DeferredRenderer.h
+layout (location = 0) out vec4 gAlbedo;     // rgb albedo, a specular intensity
+layout (location = 1) out vec2 gNormal;     // octahedral normal in [0, 1]
+#ifdef MOTION_VECTORS
+in vec4 CurrentClip;
+in vec4 PreviousClip;
+layout (location = 2) out vec2 gMotion;     // screen motion since the last frame, as in gkom.frag
+#endif
+
+uniform Material material;
+
+// Variants (see ShaderPermutations.h): SPECULAR_MAP, VIRTUAL_TEXTURE, MOTION_VECTORS. DiffuseColor and EncodeNormal
+// come from common.frag
+
+void main()
+{
+#ifdef SPECULAR_MAP
+    vec3 specular = vec3(texture(material.specular, TexCoords));
+    gAlbedo = vec4(DiffuseColor(material.diffuse, TexCoords), dot(specular, vec3(0.299, 0.587, 0.114)));
+#else
+    gAlbedo = vec4(DiffuseColor(material.diffuse, TexCoords), 0.0);
+#endif
+    gNormal = EncodeNormal(normalize(Normal));
+#ifdef MOTION_VECTORS
+    gMotion = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
+#endif
+}
@@ -15,10 +15,34 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <math.h>
+#include <functional>
+#include <chrono>
 
 // Other includes
 #include "Shader.h"
+#include "ShaderPermutations.h"
 #include "Camera.h"
+#include "VirtualTexture.h"
+#include "JpegDecoder.h"
+#include "AssetPack.h"
+#include "Mesh.h"
+#include "GltfImporter.h"
+#include "Primitives.h"
+#include "ClusteredLights.h"
+#include "DeferredRenderer.h"
+#include "GpuTimer.h"
+#include "FragmentCounters.h"
+#include "ShadowMaps.h"
+#include "LightmapBaker.h"
+#include "IrradianceProbes.h"
+#include "EnvironmentMap.h"
+#include "Skybox.h"
+#include "DamageTracker.h"
+#include "TemporalUpsampler.h"
+#include "QualityGovernor.h"
+#include "AntiAliasing.h"
+#include "OcclusionCuller.h"
+#include "SoftwareOcclusion.h"
 
 using namespace std;
 
@@ -36,12 +60,59 @@ Camera  camera(glm::vec3(0.75f, 0.5f, -2.0f));
 GLfloat lastX = WIDTH / 2.0;
 GLfloat lastY = HEIGHT / 2.0;
 bool    keys[1024];
+// Toggled with P: lay down depth first so the lighting shader only runs for visible fragments
+bool    depthPrepass = true;
+// Toggled with L: a few hundred small lamps around the workshop on top of the three main lights
+bool    workshopLights = false;
+// Toggled with R: shade through the G-buffer and light volumes instead of the clustered forward pass
+bool    deferredShading = false;
+// Toggled with H: cube shadow maps for the three main lights
+bool    shadows = true;
+// Toggled with B: the floor and base read the three main lights from the baked lightmap instead of shading them
+bool    lightmaps = true;
+// Set when the window system lost the window's contents, the next frame is then drawn in full
+bool    windowRefreshed = false;
+// Toggled with T: shade at renderScale of the window's width and height and rebuild the full frame over time,
+// - and = step the scale
+bool    temporalUpsampling = false;
+GLfloat renderScale = 0.75f;
+// Toggled with G: lower the quality as far as needed to keep every frame within frameBudget milliseconds
+// ("GKOM --budget 16.6" starts with it on)
+bool    qualityGovernor = false;
+GLfloat frameBudget = 8.3f;
+// Cycled with M: none, MSAA, FXAA, SMAA lite ("GKOM --aa fxaa" starts with one)
+int     antiAliasingMode = AA_NONE;
+// Cycled with O: skip drawing the hammer and cylinder when their boxes are hidden behind the base or floor, tested
+// with hardware queries, on the CPU against a software Hi-Z, or not at all
+int     occlusionMode = OCCLUSION_QUERIES;
 
 // Is called whenever a key is pressed/released via GLFW
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		depthPrepass = !depthPrepass;
+	if (key == GLFW_KEY_L && action == GLFW_PRESS)
+		workshopLights = !workshopLights;
+	if (key == GLFW_KEY_R && action == GLFW_PRESS)
+		deferredShading = !deferredShading;
+	if (key == GLFW_KEY_H && action == GLFW_PRESS)
+		shadows = !shadows;
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+		lightmaps = !lightmaps;
+	if (key == GLFW_KEY_T && action == GLFW_PRESS)
+		temporalUpsampling = !temporalUpsampling;
+	if (key == GLFW_KEY_MINUS && action == GLFW_PRESS)
+		renderScale = std::max(renderScale - 0.125f, TEMPORAL_MIN_SCALE);
+	if (key == GLFW_KEY_EQUAL && action == GLFW_PRESS)
+		renderScale = std::min(renderScale + 0.125f, 1.0f);
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+		qualityGovernor = !qualityGovernor;
+	if (key == GLFW_KEY_M && action == GLFW_PRESS)
+		antiAliasingMode = (antiAliasingMode + 1) % AA_MODE_COUNT;
+	if (key == GLFW_KEY_O && action == GLFW_PRESS)
+		occlusionMode = (occlusionMode + 1) % OCCLUSION_MODE_COUNT;
 	if (key >= 0 && key < 1024)
 	{
 		if (action == GLFW_PRESS)
@@ -54,6 +125,14 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 }
 
 
+// A quality level's render scale below 1 runs the temporal upsampling at that scale
+void applyQuality(const QualityLevel& quality)
+{
+	temporalUpsampling = quality.RenderScale < 1.0f;
+	if (temporalUpsampling)
+		renderScale = quality.RenderScale;
+}
+
 void do_move()
 {
 	// Camera controls
@@ -67,6 +146,11 @@ void do_move()
 		camera.ProcessKeyboard(RIGHT, deltaTime);
 }
 
+void refresh_callback(GLFWwindow*)
+{
+	windowRefreshed = true;
+}
+
 bool firstMouse = true;
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
@@ -92,8 +176,17 @@ GLuint loadTexture(GLchar* path)
 	// Generate texture ID and load texture data 
 	GLuint textureID;
 	glGenTextures(1, &textureID);
-	int width, height;
-	unsigned char* image = SOIL_load_image(path, &width, &height, 0, SOIL_LOAD_RGB);
+	int width = 0, height = 0;
+	// Baseline JPEGs go through the SIMD/multithreaded decoder, everything else (and any failure) through SOIL
+	unsigned char* image = NULL;
+	AssetView file = AssetPack::Default().Read(path);
+	if (file.IsValid())
+	{
+		image = JpegDecoder::Decode(file.Data, file.Size, &width, &height);
+		if (image == NULL)
+			image = SOIL_load_image_from_memory(file.Data, (int)file.Size, &width, &height, 0, SOIL_LOAD_RGB);
+		AssetPack::Default().Release(path);
+	}
 	// Assign texture to ID
 	glBindTexture(GL_TEXTURE_2D, textureID);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
@@ -113,9 +206,73 @@ GLuint loadTexture(GLchar* path)
 
 }
 
+// Average color of a mipmapped texture: its 1x1 level
+glm::vec3 averageColor(GLuint texture)
+{
+	GLint width = 0, level = 0;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	do
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, ++level, GL_TEXTURE_WIDTH, &width);
+	while (width > 0);
+	GLfloat color[3] = { 1.0f, 1.0f, 1.0f };
+	glGetTexImage(GL_TEXTURE_2D, level - 1, GL_RGB, GL_FLOAT, color);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return glm::vec3(color[0], color[1], color[2]);
+}
+
+// Scatters small colored lamps around the scene, deterministic so every run looks the same
+void addWorkshopLights(ClusteredLights& lights, int count)
+{
+	unsigned int seed = 12345;
+	for (int i = 0; i < count; i++)
+	{
+		GLfloat random[6];
+		for (int k = 0; k < 6; k++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			random[k] = (seed >> 8) / 16777216.0f;
+		}
+		glm::vec3 position(-1.9f + 3.8f * random[0], 0.05f + 1.85f * random[1], -1.9f + 3.8f * random[2]);
+		glm::vec3 color = glm::vec3(random[3], random[4], random[5]) * 0.3f;
+		lights.Lights.push_back(PointLight(position, glm::vec3(0.0f), color, color, 1.0f, 4.0f, 40.0f));
+	}
+}
+
 // The MAIN function, from here we start the application and run the game loop
-int main()
+int main(int argc, char** argv)
 {
+	// Offline tool: cut a large image into virtual texture tiles, e.g. "GKOM --build-vt scan.jpg niebo_vt 128"
+	if (argc >= 4 && string(argv[1]) == "--build-vt")
+		return VirtualTexture::BuildTiles(argv[2], argv[3], argc >= 5 ? atoi(argv[4]) : 128) ? 0 : -1;
+	// Offline tool: pack assets into one file, e.g. "GKOM --build-pak gkom.pak gkom.vs gkom.frag niebo.jpg drewno.jpg"
+	if (argc >= 4 && string(argv[1]) == "--build-pak")
+		return AssetPack::Build(argv[2], vector<string>(argv + 3, argv + argc)) ? 0 : -1;
+	// Offline tool: convert a text vertex list to the binary mesh format, e.g. "GKOM --convert-mesh meshes/hammer.verts meshes/hammer.mesh"
+	if (argc >= 4 && string(argv[1]) == "--convert-mesh")
+		return MeshData::Convert(argv[2], argv[3]) ? 0 : -1;
+	// Offline tool: import and optimize glTF meshes, e.g. "GKOM --import-gltf workshop.glb meshes/workshop"
+	if (argc >= 4 && string(argv[1]) == "--import-gltf")
+		return GltfImporter::Import(argv[2], argv[3]) ? 0 : -1;
+	// Deployment settings, e.g. "GKOM --budget 16.6 --aa fxaa" on a 60 Hz kiosk: the frame time budget in milliseconds
+	// for the quality governor, and the anti-aliasing mode (none, msaa, fxaa or smaa)
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (string(argv[i]) == "--budget")
+		{
+			// A budget that is not a positive number of milliseconds is ignored, the governor then stays off
+			GLfloat budget = (GLfloat)atof(argv[i + 1]);
+			if (budget > 0.0f)
+			{
+				qualityGovernor = true;
+				frameBudget = budget;
+			}
+			else
+				cout << "ERROR::GOVERNOR::INVALID_BUDGET " << argv[i + 1] << endl;
+		}
+		else if (string(argv[i]) == "--aa")
+			antiAliasingMode = AntiAliasing::Parse(argv[i + 1]);
+	}
+
 	// Init GLFW
 	glfwInit();
 	if (glfwInit() != GL_TRUE)
@@ -138,6 +295,7 @@ int main()
 	// Set the required callback functions
 	glfwSetKeyCallback(window, key_callback);
 	glfwSetCursorPosCallback(window, mouse_callback);
+	glfwSetWindowRefreshCallback(window, refresh_callback);
 
 	
 	// GLFW Options
@@ -150,606 +308,149 @@ int main()
 
 	// Initialize GLEW to setup the OpenGL Function pointers
 	glewInit();
+	// Let the driver compile on as many threads as it likes, shader reloads are then built in the background
+	if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
 
 	// Define the viewport dimensions
 	glViewport(0, 0, WIDTH, HEIGHT);
 
 	// OpenGL options
 	glEnable(GL_DEPTH_TEST);
+	// Meshes are wound counter-clockwise towards their normals, so hidden sides can be skipped
+	glEnable(GL_CULL_FACE);
 
 
-	// Build and compile our shader program
-	Shader gkomShader("gkom.vs", "gkom.frag");
-	
+	// Deployments ship everything in gkom.pak, whatever it does not contain is read from loose files
+	AssetPack::Default().Open("gkom.pak");
 
-GLfloat base_verticies[] = {
-	//base
-	//back
-	-0.4, 0.05, -0.2, 0, 0, -1, 1, 1,
-	0.4, 0.05, -0.2, 0, 0, -1, 0, 1,
-	0.4, 0, -0.2, 0, 0, -1, 0, 0,
-
-	0.4, 0, -0.2, 0, 0, -1, 0, 0,
-	-0.4, 0, -0.2, 0, 0, -1, 1, 0,
-	-0.4, 0.05, -0.2, 0, 0, -1, 1, 1,
-
-	//up
-	0.4, 0.05, -0.2, 0, 1, 0, 0, 0,
-	0.4, 0.05, 0.2, 0, 1, 0, 0, 1, 
-	-0.4, 0.05, 0.2, 0, 1, 0, 1, 1,
-
-	-0.4, 0.05, 0.2, 0, 1, 0, 1, 1,
-	-0.4, 0.05, -0.2, 0, 1, 0, 1, 0,
-	0.4, 0.05, -0.2, 0, 1, 0, 0, 0,
-
-	//front
-	-0.4, 0.05, 0.2, 0, 0, 1, 1, 1,
-	0.4, 0.05, 0.2, 0, 0, 1, 0, 1,
-	0.4, 0, 0.2, 0, 0, 1, 0, 0,
-
-	0.4, 0, 0.2, 0, 0, 1, 0, 0,
-	-0.4, 0, 0.2, 0, 0, 1, 1, 0,
-	-0.4, 0.05, 0.2, 0, 0, 1, 1, 1,
-
-	//right
-	-0.4, 0.05, -0.2, -1, 0, 0, 0, 1,
-	-0.4, 0.05, 0.2, -1, 0, 0, 1, 1,
-	-0.4, 0, 0.2, -1, 0, 0, 1, 0,
-
-	-0.4, 0, 0.2, -1, 0, 0, 1, 0,
-	-0.4, 0, -0.2, -1, 0, 0, 0, 0,
-	-0.4, 0.05, -0.2, -1, 0, 0, 0, 1,
-
-	//left
-	0.4, 0.05, -0.2, 1, 0, 0, 0, 1,
-	0.4, 0.05, 0.2, 1, 0, 0, 1, 1,
-	0.4, 0, 0.2, 1, 0, 0, 1, 0,
-
-	0.4, 0, 0.2, 1, 0, 0, 1, 0,
-	0.4, 0, -0.2, 1, 0, 0, 0, 0,
-	0.4, 0.05, -0.2, 1, 0, 0, 0, 1,
-
-	//yellow
-	//back
-	-0.35, 0.05, -0.1, 0, 0, -1, 0, 0, 
-	-0.35, 0.45, -0.1, 0, 0, -1, 0, 1,
-	-0.25, 0.45, -0.1, 0, 0, -1, 1, 1,
-
-	-0.25, 0.45, -0.1, 0, 0, -1, 1, 1,
-	-0.25, 0.05, -0.1, 0, 0, -1, 1, 0,
-	-0.35, 0.05, -0.1, 0, 0, -1, 0, 0,
-
-	//front
-	-0.35, 0.05, 0.1, 0, 0, 1, 0, 0,
-	-0.35, 0.45, 0.1, 0, 0, 1, 0, 1,
-	-0.25, 0.45, 0.1, 0, 0, 1, 1, 1,
-
-	-0.25, 0.45, 0.1, 0, 0, 1, 1, 1,
-	-0.25, 0.05, 0.1, 0, 0, 1, 1, 0,
-	-0.35, 0.05, 0.1, 0, 0, 1, 0, 0,
-
-	//right
-	-0.35, 0.45, -0.1, -1, 0, 0, 0, 1, 
-	-0.35, 0.45, 0.1, -1, 0, 0, 1, 1,
-	-0.35, 0.05, 0.1, -1, 0, 0, 1, 0,
-
-	-0.35, 0.05, 0.1, -1, 0, 0, 1, 0,
-	-0.35, 0.05, -0.1, -1, 0, 0, 0, 0,
-	-0.35, 0.45, -0.1, -1, 0, 0, 0, 1,
-
-	//left
-	-0.25, 0.45, -0.1, 1, 0, 0, 0, 1,
-	-0.25, 0.45, 0.1, 1, 0, 0, 1, 1,
-	-0.25, 0.05, 0.1, 1, 0, 0, 1, 0,
-
-	-0.25, 0.05, 0.1, 1, 0, 0, 1, 0,
-	-0.25, 0.05, -0.1, 1, 0, 0, 0, 0,
-	-0.25, 0.45, -0.1, 1, 0, 0, 0, 1,
-
-	//up
-	-0.35, 0.45, -0.1, 0, 1, 0, 0, 0, 
-	-0.35, 0.45, 0.1, 0, 1, 0, 0, 1, 
-	-0.25, 0.45, 0.1, 0, 1, 0, 1, 1,
-
-	-0.25, 0.45, 0.1, 0, 1, 0, 1, 1,
-	-0.25, 0.45, -0.1, 0, 1, 0, 1, 0, 
-	-0.35, 0.45, -0.1, 0, 1, 0, 0, 0,
-
-
-	//prostopadl pomar
-	//back
-	0.25, 0.05, -0.03, 0, 0, -1, 0, 0,
-	0.25, 0.115, -0.03, 0, 0, -1, 0, 1,
-	0.29, 0.115, -0.03, 0, 0, -1, 1, 1,
-
-	0.29, 0.115, -0.03, 0, 0, -1, 1, 1,
-	0.29, 0.05, -0.03, 0, 0, -1, 1, 0,
-	0.25, 0.05, -0.03, 0, 0, -1, 0, 0,
-
-	//front
-	0.25, 0.05, 0.03, 0, 0, 1, 0, 0,
-	0.25, 0.115, 0.03, 0, 0, 1, 0, 1,
-	0.29, 0.115, 0.03, 0, 0, 1, 1, 1,
-
-	0.29, 0.115, 0.03, 0, 0, 1, 1, 1,
-	0.29, 0.05, 0.03, 0, 0, 1, 1, 0,
-	0.25, 0.05, 0.03, 0, 0, 1, 0, 0,
-
-	//left
-	0.29, 0.05, -0.03, 1, 0, 0, 0, 0,
-	0.29, 0.115, -0.03, 1, 0, 0, 0, 1,
-	0.29, 0.115, 0.03, 1, 0, 0, 1, 1,
-
-	0.29, 0.115, 0.03, 1, 0, 0, 1, 1,
-	0.29, 0.05, 0.03, 1, 0, 0, 1, 0,
-	0.29, 0.05, -0.03, 1, 0, 0, 0, 0,
-
-	//right
-	0.25, 0.05, -0.03, -1, 0, 0, 0, 0,
-	0.25, 0.115, -0.03, -1, 0, 0, 0, 1,
-	0.25, 0.115, 0.03, -1, 0, 0, 1, 1,
-
-	0.25, 0.115, 0.03, -1, 0, 0, 1, 1,
-	0.25, 0.05, 0.03, -1, 0, 0, 1, 0,
-	0.25, 0.05, -0.03, -1, 0, 0, 0, 0,
-
-	//up
-	0.25, 0.115, -0.03, 0, 1, 0, 0, 0,
-	0.25, 0.115, 0.03, 0, 1, 0, 0, 1,
-	0.29, 0.115, 0.03, 0, 1, 0, 1, 1,
-
-	0.29, 0.115, 0.03, 0, 1, 0, 1, 1,
-	0.29, 0.115, -0.03, 0, 1, 0, 1, 0,
-	0.25, 0.115, -0.03, 0, 1, 0, 0, 0,
-
-};
-
-	GLfloat hammer_verticies[] = {
-		// Positions        // Normals   // Texture Coords
-		
-		//pink
-		//back
-		-0.25, 0.35, -0.05, 0, 0, -1, 0, 0,
-		-0.25, 0.4, -0.05, 0, 0, -1, 0, 1,
-		0.2, 0.4, -0.05, 0, 0, -1, 1, 1,
-
-		0.2, 0.4, -0.05, 0, 0, -1, 1, 1,
-		0.2, 0.35, -0.05, 0, 0, -1, 1, 0,
-		-0.25, 0.35, -0.05, 0, 0, -1, 0, 0,
-
-		//front
-		-0.25, 0.35, 0.05, 0, 0, 1, 0, 0,
-		-0.25, 0.4, 0.05, 0, 0, 1, 0, 1,
-		0.2, 0.4, 0.05, 0, 0, 1, 1, 1,
-
-		0.2, 0.4, 0.05, 0, 0, 1, 1, 1,
-		0.2, 0.35, 0.05, 0, 0, 1, 1, 0,
-		-0.25, 0.35, 0.05, 0, 0, 1, 0, 0,
-
-		//up
-		-0.25, 0.4, -0.05, 0, 1, 0, 0, 0,
-		-0.25, 0.4, 0.05, 0, 1, 0, 0, 1,
-		0.2, 0.4, 0.05, 0, 1, 0, 1, 1,
-
-		0.2, 0.4, 0.05, 0, 1, 0, 1, 1,
-		0.2, 0.4, -0.05, 0, 1, 0, 1, 0,
-		-0.25, 0.4, -0.05, 0, 1, 0, 0, 0,
-
-		//down
-		-0.25, 0.35, -0.05, 0, -1, 0, 0, 0,
-		-0.25, 0.35, 0.05, 0, -1, 0, 0, 1,
-		0.2, 0.35, 0.05, 0, -1, 0, 1, 1,
-
-		0.2, 0.35, 0.05, 0, -1, 0, 1, 1,
-		0.2, 0.35, -0.05, 0, -1, 0, 1, 0,
-		-0.25, 0.35, -0.05, 0, -1, 0, 0, 0,
-
-
-		//hammer
-		//back
-		0.2, 0.3, -0.1, 0, 0, -1, 0, 0,
-		0.2, 0.45, -0.1, 0, 0, -1, 0, 1,
-		0.35, 0.45, -0.1, 0, 0, -1, 1, 1,
-
-		0.35, 0.45, -0.1, 0, 0, -1, 1, 1,
-		0.35, 0.3, -0.1, 0, 0, -1, 1, 0,
-		0.2, 0.3, -0.1, 0, 0, -1, 0, 0,
-
-		//front
-		0.2, 0.3, 0.1, 0, 0, 1, 0, 0,
-		0.2, 0.45, 0.1, 0, 0, 1, 0, 1,
-		0.35, 0.45, 0.1, 0, 0, 1, 1, 1,
-
-		0.35, 0.45, 0.1, 0, 0, 1, 1, 1,
-		0.35, 0.3, 0.1, 0, 0, 1, 1, 0,
-		0.2, 0.3, 0.1, 0, 0, 1, 0, 0,
-
-		//left
-		0.35, 0.3, -0.1, 1, 0, 0, 0, 0,
-		0.35, 0.45, -0.1, 1, 0, 0, 0, 1,
-		0.35, 0.45, 0.1, 1, 0, 0, 1, 1,
-
-		0.35, 0.45, 0.1, 1, 0, 0, 1, 1,
-		0.35, 0.3, 0.1, 1, 0, 0, 1, 0,
-		0.35, 0.3, -0.1, 1, 0, 0, 0, 0,
-
-		//right
-		0.2, 0.3, -0.1, -1, 0, 0, 0, 0,
-		0.2, 0.45, -0.1, -1, 0, 0, 0, 1,
-		0.2, 0.45, 0.1, -1, 0, 0, 1, 1,
-
-		0.2, 0.45, 0.1, -1, 0, 0, 1, 1,
-		0.2, 0.3, 0.1, -1, 0, 0, 1, 0,
-		0.2, 0.3, -0.1, -1, 0, 0, 0, 0,
-
-		//up
-		0.2, 0.45, -0.1, 0, 1, 0, 0, 0,
-		0.2, 0.45, 0.1, 0, 1, 0, 0, 1,
-		0.35, 0.45, 0.1, 0, 1, 0, 1, 1,
-
-		0.35, 0.45, 0.1, 0, 1, 0, 1, 1,
-		0.35, 0.45, -0.1, 0, 1, 0, 1, 0,
-		0.2, 0.45, -0.1, 0, 1, 0, 0, 0,
-
-		//down
-		0.2, 0.3, -0.1, 0, -1, 0, 0, 0,
-		0.2, 0.3, 0.1, 0, -1, 0, 0, 1,
-		0.35, 0.3, 0.1, 0, -1, 0, 1, 1,
-
-		0.35, 0.3, 0.1, 0, -1, 0, 1, 1,
-		0.35, 0.3, -0.1, 0, -1, 0, 1, 0,
-		0.2, 0.3, -0.1, 0, -1, 0, 0, 0,
-
-
-
-		//maly prostopadl
-		//back
-		0.265, 0.13, -0.11, 0, 0, -1, 0, 0,
-		0.265, 0.33, -0.11, 0, 0, -1, 0, 1,
-		0.275, 0.33, -0.11, 0, 0, -1, 1, 1,
-
-		0.275, 0.33, -0.11, 0, 0, -1, 1, 1,
-		0.275, 0.13, -0.11, 0, 0, -1, 1, 0,
-		0.265, 0.13, -0.11, 0, 0, -1, 0, 0,
-
-		//front
-		0.265, 0.13, -0.1, 0, 0, 1, 0, 0,
-		0.265, 0.33, -0.1, 0, 0, 1, 0, 1,
-		0.275, 0.33, -0.1, 0, 0, 1, 1, 1,
-
-		0.275, 0.33, -0.1, 0, 0, 1, 1, 1,
-		0.275, 0.13, -0.1, 0, 0, 1, 1, 0,
-		0.265, 0.13, -0.1, 0, 0, 1, 0, 0,
-
-		//left
-		0.275, 0.13, -0.11, 1, 0, 0, 0, 0,
-		0.275, 0.33, -0.11, 1, 0, 0, 0, 1,
-		0.275, 0.33, -0.1, 1, 0, 0, 1, 1,
-
-		0.275, 0.33, -0.1, 1, 0, 0, 1, 1,
-		0.275, 0.13, -0.1, 1, 0, 0, 1, 0,
-		0.275, 0.13, -0.11, 1, 0, 0, 0, 0,
-
-		//right
-		0.265, 0.13, -0.11, -1, 0, 0, 0, 0,
-		0.265, 0.33, -0.11, -1, 0, 0, 0, 1,
-		0.265, 0.33, -0.1, -1, 0, 0, 1, 1,
-
-		0.265, 0.33, -0.1, -1, 0, 0, 1, 1,
-		0.265, 0.13, -0.1, -1, 0, 0, 1, 0,
-		0.265, 0.13, -0.11, -1, 0, 0, 0, 0,
-
-		//up
-		0.265, 0.33, -0.11, 0, 1, 0, 0, 0,
-		0.265, 0.33, -0.1, 0, 1, 0, 0, 1,
-		0.275, 0.33, -0.1, 0, 1, 0, 1, 1,
-
-		0.275, 0.33, -0.1, 0, 1, 0, 1, 1,
-		0.275, 0.33, -0.11, 0, 1, 0, 1, 0,
-		0.265, 0.33, -0.11, 0, 1, 0, 0, 0,
-
-		//down
-		0.265, 0.13, -0.11, 0, -1, 0, 0, 0,
-		0.265, 0.13, -0.1, 0, -1, 0, 0, 1,
-		0.275, 0.13, -0.1, 0, -1, 0, 1, 1,
-
-		0.275, 0.13, -0.1, 0, -1, 0, 1, 1,
-		0.275, 0.13, -0.11, 0, -1, 0, 1, 0,
-		0.265, 0.13, -0.11, 0, -1, 0, 0, 0,
-	};
-
-	// Set up cylinder points
-	GLfloat cylinder_vertices[] = {
-		// Positions        // Normals   // Texture Coords
-		//cylinder
-	//back
-	//1
-	0.245, 0.15, -0.1, 0, 0, -1, 0, 0,
-	0.25, 0.185, -0.1, 0, 0, -1, 0, 1,
-	0.27, 0.15, -0.1, 0, 0, -1, 1, 1,
-
-	0.27, 0.15, -0.1, 0, 0, -1, 1, 1,
-	0.25, 0.115, -0.1, 0, 0, -1, 1, 0,
-	0.245, 0.15, -0.1, 0, 0, -1, 0, 0,
-
-	//2
-	0.25, 0.185, -0.1, 0, 0, -1, 0, 0,
-	0.27, 0.2, -0.1, 0, 0, -1, 0, 1,
-	0.27, 0.15, -0.1, 0, 0, -1, 1, 0,
-
-	0.27, 0.15, -0.1, 0, 0, -1, 1, 0,
-	0.29, 0.185, -0.1, 0, 0, -1, 1, 1,
-	0.27, 0.2, -0.1, 0, 0, -1, 0, 1,
-
-	//3 (copy1)
-	0.295, 0.15, -0.1, 0, 0, -1, 0, 0,
-	0.29, 0.185, -0.1, 0, 0, -1, 0, 1,
-	0.27, 0.15, -0.1, 0, 0, -1, 1, 1,
-
-	0.27, 0.15, -0.1, 0, 0, -1, 1, 1,
-	0.29, 0.115, -0.1, 0, 0, -1, 1, 0,
-	0.295, 0.15, -0.1, 0, 0, -1, 0, 0,
-
-	//4 (copy 2)
-	0.25, 0.115, -0.1, 0, 0, -1, 0, 0,
-	0.27, 0.1, -0.1, 0, 0, -1, 0, 1,
-	0.27, 0.15, -0.1, 0, 0, -1, 1, 0,
-
-	0.27, 0.15, -0.1, 0, 0, -1, 1, 0,
-	0.29, 0.115, -0.1, 0, 0, -1, 1, 1,
-	0.27, 0.1, -0.1, 0, 0, -1, 0, 1,
-
-	//front (copy back change z)
-	//1
-	0.245, 0.15, 0.1, 0, 0, 1, 0, 0,
-	0.25, 0.185, 0.1, 0, 0, 1, 0, 1,
-	0.27, 0.15, 0.1, 0, 0, 1, 1, 1,
-
-	0.27, 0.15, 0.1, 0, 0, 1, 1, 1,
-	0.25, 0.115, 0.1, 0, 0, 1, 1, 0,
-	0.245, 0.15, 0.1, 0, 0, 1, 0, 0,
-
-	//2
-	0.25, 0.185, 0.1, 0, 0, 1, 0, 0,
-	0.27, 0.2, 0.1, 0, 0, 1, 0, 1,
-	0.27, 0.15, 0.1, 0, 0, 1, 1, 0,
-
-	0.27, 0.15, 0.1, 0, 0, 1, 1, 0,
-	0.29, 0.185, 0.1, 0, 0, 1, 1, 1,
-	0.27, 0.2, 0.1, 0, 0, 1, 0, 1,
-
-	//3 (copy1)
-	0.295, 0.15, 0.1, 0, 0, 1, 0, 0,
-	0.29, 0.185, 0.1, 0, 0, 1, 0, 1,
-	0.27, 0.15, 0.1, 0, 0, 1, 1, 1,
-
-	0.27, 0.15, 0.1, 0, 0, 1, 1, 1,
-	0.29, 0.115, 0.1, 0, 0, 1, 1, 0,
-	0.295, 0.15, 0.1, 0, 0, 1, 0, 0,
-
-	//4 (copy 2)
-	0.25, 0.115, 0.1, 0, 0, 1, 0, 0,
-	0.27, 0.1, 0.1, 0, 0, 1, 0, 1,
-	0.27, 0.15, 0.1, 0, 0, 1, 1, 0,
-
-	0.27, 0.15, 0.1, 0, 0, 1, 1, 0,
-	0.29, 0.115, 0.1, 0, 0, 1, 1, 1,
-	0.27, 0.1, 0.1, 0, 0, 1, 0, 1,
-
-	//cylinder prostopadl
-	//1
-	0.245, 0.15, -0.1, -1, 0, 0, 0, 0,
-	0.25, 0.185, -0.1, -1, 0, 0, 0, 1,
-	0.25, 0.185, 0.1, -1, 0, 0, 1, 1,
-
-	0.25, 0.185, 0.1, -1, 0, 0, 1, 1,
-	0.245, 0.15, 0.1, -1, 0, 0, 1, 0,
-	0.245, 0.15, -0.1, -1, 0, 0, 0, 0,
-
-	//2
-	0.25, 0.185, -0.1, 0, 1, 0, 0, 0,
-	0.27, 0.2, -0.1, 0, 1, 0, 0, 1,
-	0.27, 0.2, 0.1, 0, 1, 0, 1, 1,
-
-	0.27, 0.2, 0.1, 0, 1, 0, 1, 1,
-	0.25, 0.185, 0.1, 0, 1, 0, 1, 0,
-	0.25, 0.185, -0.1, 0, 1, 0, 0, 0,
-
-	//3
-	0.29, 0.185, -0.1, 0, 1, 0, 0, 0,
-	0.27, 0.2, -0.1, 0, 1, 0, 0, 1,
-	0.27, 0.2, 0.1, 0, 1, 0, 1, 1,
-
-	0.27, 0.2, 0.1, 0, 1, 0, 1, 1,
-	0.29, 0.185, 0.1, 0, 1, 0, 1, 0,
-	0.29, 0.185, -0.1, 0, 1, 0, 0, 0,
-
-	//4
-	0.295, 0.15, -0.1, 1, 0, 0, 0, 0,
-	0.29, 0.185, -0.1, 1, 0, 0, 0, 1,
-	0.29, 0.185, 0.1, 1, 0, 0, 1, 1,
-
-	0.29, 0.185, 0.1, 1, 0, 0, 1, 1,
-	0.295, 0.15, 0.1, 1, 0, 0, 1, 0,
-	0.295, 0.15, -0.1, 1, 0, 0, 0, 0,
-
-	//5
-	0.295, 0.15, -0.1, 1, 0, 0, 0, 0,
-	0.29, 0.115, -0.1, 1, 0, 0, 0, 1,
-	0.29, 0.115, 0.1, 1, 0, 0, 1, 1,
-
-	0.29, 0.115, 0.1, 1, 0, 0, 1, 1,
-	0.295, 0.15, 0.1, 1, 0, 0, 1, 0,
-	0.295, 0.15, -0.1, 1, 0, 0, 0, 0,
-
-	//6
-	0.29, 0.115, -0.1, 0, -1, 0, 0, 0,
-	0.27, 0.1, -0.1, 0, -1, 0, 0, 1,
-	0.27, 0.1, 0.1, 0, -1, 0, 1, 1,
-
-	0.27, 0.1, 0.1, 0, -1, 0, 1, 1,
-	0.29, 0.115, 0.1, 0, -1, 0, 1, 0,
-	0.29, 0.115, -0.1, 0, -1, 0, 0, 0,
-
-	//7
-	0.25, 0.115, -0.1, 0, -1, 0, 0, 0,
-	0.27, 0.1, -0.1, 0, -1, 0, 0, 1,
-	0.27, 0.1, 0.1, 0, -1, 0, 1, 1,
-
-	0.27, 0.1, 0.1, 0, -1, 0, 1, 1,
-	0.25, 0.115, 0.1, 0, -1, 0, 1, 0,
-	0.25, 0.115, -0.1, 0, -1, 0, 0, 0,
-
-	//8
-	0.245, 0.15, -0.1, -1, 0, 0, 0, 0,
-	0.25, 0.115, -0.1, -1, 0, 0, 0, 1,
-	0.25, 0.115, 0.1, -1, 0, 0, 1, 1,
-
-	0.25, 0.115, 0.1, -1, 0, 0, 1, 1,
-	0.245, 0.15, 0.1, -1, 0, 0, 1, 0,
-	0.245, 0.15, -0.1, -1, 0, 0, 0, 0,
-	};
-
-
-	// Positions of the point lights
-	glm::vec3 pointLightPositions[] = {
-		glm::vec3(1.95f, 1.0f, 0.0f), //left
-		glm::vec3(0.0f, 2.0f, 0.0f),  //up
-		glm::vec3(0.0f, 0.05f, -1.35f), //back
-	};
-
-	GLfloat planeVertices[] = {
-		// Positions   //Normals   // Texture Coords
-		//down
-		1, 0, 1, 0, 1, 0, 1, 0,
-		-1, 0, 1, 0, 1, 0, 0, 0,
-		-1, 0, -1, 0, 1, 0, 0, 1,
-
-		1, 0, 1, 0, 1, 0, 1, 0,
-		-1, 0, -1, 0, 1, 0, 0, 1,
-		1, 0, -1, 0, 1, 0, 1, 1,
-		
-		//up
-		1, 1, 1, 0, -1, 0, 1, 0,
-		-1, 1, 1, 0, -1, 0, 0, 0,
-		-1, 1, -1, 0, -1, 0, 0, 1,
-
-		1, 1, 1, 0, -1, 0, 1, 0,
-		-1, 1, -1, 0, -1, 0, 0, 1,
-		1, 1, -1, 0, -1, 0, 1, 1,
-
-		//left
-		1, 0, -1, -1, 0, 0, 1, 0,
-		1, 0, 1, -1, 0, 0, 0, 0,
-		1, 1, -1, -1, 0, 0, 1, 1,
-
-		1, 1, -1, -1, 0, 0, 1, 1,
-		1, 1, 1, -1, 0, 0, 0, 1,
-		1, 0, 1, -1, 0, 0, 0, 0,
-
-		//front
-		1, 0, 1, 0, 0, -1, 1, 0,
-		-1, 0, 1, 0, 0, -1, 0, 0,
-		-1, 1, 1, 0, 0, -1, 0, 1,
-
-		1, 1, 1, 0, 0, -1, 1, 1,
-		1, 0, 1, 0, 0, -1, 1, 0,
-		-1, 1, 1, 0, 0, -1, 0, 1,
-
-		//right
-		-1, 1, 1, 1, 0, 0, 1, 1,
-		-1, 1, -1, 1, 0, 0, 0, 1,
-		-1, 0, 1, 1, 0, 0, 1, 0,
-
-		-1, 0, 1, 1, 0, 0, 1, 0,
-		-1, 1, -1, 1, 0, 0, 0, 1,
-		-1, 0, -1, 1, 0, 0, 0, 0,
-
-		//back
-		-1, 0, -1, 0, 0, 1, 0, 0,
-		1, 0, -1, 0, 0, 1, 1, 0,
-		-1, 1, -1, 0, 0, 1, 0, 1,
-		-1, 1, -1, 0, 0, 1, 0, 1,
-		1, 1, -1, 0, 0, 1, 1, 1,
-		1, 0, -1, 0, 0, 1, 1, 0,
-
-
-	};
-
-	// First, set the VBO
-	GLuint VBO;
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	
-
-	// Setup plane VAO
-	GLuint planeVAO, planeVBO;
-	glGenVertexArrays(1, &planeVAO);
-	glGenBuffers(1, &planeVBO);
-	glBindVertexArray(planeVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-	glBindVertexArray(0);
-
-	// Setup cylinder VAO
-	GLuint cylinderVAO, cylinderVBO;
-	glGenVertexArrays(1, &cylinderVAO);
-	glGenBuffers(1, &cylinderVBO);
-	glBindVertexArray(cylinderVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, cylinderVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cylinder_vertices), &cylinder_vertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-	glBindVertexArray(0);
-
-	// Setup hammer VAO
-	GLuint hammerVAO, hammerVBO;
-	glGenVertexArrays(1, &hammerVAO);
-	glGenBuffers(1, &hammerVBO);
-	glBindVertexArray(hammerVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, hammerVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(hammer_verticies), &hammer_verticies, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-	glBindVertexArray(0);
-
-	// Setup base VAO
-	GLuint baseVAO, baseVBO;
-	glGenVertexArrays(1, &baseVAO);
-	glGenBuffers(1, &baseVBO);
-	glBindVertexArray(baseVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, baseVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(base_verticies), &base_verticies, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-	glBindVertexArray(0);
+	// Build and compile our shader program
+	// Forward and G-buffer shaders are compiled per feature set, each draw picks the cheapest variant that fits it
+	ShaderPermutations gkomShaders("gkom.vs", "gkom.frag");
+	Shader vtFeedbackShader("gkom.vs", "vt_feedback.frag");
+	Shader depthShader("depth.vs", "depth.frag");
+	ShaderPermutations gbufferShaders("gkom.vs", "gbuffer.frag");
+	Shader lightVolumeShader("light_volume.vs", "light_volume.frag", "#define SHADOWS\n");
+	Shader resolveShader("fullscreen.vs", "deferred_resolve.frag");
+	Shader skyboxShader("skybox.vs", "skybox.frag");
+	Shader temporalShader("fullscreen.vs", "taa_resolve.frag");
+	Shader fxaaShader("fullscreen.vs", "fxaa.frag");
+	Shader smaaShader("fullscreen.vs", "smaa_lite.frag");
+	Shader shadowDepthShader("shadow_depth.vs", "shadow_depth.frag", "", "shadow_depth.gs");
+	DeferredRenderer deferred(WIDTH, HEIGHT);
+	Skybox skybox;
+	// Frames are drawn offscreen and only where something changed, unchanged frames are not drawn at all
+	DamageTracker damage(WIDTH, HEIGHT);
+	bool vtStreaming = false;
+	// Reduced resolution shading, rebuilt to the window's size from the last frames with the motion of every pixel
+	TemporalUpsampler upsampler(WIDTH, HEIGHT, renderScale);
+	GpuTimer temporalTimer;
+	glm::mat4 previousViewProjection, previousHammerModel, previousCylinderModel;
+	int temporalSettle = 0;
+	GLfloat textureBias = 0.0f;
+	// Keeps the frames within the budget by trading quality, fed the newest timer results of every drawn frame
+	QualityGovernor governor(frameBudget);
+	bool governed = false;
+	// The user's upsampling settings, put back when the governor is switched off again
+	bool userTemporalUpsampling = temporalUpsampling;
+	GLfloat userRenderScale = renderScale;
+	double latestFrame = 0.0, latestShadows = 0.0, latestUpsampling = 0.0, latestAntiAliasing = 0.0;
+	// Frames since the moving casters' shadows were last drawn, and whether they lag behind the casters
+	int shadowAge = 0;
+	bool shadowsStale = false;
+	// Anti-aliasing of frames drawn at full resolution, its own pass timed apart from the frame
+	AntiAliasing antiAliasing(WIDTH, HEIGHT);
+	GpuTimer antiAliasingTimer;
+	// Occlusion queries on the moving objects' boxes, their draws are rendered conditionally on them
+	OcclusionCuller occlusion;
+	// GPU time of the shading path in use, printed once a second
+	GpuTimer frameTimer;
+	// Per fragment texture fetches and light evaluations of the forward pass, measured when the timings are printed
+	FragmentCounters fragmentCounters(WIDTH, HEIGHT);
+	// The floor and base are static shadow casters, cached per light; the hammer and cylinder are redrawn when they move
+	ShadowMaps shadowMaps;
+	GpuTimer shadowTimer;
+	glm::mat4 shadowHammerModel, shadowCylinderModel;
+	int shadowCylinderLod = -1;
+	bool timedDeferred = deferredShading;
+	GLfloat timedScale = 0.0f;
+	AntiAliasingMode timedAntiAliasing = AA_NONE;
+	GLfloat lastReport = 0.0f;
+
+	// Shader hot reload: edited shader files are rebuilt while the old programs keep rendering
+	Shader* shaders[] = { &vtFeedbackShader, &depthShader, &lightVolumeShader, &resolveShader, &shadowDepthShader, &skyboxShader, &temporalShader, &fxaaShader, &smaaShader };
+	ShaderPermutations* permutations[] = { &gkomShaders, &gbufferShaders };
+	const size_t SHADER_COUNT = sizeof(shaders) / sizeof(shaders[0]);
+	const size_t PERMUTATION_COUNT = sizeof(permutations) / sizeof(permutations[0]);
+	FileWatcher shaderWatcher;
+	for (size_t i = 0; i < SHADER_COUNT; i++)
+		shaders[i]->Watch(shaderWatcher);
+	for (size_t i = 0; i < PERMUTATION_COUNT; i++)
+		permutations[i]->Watch(shaderWatcher);
+	shaderWatcher.Start();
+
+	// Point lights, binned into view space clusters every frame so each fragment only evaluates the ones reaching it
+	ClusteredLights lights;
+	lights.Lights.push_back(PointLight(glm::vec3(1.95f, 1.0f, 0.0f), glm::vec3(0.05f), glm::vec3(0.8f), glm::vec3(1.0f))); //left
+	lights.Lights.push_back(PointLight(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.05f), glm::vec3(1.3f), glm::vec3(1.0f)));  //up
+	lights.Lights.push_back(PointLight(glm::vec3(0.0f, 0.05f, -1.35f), glm::vec3(0.25f), glm::vec3(0.8f), glm::vec3(1.0f))); //back
+	const size_t MAIN_LIGHTS = lights.Lights.size();
+	// Up to this many lights the forward shader loops over all of them with the count compiled in, skipping the clusters
+	const size_t FIXED_LIGHT_LIMIT = 8;
+
+	// Load meshes, their vertex layouts and draw ranges come from the mesh files
+	Mesh floorMesh, baseMesh, hammerMesh;
+	MeshData floorData, baseData;
+	floorMesh.Load("meshes/floor.mesh", &floorData);
+	baseMesh.Load("meshes/base.mesh", &baseData);
+	hammerMesh.Load("meshes/hammer.mesh");
+	// The floor and base never move
+	glm::mat4 floorModel = glm::scale(glm::mat4(), glm::vec3(2, 2, 2));
+	glm::mat4 baseModel = glm::scale(glm::mat4(), glm::vec3(2, 1.5, 2)); //(1, 0.66, 1));
+	// The same two are the occluders of the software occlusion culling
+	SoftwareOcclusion softwareOcclusion;
+	softwareOcclusion.AddOccluder(floorData, floorModel);
+	softwareOcclusion.AddOccluder(baseData, baseModel);
+
+	// The cylinder is generated: a unit cylinder LOD chain, squashed to the old prism's elliptic profile by cylinderShape
+	LodMesh cylinderMesh;
+	cylinderMesh.Upload(Primitives::CylinderLods(1.0f, 1.0f, 64, 4));
+	glm::mat4 cylinderShape = glm::scale(glm::translate(glm::mat4(), glm::vec3(0.27f, 0.15f, 0.0f)), glm::vec3(0.025f, 0.05f, 0.2f));
 
 	// Load textures
 	GLuint planeTexture = loadTexture("niebo.jpg");
 	GLuint figureTexture = loadTexture("drewno.jpg");
+	// The floor streams its texture from a virtual texture when a tile set is deployed, niebo.jpg is the fallback
+	VirtualTexture floorVT("niebo_vt");
+	// The sky lights the scene too: its prefiltered cubes give the ambient light in place of the lights' flat terms
+	EnvironmentMap environment;
+	environment.Load("niebo.jpg");
+
+	// Neither do the main lights, so their light on the floor and base is baked once here. The meshes come back
+	// unwrapped, with lightmap coordinates
+	LightmapBaker lightmap;
+	size_t floorLightmap = lightmap.Add(floorData, floorModel, averageColor(planeTexture));
+	size_t baseLightmap = lightmap.Add(baseData, baseModel, averageColor(figureTexture));
+	bool lightmapBaked = lightmap.Bake(vector<PointLight>(lights.Lights.begin(), lights.Lights.begin() + MAIN_LIGHTS), !environment.IsValid());
+	// The light the baked surfaces bounce, gathered by a probe grid: the moving objects pick it up from the probes,
+	// the lightmap gets the same bounce added so static and moving surfaces agree
+	glm::vec3 sceneLower, sceneUpper;
+	lightmap.Bounds(sceneLower, sceneUpper);
+	IrradianceProbes probes(sceneLower, sceneUpper, glm::ivec3(4, 3, 4));
+	if (lightmapBaked)
+	{
+		floorMesh.Upload(lightmap.Unwrapped(floorLightmap));
+		baseMesh.Upload(lightmap.Unwrapped(baseLightmap));
+		probes.Bake(lightmap);
+		lightmap.AddIndirect([&](const glm::vec3& position, const glm::vec3& normal) { return probes.Irradiance(position, normal); });
+	}
 
 	// Set texture units
-	gkomShader.Use();
-	glUniform1i(glGetUniformLocation(gkomShader.Program, "material.diffuse"), 0);
-	glUniform1i(glGetUniformLocation(gkomShader.Program, "material.specular"), 1);
+	gkomShaders.SetSampler("material.diffuse", 0);
+	gkomShaders.SetSampler("material.specular", 1);
+	gkomShaders.SetSampler("lightmap", 10);
+	gbufferShaders.SetSampler("material.diffuse", 0);
+	gbufferShaders.SetSampler("material.specular", 1);
 
 
 	int countframe = 0;
@@ -757,11 +458,6 @@ GLfloat base_verticies[] = {
 	// Game loop
 	while (!glfwWindowShouldClose(window))
 	{
-
-		// Clear the colorbuffer
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
 		// Calculate deltatime of current frame
 		GLfloat currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
@@ -769,88 +465,69 @@ GLfloat base_verticies[] = {
 		// Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
 		glfwPollEvents();
 		do_move();
-	
+		std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+		if (qualityGovernor != governed)
+		{
+			governor.Reset();
+			governed = qualityGovernor;
+			if (governed)
+			{
+				userTemporalUpsampling = temporalUpsampling;
+				userRenderScale = renderScale;
+				applyQuality(QUALITY_LEVELS[0]);
+			}
+			else
+			{
+				temporalUpsampling = userTemporalUpsampling;
+				renderScale = userRenderScale;
+			}
+		}
+		const QualityLevel& quality = qualityGovernor ? governor.Settings() : QUALITY_LEVELS[0];
 
-		// Use cooresponding shader when setting uniforms/drawing objects
-		gkomShader.Use();
-		GLint viewPosLoc = glGetUniformLocation(gkomShader.Program, "viewPos");
-		glUniform3f(viewPosLoc, camera.Position.x, camera.Position.y, camera.Position.z);
-		// Set material properties
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "material.shininess"), 32.0f);
-
-		// Here we set all the uniforms for the types of lights we have
-		// Point light 1
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[0].position"), pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[0].ambient"), 0.05f, 0.05f, 0.05f);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[0].diffuse"), 0.8f, 0.8f, 0.8f);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[0].specular"), 1.0f, 1.0f, 1.0f);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[0].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[0].linear"), 0.09);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[0].quadratic"), 0.032);
-		// Point light 2
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[1].position"), pointLightPositions[1].x, pointLightPositions[1].y, pointLightPositions[1].z);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[1].ambient"), 0.05f, 0.05f, 0.05f);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[1].diffuse"), 1.3f, 1.3f, 1.3f);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[1].specular"), 1.0f, 1.0f, 1.0f);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[1].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[1].linear"), 0.09);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[1].quadratic"), 0.032);
-		// Point light 3
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[2].position"), pointLightPositions[2].x, pointLightPositions[2].y, pointLightPositions[2].z);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[2].ambient"), 0.25f, 0.25f, 0.25f);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[2].diffuse"), 0.8f, 0.8f, 0.8f);
-		glUniform3f(glGetUniformLocation(gkomShader.Program, "pointLights[2].specular"), 1.0f, 1.0f, 1.0f);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[2].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[2].linear"), 0.09);
-		glUniform1f(glGetUniformLocation(gkomShader.Program, "pointLights[2].quadratic"), 0.032);
+		// Start rebuilding what uses edited files, swap in whatever has finished linking. A swapped program redraws everything
+		bool shadersSwapped = false;
+		vector<string> changedFiles = shaderWatcher.Changed();
+		for (size_t i = 0; i < changedFiles.size(); i++)
+		{
+			for (size_t k = 0; k < SHADER_COUNT; k++)
+				shaders[k]->Reload(changedFiles[i]);
+			for (size_t k = 0; k < PERMUTATION_COUNT; k++)
+				permutations[k]->Reload(changedFiles[i]);
+		}
+		for (size_t i = 0; i < SHADER_COUNT; i++)
+			shadersSwapped |= shaders[i]->Update();
+		for (size_t i = 0; i < PERMUTATION_COUNT; i++)
+			shadersSwapped |= permutations[i]->Update();
 
 		// Create camera transformations
 		glm::mat4 view;
 		view = camera.GetViewMatrix();
-		glm::mat4 projection = glm::perspective(camera.Zoom, (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
-
-
-
-		// Get the uniform locations
-		GLint modelLoc = glGetUniformLocation(gkomShader.Program, "model");
-		GLint viewLoc = glGetUniformLocation(gkomShader.Program, "view");
-		GLint projLoc = glGetUniformLocation(gkomShader.Program, "projection");
-		// Pass the matrices to the shader
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-		// Bind planeMap
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, planeTexture);
-
-		// Draw the plane
-		glm::mat4 model;
-		glBindVertexArray(planeVAO);
-		model = glm::mat4();
-		model = glm::scale(model, glm::vec3(2, 2, 2)); 
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
-
-		// Bind figureMap
-		glBindTexture(GL_TEXTURE_2D, figureTexture);
-
-
-		// Draw the base
-		glBindVertexArray(baseVAO);
-		model = glm::mat4();
-		model = glm::scale(model, glm::vec3(2, 1.5, 2)); //(1, 0.66, 1));
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-		glDrawArrays(GL_TRIANGLES, 0, 90);
-		glBindVertexArray(0);
-
-		// Draw the hammer
-		glBindVertexArray(hammerVAO);
-		model = glm::mat4();
-		model = glm::scale(model, glm::vec3(2, 1.5, 2)); 
-
-		
-		model = glm::rotate(model, 0.13f, glm::vec3(0.0f, 0.0f, 1.0f));
+		glm::mat4 steadyProjection = glm::perspective(camera.Zoom, (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
+		// Upsampled frames are shaded smaller and each from a slightly shifted projection. Whatever compares frames
+		// uses the steady one
+		upsampler.SetScale(renderScale);
+		if (!temporalUpsampling)
+			upsampler.Reset();
+		GLsizei sceneWidth = temporalUpsampling ? upsampler.RenderWidth : WIDTH;
+		GLsizei sceneHeight = temporalUpsampling ? upsampler.RenderHeight : HEIGHT;
+		glm::mat4 projection = temporalUpsampling ? upsampler.Jittered(steadyProjection) : steadyProjection;
+		// The materials keep the detail of the output resolution, the jittered frames add up to it
+		GLfloat mipBias = temporalUpsampling ? std::log2(upsampler.Scale) : 0.0f;
+		if (mipBias != textureBias)
+		{
+			const GLuint materials[2] = { planeTexture, figureTexture };
+			for (int i = 0; i < 2; i++)
+			{
+				glBindTexture(GL_TEXTURE_2D, materials[i]);
+				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, mipBias);
+			}
+			glBindTexture(GL_TEXTURE_2D, 0);
+			textureBias = mipBias;
+		}
+
+		// Object transforms, shared by the feedback, depth and lighting passes
+		glm::mat4 hammerModel = glm::scale(glm::mat4(), glm::vec3(2, 1.5, 2));
+		hammerModel = glm::rotate(hammerModel, 0.13f, glm::vec3(0.0f, 0.0f, 1.0f));
 			counta = round(currentFrame);
 			if (counta >= currentFrame)
 			{
@@ -866,37 +543,392 @@ GLfloat base_verticies[] = {
 	
 		if ((counta%2) && (!(countb%2)))
 		{
-			model = glm::rotate(model, -0.13f, glm::vec3(0.0f, 0.0f, 1.0f));
+			hammerModel = glm::rotate(hammerModel, -0.13f, glm::vec3(0.0f, 0.0f, 1.0f));
 			
 		}
-		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-		glDrawArrays(GL_TRIANGLES, 0, 108);
-		glBindVertexArray(0);
 
-	
-		// Draw the cylinder
-		glBindVertexArray(cylinderVAO);
-		model = glm::mat4();
-		model = glm::scale(model, glm::vec3(2, 1.5, 2)); 
-
-			model = glm::rotate(model, 59.75f, glm::vec3(0.0f, 0.0f, 1.0f));//59,75
-			model = glm::translate(model, glm::vec3(-0.545f, -0.29f, 0.0f));
-		
-			
+		glm::mat4 cylinderModel = glm::scale(glm::mat4(), glm::vec3(2, 1.5, 2));
+			cylinderModel = glm::rotate(cylinderModel, 59.75f, glm::vec3(0.0f, 0.0f, 1.0f));//59,75
+			cylinderModel = glm::translate(cylinderModel, glm::vec3(-0.545f, -0.29f, 0.0f));
 			if ((counta % 2) && (!(countb % 2)))
 			{
-				model = glm::rotate(model, -59.75f, glm::vec3(0.0f, 0.0f, 1.0f));
-				model = glm::translate(model, glm::vec3(-0.53f, -0.31f, 0.0f));
+				cylinderModel = glm::rotate(cylinderModel, -59.75f, glm::vec3(0.0f, 0.0f, 1.0f));
+				cylinderModel = glm::translate(cylinderModel, glm::vec3(-0.53f, -0.31f, 0.0f));
 			}
-	
+		cylinderModel = cylinderModel * cylinderShape;
+		cylinderMesh.Select(cylinderModel, view, camera.Zoom, (GLfloat)sceneHeight * std::pow(2.0f, -quality.LodBias));
+
+		// Compare what this frame would show with the last one drawn. The camera and the toggles change the whole
+		// picture, the hammer and cylinder only where they were and are, unless they cast shadows onto the rest
+		damage.Begin(steadyProjection * view);
+		GLuint toggles = (depthPrepass ? 1 : 0) | (deferredShading ? 2 : 0) | (shadows ? 4 : 0) | (lightmaps ? 8 : 0) | (workshopLights ? 16 : 0) | (temporalUpsampling ? 32 : 0);
+		damage.Global(toggles);
+		if (temporalUpsampling)
+			damage.Global(upsampler.Scale);
+		if (qualityGovernor)
+			damage.Global(governor.Level);
+		// The temporal upsampling smooths the edges on its own
+		antiAliasing.Mode = temporalUpsampling ? AA_NONE : (AntiAliasingMode)antiAliasingMode;
+		AntiAliasingMode antiAliasingActive = antiAliasing.Active(!deferredShading);
+		damage.Global(antiAliasingActive);
+		damage.Global(cylinderMesh.Current);
+		damage.Object(0, hammerModel, hammerMesh.BoundsMin, hammerMesh.BoundsMax, shadows);
+		damage.Object(1, cylinderModel, cylinderMesh.Levels[0].BoundsMin, cylinderMesh.Levels[0].BoundsMax, shadows);
+		if (shadersSwapped || windowRefreshed || shadowsStale)
+			damage.Invalidate();
+		windowRefreshed = false;
+		// Virtual texture feedback: draw the floor at low resolution writing the tiles it needs, then stream them in.
+		// It keeps running while tiles are on their way, the frame is redrawn only once some went into the cache
+		if (floorVT.IsValid() && (vtStreaming || !damage.IsIdle()))
+		{
+			floorVT.BeginFeedback(WIDTH, HEIGHT);
+			vtFeedbackShader.Use();
+			floorVT.SetUniforms(vtFeedbackShader.Program, floorVT.FeedbackLodBias());
+			glUniformMatrix4fv(glGetUniformLocation(vtFeedbackShader.Program, "model"), 1, GL_FALSE, glm::value_ptr(floorModel));
+			glUniformMatrix4fv(glGetUniformLocation(vtFeedbackShader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+			glUniformMatrix4fv(glGetUniformLocation(vtFeedbackShader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+			floorMesh.Draw();
+			floorVT.EndFeedback(WIDTH, HEIGHT);
+			vtStreaming = floorVT.Update();
+			if (floorVT.Uploaded)
+				damage.Invalidate();
+		}
+		// The post-process anti-aliasing reads pixels around the ones that changed, it only runs on whole frames
+		if (antiAliasing.IsPostProcess(!deferredShading) && !damage.IsIdle())
+			damage.Invalidate();
+		// An upsampled frame builds up over a run of jittered frames: every change is followed by that many full ones
+		if (temporalUpsampling)
+		{
+			if (!damage.IsIdle())
+				temporalSettle = 0;
+			if (temporalSettle < TEMPORAL_SETTLE_FRAMES)
+			{
+				damage.Invalidate();
+				temporalSettle++;
+			}
+		}
+		if (damage.IsIdle())
+		{
+			// Nothing changed: the window keeps showing the last frame. Sleep until input arrives or the hammer's
+			// next swing (its pose flips every half second), waking a few times a second for edited shaders and every
+			// few milliseconds for the virtual texture tiles still loading
+			double now = glfwGetTime();
+			double nextSwing = floor(now + 0.5) + 0.5;
+			damage.Wait(std::min(nextSwing - now, vtStreaming ? 0.01 : 0.25));
+			lastFrame = (GLfloat)glfwGetTime();
+			continue;
+		}
+
+		// The software occlusion culling runs on its workers while the frame is set up, the first draw it decides
+		// waits for it
+		softwareOcclusion.Enabled = occlusionMode == OCCLUSION_SOFTWARE;
+		softwareOcclusion.Object(0, hammerModel, hammerMesh.BoundsMin, hammerMesh.BoundsMax);
+		softwareOcclusion.Object(1, cylinderModel, cylinderMesh.Levels[0].BoundsMin, cylinderMesh.Levels[0].BoundsMax);
+		softwareOcclusion.Start(steadyProjection * view);
+
+		// With the queries, the hammer and cylinder are tested once the base (and in the depth pre-pass the floor)
+		// is down: from below or behind the base it hides them
+		occlusion.Enabled = occlusionMode == OCCLUSION_QUERIES;
+		occlusion.BeginFrame(depthShader.Program, view, projection);
+		auto testOcclusion = [&]()
+		{
+			occlusion.Test(0, hammerModel, hammerMesh.BoundsMin, hammerMesh.BoundsMax);
+			occlusion.Test(1, cylinderModel, cylinderMesh.Levels[0].BoundsMin, cylinderMesh.Levels[0].BoundsMax);
+		};
+		// Draws the object in slot id unless the culling found it hidden
+		auto drawOccludee = [&](size_t id, const std::function<void()>& draw)
+		{
+			if (softwareOcclusion.IsHidden(id))
+				return;
+			occlusion.BeginConditional(id);
+			draw();
+			occlusion.EndConditional(id);
+		};
+
+		// Draws the objects with their textures. begin(features) makes the variant for the draw's features current,
+		// sets up whatever the pass needs on it and returns its program. None of the scene's materials has a specular map
+		auto drawScene = [&](const std::function<GLuint(GLuint)>& begin)
+		{
+			auto use = [&](GLuint features) -> GLuint
+			{
+				GLuint program = begin(features);
+				// Pass the matrices to the shader
+				glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+				glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+				glUniformMatrix4fv(glGetUniformLocation(program, "currentViewProjection"), 1, GL_FALSE, glm::value_ptr(steadyProjection * view));
+				glUniformMatrix4fv(glGetUniformLocation(program, "previousViewProjection"), 1, GL_FALSE, glm::value_ptr(previousViewProjection));
+				return program;
+			};
+
+			// Static surfaces take the baked lights from the lightmap, everything else gets the bounce from the probes
+			GLuint dynamicFeatures = lightmapBaked ? SHADER_PROBES : 0;
+			GLuint staticFeatures = lightmaps && lightmapBaked ? (GLuint)SHADER_LIGHTMAP : dynamicFeatures;
+			// The floor goes last: early-Z then rejects what the objects cover of it
+			GLuint program = use(staticFeatures);
+			GLint modelLoc = glGetUniformLocation(program, "model");
+			GLint previousModelLoc = glGetUniformLocation(program, "previousModel");
+
+			// Bind figureMap
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, figureTexture);
+
+			// Draw the base
+			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(baseModel));
+			glUniformMatrix4fv(previousModelLoc, 1, GL_FALSE, glm::value_ptr(baseModel));
+			baseMesh.Draw();
+			testOcclusion();
+
+			program = use(dynamicFeatures);
+			modelLoc = glGetUniformLocation(program, "model");
+			previousModelLoc = glGetUniformLocation(program, "previousModel");
+
+			// Draw the hammer
+			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(hammerModel));
+			glUniformMatrix4fv(previousModelLoc, 1, GL_FALSE, glm::value_ptr(previousHammerModel));
+			drawOccludee(0, [&]() { hammerMesh.Draw(); });
+
+			// Draw the cylinder
+			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(cylinderModel));
+			glUniformMatrix4fv(previousModelLoc, 1, GL_FALSE, glm::value_ptr(previousCylinderModel));
+			drawOccludee(1, [&]() { cylinderMesh.Draw(); });
+
+			program = use((floorVT.IsValid() ? SHADER_VIRTUAL_TEXTURE : 0) | staticFeatures);
+
+			// Bind planeMap
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, planeTexture);
+			if (floorVT.IsValid())
+				floorVT.Bind(program, 2, 3);
+
+			// Draw the plane
+			glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, glm::value_ptr(floorModel));
+			glUniformMatrix4fv(glGetUniformLocation(program, "previousModel"), 1, GL_FALSE, glm::value_ptr(floorModel));
+			floorMesh.Draw();
+		};
+
+		size_t lightTotal = MAIN_LIGHTS + (workshopLights ? quality.WorkshopLights : 0);
+		if (lights.Lights.size() != lightTotal)
+		{
+			lights.Lights.resize(MAIN_LIGHTS, lights.Lights[0]);
+			if (workshopLights)
+				addWorkshopLights(lights, quality.WorkshopLights);
+		}
 
-			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		GLfloat scale = temporalUpsampling ? upsampler.Scale : 0.0f;
+		if (timedDeferred != deferredShading || timedScale != scale || timedAntiAliasing != antiAliasingActive)
+		{
+			frameTimer.Reset();
+			temporalTimer.Reset();
+			antiAliasingTimer.Reset();
+			timedDeferred = deferredShading;
+			timedScale = scale;
+			timedAntiAliasing = antiAliasingActive;
+		}
+		// The upsampler needs every surface's motion
+		GLuint motionFeatures = temporalUpsampling ? SHADER_MOTION_VECTORS : 0;
+		// A handful of lights is cheaper to loop over than to look up in the clusters
+		GLuint lightCount = lights.Lights.size() <= FIXED_LIGHT_LIMIT ? (GLuint)lights.Lights.size() : 0;
+		auto forwardShading = [&](GLuint features) -> GLuint
+		{
+			// Use cooresponding shader when setting uniforms/drawing objects. The lightmap has the static casters' shadows
+			// of its lights baked in, the static cube maps tell the shader what the moving casters add on top
+			bool lightmapped = (features & SHADER_LIGHTMAP) != 0;
+			if (environment.IsValid())
+				features |= SHADER_ENVIRONMENT;
+			GLuint program = gkomShaders.Use(ShaderPermutations::Key(features | motionFeatures | (shadows ? SHADER_SHADOWS : 0), lightCount));
+			glUniform3f(glGetUniformLocation(program, "viewPos"), camera.Position.x, camera.Position.y, camera.Position.z);
+			// Set material properties
+			glUniform1f(glGetUniformLocation(program, "material.shininess"), 32.0f);
+			lights.Bind(program, 4, 5, 6, sceneWidth, sceneHeight);
+			if (shadows)
+				shadowMaps.Bind(program, 7);
+			if (shadows && lightmapped)
+				shadowMaps.BindStatic(program, 13);
+			if (features & SHADER_PROBES)
+				probes.Bind(program);
+			if (lightmapped)
+			{
+				glActiveTexture(GL_TEXTURE10);
+				glBindTexture(GL_TEXTURE_2D, lightmap.Texture);
+				glActiveTexture(GL_TEXTURE0);
+				glUniform1i(glGetUniformLocation(program, "lightmapLights"), (GLint)MAIN_LIGHTS);
+			}
+			if (environment.IsValid())
+				environment.Bind(program, 11, 12);
+			return program;
+		};
 
-			glDrawArrays(GL_TRIANGLES, 0, 96);
-		
-		glBindVertexArray(0);
+		shadowsStale = false;
+		if (shadows)
+		{
+			// Lower quality levels let the moving casters' shadows lag up to ShadowInterval - 1 frames, the frames
+			// in between are still drawn in full so the shadows catch up
+			bool castersMoved = hammerModel != shadowHammerModel || cylinderModel != shadowCylinderModel || cylinderMesh.Current != shadowCylinderLod;
+			shadowAge = std::min(shadowAge + 1, quality.ShadowInterval);
+			shadowsStale = castersMoved && shadowAge < quality.ShadowInterval;
+			if (castersMoved && !shadowsStale)
+			{
+				shadowHammerModel = hammerModel;
+				shadowCylinderModel = cylinderModel;
+				shadowCylinderLod = cylinderMesh.Current;
+				shadowAge = 0;
+			}
+			shadowTimer.Begin();
+			shadowMaps.Update(lights.Lights, shadowDepthShader.Program, [&](GLuint program)
+			{
+				GLint modelLoc = glGetUniformLocation(program, "model");
+				glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(floorModel));
+				floorMesh.DrawDepth();
+				glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(baseModel));
+				baseMesh.DrawDepth();
+			}, [&](GLuint program)
+			{
+				GLint modelLoc = glGetUniformLocation(program, "model");
+				glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(hammerModel));
+				hammerMesh.DrawDepth();
+				glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(cylinderModel));
+				cylinderMesh.DrawDepth();
+			}, castersMoved && !shadowsStale);
+			shadowTimer.End();
+		}
+
+		frameTimer.Begin();
+		damage.BeginFrame(glm::vec3(0.1f, 0.1f, 0.1f));
+		// Upsampled frames are shaded into the upsampler's target first, anti-aliased ones into the mode's target
+		GLuint sceneTarget = temporalUpsampling ? upsampler.SceneFramebuffer : antiAliasing.Begin(damage.Framebuffer, glm::vec3(0.1f, 0.1f, 0.1f), !deferredShading);
+		if (deferredShading)
+		{
+			// Deferred: fill the G-buffer, add every light volume on top of it, then copy the sum to the window
+			deferred.SetRenderSize(sceneWidth, sceneHeight);
+			deferred.BeginGeometry();
+			// The G-buffer has no room for the lightmap or the probe bounce, the light volumes shade every surface
+			drawScene([&](GLuint features) { return gbufferShaders.Use(ShaderPermutations::Key((features & ~(SHADER_LIGHTMAP | SHADER_PROBES)) | motionFeatures)); });
+			lights.UploadLights();
+			lightVolumeShader.Use();
+			shadowMaps.Bind(lightVolumeShader.Program, 7, shadows);
+			glUniform1i(glGetUniformLocation(lightVolumeShader.Program, "environmentLighting"), environment.IsValid());
+			deferred.AccumulateLights(lightVolumeShader.Program, lights.LightTexture(), (GLsizei)lights.Lights.size(), view, projection, camera.Position, 32.0f);
+			// The sky's ambient goes on in the resolve, once per pixel, and the sky itself fills the empty pixels. The
+			// cubes are bound even when empty, so their samplers never share a unit with the G-buffer's
+			resolveShader.Use();
+			environment.Bind(resolveShader.Program, 11, 12);
+			glUniform1i(glGetUniformLocation(resolveShader.Program, "environmentLighting"), environment.IsValid());
+			glUniformMatrix4fv(glGetUniformLocation(resolveShader.Program, "inverseViewProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(projection * view)));
+			glUniform3f(glGetUniformLocation(resolveShader.Program, "viewPos"), camera.Position.x, camera.Position.y, camera.Position.z);
+			glUniform1f(glGetUniformLocation(resolveShader.Program, "shininess"), 32.0f);
+			deferred.Resolve(resolveShader.Program, glm::vec3(0.1f, 0.1f, 0.1f), sceneTarget);
+		}
+		else
+		{
+			if (temporalUpsampling)
+				upsampler.BeginScene(glm::vec3(0.1f, 0.1f, 0.1f));
+
+			// Depth pre-pass: positions only, no color writes. The lighting pass below then shades only the fragments
+			// whose depth matches exactly, so nothing overdrawn runs the light loop. The base and floor go first, the
+			// moving objects are tested against them and their depth is drawn like their color, conditionally
+			if (depthPrepass)
+			{
+				depthShader.Use();
+				GLint depthModelLoc = glGetUniformLocation(depthShader.Program, "model");
+				glUniformMatrix4fv(glGetUniformLocation(depthShader.Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+				glUniformMatrix4fv(glGetUniformLocation(depthShader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				glUniformMatrix4fv(depthModelLoc, 1, GL_FALSE, glm::value_ptr(baseModel));
+				baseMesh.DrawDepth();
+				glUniformMatrix4fv(depthModelLoc, 1, GL_FALSE, glm::value_ptr(floorModel));
+				floorMesh.DrawDepth();
+				testOcclusion();
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				glUniformMatrix4fv(depthModelLoc, 1, GL_FALSE, glm::value_ptr(hammerModel));
+				drawOccludee(0, [&]() { hammerMesh.DrawDepth(); });
+				glUniformMatrix4fv(depthModelLoc, 1, GL_FALSE, glm::value_ptr(cylinderModel));
+				drawOccludee(1, [&]() { cylinderMesh.DrawDepth(); });
+				glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+				glDepthFunc(GL_EQUAL);
+				glDepthMask(GL_FALSE);
+			}
+
+			// Bin the lights for this view
+			lights.Update(view, camera.Zoom, (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 100.0f);
+			drawScene(forwardShading);
+
+			// Back to the default depth state, also needed for the next glClear to reach the depth buffer
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+
+			// The sky fills whatever the scene left empty
+			if (environment.IsValid())
+				skybox.Draw(skyboxShader.Program, environment.SpecularMap, view, projection);
+		}
+		frameTimer.End();
+		if (antiAliasingActive != AA_NONE)
+		{
+			antiAliasingTimer.Begin();
+			antiAliasing.Resolve(antiAliasingActive == AA_SMAA ? smaaShader.Program : fxaaShader.Program, damage.Framebuffer);
+			antiAliasingTimer.End();
+		}
+		if (temporalUpsampling)
+		{
+			// Rebuild the full frame from the samples, timed on its own. The motion and depth are the G-buffer's in deferred shading
+			temporalTimer.Begin();
+			upsampler.Resolve(temporalShader.Program, damage.Framebuffer, deferredShading ? deferred.MotionTexture : upsampler.MotionTexture,
+				deferredShading ? deferred.DepthTexture : upsampler.DepthTexture);
+			temporalTimer.End();
+		}
+		damage.EndFrame();
+		previousViewProjection = steadyProjection * view;
+		previousHammerModel = hammerModel;
+		previousCylinderModel = cylinderModel;
+		// The frame's CPU time for the governor, taken before the once a second report and its counters pass
+		double cpuFrame = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+
+		double gpuMilliseconds;
+		if (lastFrame - lastReport >= 1.0f && frameTimer.Report(gpuMilliseconds))
+		{
+			cout << (deferredShading ? "deferred: " : "forward: ") << gpuMilliseconds << " ms GPU, " << lights.Lights.size() << " lights";
+			double shadowMilliseconds;
+			if (shadows && shadowTimer.Report(shadowMilliseconds))
+				cout << ", shadow maps " << shadowMilliseconds << " ms";
+			double temporalMilliseconds;
+			if (temporalUpsampling && temporalTimer.Report(temporalMilliseconds))
+				cout << ", upsampling " << temporalMilliseconds << " ms from " << upsampler.RenderWidth << "x" << upsampler.RenderHeight;
+			// The counters are laid out for the window's pixels, not for a reduced render size
+			if (!deferredShading && !temporalUpsampling)
+			{
+				fragmentCounters.Begin();
+				drawScene([&](GLuint features) { return forwardShading(features | SHADER_COUNTERS); });
+				if (fragmentCounters.End())
+					cout << ", per fragment " << fragmentCounters.Fetches << " fetches, " << fragmentCounters.LightsShaded << " of " << fragmentCounters.LightsTested << " lights shaded, " << fragmentCounters.Math << " math operations";
+			}
+			double antiAliasingMilliseconds;
+			if (antiAliasingActive != AA_NONE && antiAliasingTimer.Report(antiAliasingMilliseconds))
+				cout << ", " << AntiAliasing::Name(antiAliasingActive) << (antiAliasingActive == AA_MSAA ? " resolve " : " ") << antiAliasingMilliseconds << " ms";
+			if (occlusionMode == OCCLUSION_QUERIES)
+				cout << ", " << occlusion.Hidden() << " of " << occlusion.Objects() << " objects occluded, " << occlusion.TestsPerFrame() << " box tests per frame";
+			double cullMilliseconds, cullWaitMilliseconds;
+			if (occlusionMode == OCCLUSION_SOFTWARE && softwareOcclusion.Report(cullMilliseconds, cullWaitMilliseconds))
+				cout << ", " << softwareOcclusion.Hidden() << " of " << softwareOcclusion.Objects() << " objects occluded, Hi-Z " << cullMilliseconds
+					<< " ms on " << softwareOcclusion.Threads() << " threads, waited " << cullWaitMilliseconds << " ms";
+			if (qualityGovernor)
+				cout << ", quality level " << governor.Level << " of " << QUALITY_LEVEL_COUNT - 1;
+			cout << endl;
+			lastReport = lastFrame;
+		}
+
+		// The governor weighs the newest GPU times of the passes drawn against this frame's CPU time
+		if (qualityGovernor)
+		{
+			frameTimer.Latest(latestFrame);
+			shadowTimer.Latest(latestShadows);
+			temporalTimer.Latest(latestUpsampling);
+			antiAliasingTimer.Latest(latestAntiAliasing);
+			double gpuFrame = latestFrame + (shadows ? latestShadows : 0.0) + (temporalUpsampling ? latestUpsampling : 0.0) + (antiAliasingActive != AA_NONE ? latestAntiAliasing : 0.0);
+			if (governor.Update(gpuFrame, cpuFrame))
+				applyQuality(governor.Settings());
+		}
 
-			// Swap the screen buffers
+		// Swap the screen buffers
+		damage.Present();
 		glfwSwapBuffers(window);
 		countframe++;
 	}
@@ -17,7 +17,10 @@ struct PointLight {
     vec3 specular;
 };
 
-#define NR_POINT_LIGHTS 3
+// Cluster grid, has to match ClusteredLights.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
 
 in vec3 FragPos;
 in vec3 Normal;
@@ -25,45 +28,219 @@ in vec2 TexCoords;
 
 uniform sampler2D texture1;
 
-out vec4 color;
+layout (location = 0) out vec4 color;
 
 uniform vec3 viewPos;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+uniform mat4 view;
 uniform Material material;
 
+// Variants (see ShaderPermutations.h): SPECULAR_MAP, VIRTUAL_TEXTURE, LIGHT_COUNT, COUNTERS, SHADOWS, LIGHTMAP, PROBES.
+// The virtual texture, shadow map and COUNT parts live in common.frag
+
+// Clustered lights: 4 texels per light, (offset, count) per cluster into the light index list.
+// With LIGHT_COUNT every fragment simply evaluates the first LIGHT_COUNT lights and the clusters are not read
+uniform samplerBuffer lightData;
+#ifndef LIGHT_COUNT
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterSlice;        // slice = log(view depth) * x + y
+#endif
+
+// Static surfaces: lights 0 .. lightmapLights - 1 are baked (diffuse and ambient, shadows and ambient occlusion
+// included) and cost a single fetch, only the lights after them go through the loop. The bake only has the static
+// casters' shadows: with SHADOWS, the static cube maps tell how much of a baked light got through them, and
+// whatever of that the full maps hold back is the moving casters' shadow
+#ifdef LIGHTMAP
+in vec2 LightmapCoords;
+uniform sampler2D lightmap;
+uniform int lightmapLights;
+#ifdef SHADOWS
+uniform samplerCubeShadow staticShadowMaps[SHADOW_LIGHTS];
+#endif
+#endif
+
+// Surfaces without a lightmap get the bounce light from the probe grid, evaluated per vertex in gkom.vs
+#ifdef PROBES
+in vec3 ProbeIrradiance;
+#endif
+
+// Image based ambient (EnvironmentMap.h) instead of the lights' ambient terms: diffuse from the irradiance cube,
+// specular from the mip of the prefiltered cube whose Phong lobe matches the shininess. A lightmap keeps the
+// ambient occlusion in alpha for it
+#ifdef ENVIRONMENT
+uniform samplerCube environmentMap;
+uniform samplerCube irradianceMap;
+uniform float environmentLevels;
+uniform float environmentIntensity;
+#endif
+
+// Screen space motion since the last frame in texture coordinates, for the temporal upsampling
+#ifdef MOTION_VECTORS
+in vec4 CurrentClip;
+in vec4 PreviousClip;
+layout (location = 1) out vec2 motion;
+#endif
+
 // Function prototypes
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 ShadeLight(int index, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor);
+vec3 CalcPointLight(PointLight light, float distance, float shadow, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor);
+#if defined(LIGHTMAP) && defined(SHADOWS)
+vec3 MovingCasterShadow(int index, vec3 normal, vec3 albedo);
+#endif
 
 void main()
 {    
     // Properties
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
+    COUNT(0, 0, 0, 3);
+    // The material is the same for every light: sample it once, here in uniform control flow where the
+    // virtual texture's derivatives are defined
+    vec3 albedo = DiffuseColor(material.diffuse, TexCoords);
+#ifdef SPECULAR_MAP
+    vec3 specularColor = vec3(texture(material.specular, TexCoords));
+    COUNT(1, 0, 0, 0);
+#else
+    vec3 specularColor = vec3(0.0);
+#endif
 
-    vec3 result = CalcPointLight(pointLights[0], norm, FragPos, viewDir); 
-    for(int i = 1; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
-    
+    vec3 result = vec3(0.0);
+    int firstLight = 0;
+    float occlusion = 1.0;
+#ifdef LIGHTMAP
+    vec4 baked = texture(lightmap, LightmapCoords);
+    result = albedo * baked.rgb;
+    occlusion = baked.a;
+    firstLight = lightmapLights;
+    COUNT(1, 0, 0, 1);
+#ifdef SHADOWS
+    for(int i = 0; i < lightmapLights; i++)
+        result -= MovingCasterShadow(i, norm, albedo);
+    // The static maps are coarser than the baked shadows, they may see light the bake did not get
+    result = max(result, vec3(0.0));
+#endif
+#endif
+#ifdef PROBES
+    result += albedo * ProbeIrradiance;
+    COUNT(0, 0, 0, 2);
+#endif
+#ifdef ENVIRONMENT
+    vec3 ambient = albedo * texture(irradianceMap, norm).rgb;
+    COUNT(1, 0, 0, 4);
+#ifdef SPECULAR_MAP
+    // Mip m holds exponent 4^(levels - 1 - m)
+    float lod = clamp(environmentLevels - 1.0 - 0.5 * log2(max(material.shininess, 1.0)), 0.0, environmentLevels - 1.0);
+    ambient += specularColor * textureLod(environmentMap, reflect(-viewDir, norm), lod).rgb;
+    COUNT(1, 0, 0, 11);
+#endif
+    result += ambient * (environmentIntensity * occlusion);
+#endif
+#ifdef LIGHT_COUNT
+    for(int i = firstLight; i < LIGHT_COUNT; i++)
+        result += ShadeLight(i, norm, viewDir, albedo, specularColor);
+#else
+    // Only the lights binned into this fragment's cluster can reach it
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    ivec3 cell = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(floor(log(max(depth, 1e-4)) * clusterSlice.x + clusterSlice.y)));
+    cell = clamp(cell, ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+    uvec2 range = texelFetch(lightClusters, (cell.z * CLUSTER_Y + cell.y) * CLUSTER_X + cell.x).xy;
+    COUNT(1, 0, 0, 13);
+
+    for(uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(lightIndices, int(range.x + i)).r);
+        COUNT(1, 0, 0, 1);
+        if (index >= firstLight)
+            result += ShadeLight(index, norm, viewDir, albedo, specularColor);
+    }
+#endif
+
+#ifdef COUNTERS
+    color = counters;
+#else
     color = vec4(result, 1.0);
+#endif
+#ifdef MOTION_VECTORS
+    motion = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
+#endif
+}
+
+// Reads the light's position and radius first, the other three texels only if the fragment is in range.
+// Past the radius the light is below the cutoff ClusteredLights derives it from (1/256 of its brightest term)
+vec3 ShadeLight(int index, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor)
+{
+    vec4 positionRadius = texelFetch(lightData, index * 4);
+    vec3 toLight = positionRadius.xyz - FragPos;
+    float distanceSquared = dot(toLight, toLight);
+    COUNT(1, 1, 0, 4);
+    if (distanceSquared > positionRadius.w * positionRadius.w)
+        return vec3(0.0);
+    vec4 ambientConstant = texelFetch(lightData, index * 4 + 1);
+    vec4 diffuseLinear = texelFetch(lightData, index * 4 + 2);
+    vec4 specularQuadratic = texelFetch(lightData, index * 4 + 3);
+    COUNT(3, 0, 1, 1);
+    PointLight light = PointLight(positionRadius.xyz, ambientConstant.w, diffuseLinear.w, specularQuadratic.w,
+                                  ambientConstant.rgb, diffuseLinear.rgb, specularQuadratic.rgb);
+    float distance = sqrt(distanceSquared);
+    return CalcPointLight(light, distance, Shadow(index, toLight, distance), normal, viewDir, albedo, specularColor);
 }
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(PointLight light, float distance, float shadow, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = (light.position - FragPos) / distance;
     // Diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // Specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // Attenuation
-    float distance = length(light.position - fragPos);
     float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
     // Combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
-}
\ No newline at end of file
+    vec3 result = light.diffuse * diff * albedo;
+    COUNT(0, 0, 0, 12);
+#ifdef SPECULAR_MAP
+    // Specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    result += light.specular * spec * specularColor;
+    COUNT(0, 0, 0, 8);
+#endif
+    // Shadows only hold back the direct light, ambient still reaches
+#ifdef ENVIRONMENT
+    COUNT(0, 0, 0, 3);
+    return result * shadow * attenuation;
+#else
+    COUNT(0, 0, 0, 5);
+    return (light.ambient * albedo + result * shadow) * attenuation;
+#endif
+}
+
+#if defined(LIGHTMAP) && defined(SHADOWS)
+// The part of baked light index's diffuse term (as LightmapBaker computes it) that the moving casters hold back
+vec3 MovingCasterShadow(int index, vec3 normal, vec3 albedo)
+{
+    if (index >= shadowCount)
+        return vec3(0.0);
+    vec4 positionRadius = texelFetch(lightData, index * 4);
+    vec3 toLight = positionRadius.xyz - FragPos;
+    float distance = length(toLight);
+    COUNT(1, 0, 0, 3);
+    if (distance > positionRadius.w)
+        return vec3(0.0);
+    float staticShadow;
+    if (index == 0)
+        staticShadow = ShadowTest(staticShadowMaps[0], shadowFar[0], toLight, distance);
+    else if (index == 1)
+        staticShadow = ShadowTest(staticShadowMaps[1], shadowFar[1], toLight, distance);
+    else
+        staticShadow = ShadowTest(staticShadowMaps[2], shadowFar[2], toLight, distance);
+    float held = max(staticShadow - Shadow(index, toLight, distance), 0.0);
+    if (held == 0.0)
+        return vec3(0.0);
+    vec4 ambientConstant = texelFetch(lightData, index * 4 + 1);
+    vec4 diffuseLinear = texelFetch(lightData, index * 4 + 2);
+    vec4 specularQuadratic = texelFetch(lightData, index * 4 + 3);
+    float diff = max(dot(normal, toLight / distance), 0.0);
+    float attenuation = 1.0f / (ambientConstant.w + diffuseLinear.w * distance + specularQuadratic.w * (distance * distance));
+    COUNT(3, 0, 0, 14);
+    return diffuseLinear.rgb * (diff * attenuation * held) * albedo;
+}
+#endif
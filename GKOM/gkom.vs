@@ -2,18 +2,68 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 texCoords;
+// Only meshes unwrapped by LightmapBaker.h have these
+layout (location = 3) in vec2 lightmapCoords;
 
 
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
+out vec2 LightmapCoords;
+
+// The depth pre-pass (depth.vs) computes the same position, both must round identically for GL_EQUAL
+invariant gl_Position;
 
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Temporal upsampling (TemporalUpsampler.h): where the vertex is on screen, without the jitter, now and last frame
+#ifdef MOTION_VECTORS
+uniform mat4 previousModel;
+uniform mat4 currentViewProjection;
+uniform mat4 previousViewProjection;
+out vec4 CurrentClip;
+out vec4 PreviousClip;
+#endif
+
+// Light bounced off the static surfaces, from the 8 probes around the vertex (IrradianceProbes.h, PROBE_MAX matches it)
+#ifdef PROBES
+#define PROBE_MAX 64
+layout (std140) uniform IrradianceProbes
+{
+    vec4 probeFirst;
+    vec4 probeSpacing;
+    ivec4 probeCounts;
+    vec4 probeCoefficients[PROBE_MAX * 9];
+};
+out vec3 ProbeIrradiance;
+
+vec3 ProbeBounce(vec3 position, vec3 n)
+{
+    float basis[9] = float[9](0.282095, 0.488603 * n.y, 0.488603 * n.z, 0.488603 * n.x, 1.092548 * n.x * n.y,
+                              1.092548 * n.y * n.z, 0.315392 * (3.0 * n.z * n.z - 1.0), 1.092548 * n.x * n.z, 0.546274 * (n.x * n.x - n.y * n.y));
+    vec3 grid = clamp((position - probeFirst.xyz) / probeSpacing.xyz, vec3(0.0), vec3(probeCounts.xyz - 1));
+    ivec3 base = min(ivec3(grid), probeCounts.xyz - 2);
+    vec3 fraction = grid - vec3(base);
+    vec3 result = vec3(0.0);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        ivec3 offset = ivec3(corner & 1, (corner >> 1) & 1, corner >> 2);
+        vec3 weights = mix(1.0 - fraction, fraction, vec3(offset));
+        ivec3 cell = base + offset;
+        int probe = ((cell.z * probeCounts.y + cell.y) * probeCounts.x + cell.x) * 9;
+        vec3 irradiance = vec3(0.0);
+        for (int c = 0; c < 9; c++)
+            irradiance += probeCoefficients[probe + c].rgb * basis[c];
+        result += irradiance * (weights.x * weights.y * weights.z);
+    }
+    return max(result, vec3(0.0));
+}
+#endif
+
 
 void main()
 {
@@ -21,4 +71,12 @@ void main()
     FragPos = vec3(model* vec4(position, 1.0f));
     Normal = mat3(transpose(inverse(model))) * normal;  
     TexCoords = texCoords;
+    LightmapCoords = lightmapCoords;
+#ifdef PROBES
+    ProbeIrradiance = ProbeBounce(FragPos, normalize(Normal));
+#endif
+#ifdef MOTION_VECTORS
+    CurrentClip = currentViewProjection * vec4(FragPos, 1.0);
+    PreviousClip = previousViewProjection * previousModel * vec4(position, 1.0);
+#endif
 } 
\ No newline at end of file
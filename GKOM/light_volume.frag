@@ -0,0 +1,53 @@
+#version 330 core
+flat in int LightIndex;
+
+out vec4 color;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform samplerBuffer lightData;
+
+// Compiled with SHADOWS: the shadow maps of common.frag, shadowCount is 0 when they are off
+
+// Set when deferred_resolve.frag adds the image based ambient instead of the lights' ambient terms
+uniform bool environmentLighting;
+
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+uniform vec3 viewPos;
+uniform float shininess;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard;
+    // World position back from the depth buffer
+    vec4 clip = vec4(gl_FragCoord.xy / viewportSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+
+    vec4 positionRadius = texelFetch(lightData, LightIndex * 4);
+    float distance = length(positionRadius.xyz - fragPos);
+    if (distance > positionRadius.w)
+        discard;
+    vec4 ambientConstant = texelFetch(lightData, LightIndex * 4 + 1);
+    vec4 diffuseLinear = texelFetch(lightData, LightIndex * 4 + 2);
+    vec4 specularQuadratic = texelFetch(lightData, LightIndex * 4 + 3);
+    vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+    vec3 normal = DecodeNormal(texelFetch(gNormal, pixel, 0).rg);
+
+    // Same model as CalcPointLight in gkom.frag
+    vec3 lightDir = (positionRadius.xyz - fragPos) / distance;
+    vec3 viewDir = normalize(viewPos - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    float attenuation = 1.0f / (ambientConstant.w + diffuseLinear.w * distance + specularQuadratic.w * (distance * distance));
+    float shadow = Shadow(LightIndex, positionRadius.xyz - fragPos, distance);
+    vec3 ambient = environmentLighting ? vec3(0.0) : ambientConstant.rgb * albedo.rgb;
+    vec3 result = ambient + (diffuseLinear.rgb * diff * albedo.rgb + specularQuadratic.rgb * spec * albedo.a) * shadow;
+    color = vec4(result * attenuation, 1.0);
+}
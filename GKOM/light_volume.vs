@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+
+// One instance per light, 4 texels each (see ClusteredLights.h)
+uniform samplerBuffer lightData;
+uniform float volumeScale;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+flat out int LightIndex;
+
+void main()
+{
+    vec4 positionRadius = texelFetch(lightData, gl_InstanceID * 4);
+    gl_Position = projection * view * vec4(positionRadius.xyz + position * positionRadius.w * volumeScale, 1.0f);
+    LightIndex = gl_InstanceID;
+}
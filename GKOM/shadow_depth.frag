@@ -0,0 +1,11 @@
+#version 330 core
+in vec3 FragPos;
+
+uniform vec3 lightPos;
+uniform float farPlane;
+
+// Linear distance to the light rather than the projected depth, so one comparison works across all faces
+void main()
+{
+    gl_FragDepth = length(FragPos - lightPos) / farPlane;
+}
@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+
+uniform mat4 model;
+
+// World space, shadow_depth.gs projects it onto the six cube faces
+void main()
+{
+    gl_Position = model * vec4(position, 1.0f);
+}
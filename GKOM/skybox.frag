@@ -0,0 +1,14 @@
+#version 330 core
+in vec3 Direction;
+
+out vec4 color;
+// The temporal upsampling's motion target, if bound: no motion, like the empty pixels of the deferred path
+layout (location = 1) out vec2 motion;
+
+uniform samplerCube sky;
+
+void main()
+{
+    color = vec4(textureLod(sky, Direction, 0.0).rgb, 1.0);
+    motion = vec2(0.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+
+out vec3 Direction;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    Direction = position;
+    // z = w lands on the far plane after the divide, GL_LEQUAL then passes only where the depth is still cleared
+    gl_Position = (projection * view * vec4(position, 1.0)).xyww;
+}
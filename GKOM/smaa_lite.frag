@@ -0,0 +1,95 @@
+#version 330 core
+in vec2 TexCoords;
+
+out vec4 color;
+
+uniform sampler2D scene;
+uniform vec2 texelSize;
+
+// SMAA lite: the edge detection and shape based blending of SMAA/MLAA in one pass, without the precomputed area
+// textures. For each side of the pixel that is an edge, the run of that edge is followed both ways, and the step
+// at each end tells on which side of the edge the real (sloped) boundary lies. Where it lies on this pixel's side,
+// the pixel takes the triangle of the other color it covers: half at the run's end, down to none at its middle
+// (Z and U shapes) or at its far end (L shapes).
+const float SMAA_THRESHOLD = 0.1;
+// Local contrast adaptation: an edge much weaker than the strongest one around the pixel is texture, not a boundary
+const float SMAA_ADAPTATION = 2.0;
+const int SMAA_SEARCH = 8;
+
+ivec2 size;
+
+float Luma(ivec2 pixel)
+{
+    return dot(texelFetch(scene, clamp(pixel, ivec2(0), size - 1), 0).rgb, vec3(0.299, 0.587, 0.114));
+}
+
+bool IsEdge(ivec2 pixel, ivec2 across)
+{
+    return abs(Luma(pixel) - Luma(pixel + across)) > SMAA_THRESHOLD;
+}
+
+// Which way the boundary steps past the end of a run: 1 towards the pixel's side, -1 away, 0 no step found
+float Step(ivec2 beyond, ivec2 across)
+{
+    if (IsEdge(beyond, -across))
+        return 1.0;
+    if (IsEdge(beyond + across, across))
+        return -1.0;
+    return 0.0;
+}
+
+// Share of the pixel covered by the color across its edge towards across
+float Coverage(ivec2 pixel, ivec2 across)
+{
+    ivec2 along = ivec2(across.y, across.x);
+    int lengths[2];
+    float steps[2];
+    for (int side = 0; side < 2; side++)
+    {
+        ivec2 direction = side == 0 ? -along : along;
+        int length = 0;
+        while (length < SMAA_SEARCH && IsEdge(pixel + direction * (length + 1), across))
+            length++;
+        lengths[side] = length;
+        steps[side] = length < SMAA_SEARCH ? Step(pixel + direction * (length + 1), across) : 0.0;
+    }
+    float run = float(lengths[0] + lengths[1] + 1);
+    float coverage = 0.0;
+    for (int side = 0; side < 2; side++)
+    {
+        if (steps[side] <= 0.0)
+            continue;
+        // The boundary crosses the edge at the middle of the run when the other end steps too, at its far end otherwise
+        float span = steps[1 - side] != 0.0 ? run * 0.5 : run;
+        coverage += 0.5 * max(1.0 - (float(lengths[side]) + 0.5) / span, 0.0);
+    }
+    return min(coverage, 0.5);
+}
+
+void main()
+{
+    size = textureSize(scene, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 center = texelFetch(scene, pixel, 0).rgb;
+    const ivec2 sides[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+    float lumaM = Luma(pixel);
+    float deltas[4];
+    float strongest = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        deltas[i] = abs(lumaM - Luma(pixel + sides[i]));
+        strongest = max(strongest, deltas[i]);
+    }
+
+    vec3 result = center;
+    float total = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (deltas[i] <= SMAA_THRESHOLD || deltas[i] * SMAA_ADAPTATION < strongest)
+            continue;
+        float coverage = min(Coverage(pixel, sides[i]), 1.0 - total);
+        result += (texelFetch(scene, clamp(pixel + sides[i], ivec2(0), size - 1), 0).rgb - center) * coverage;
+        total += coverage;
+    }
+    color = vec4(result, 1.0);
+}
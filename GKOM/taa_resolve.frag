@@ -0,0 +1,65 @@
+#version 330 core
+in vec2 TexCoords;
+
+out vec4 color;
+
+// This frame at the reduced resolution, in the lower left renderSize pixels of the textures
+uniform sampler2D current;
+uniform sampler2D motion;
+uniform sampler2D depth;
+// The last reconstructed frame at the output resolution
+uniform sampler2D history;
+uniform bool historyValid;
+uniform vec2 renderSize;
+uniform vec2 outputSize;
+// Offset of this frame's samples in render pixels, the same one the projection was shifted by
+uniform vec2 jitter;
+uniform float feedback;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / outputSize;
+    // The output pixel in render pixels, without the jitter. Render pixel i was shaded at i + 0.5 - jitter
+    vec2 position = uv * renderSize;
+    ivec2 nearest = ivec2(floor(position + jitter));
+    ivec2 last = ivec2(renderSize) - 1;
+
+    // 3x3 neighbourhood: the range the history is clamped to, and the motion of the closest surface in it, so
+    // the edges of moving objects keep their motion
+    vec3 lower = vec3(1e9), upper = vec3(-1e9);
+    float closest = 1.0;
+    ivec2 closestPixel = clamp(nearest, ivec2(0), last);
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+        {
+            ivec2 pixel = clamp(nearest + ivec2(x, y), ivec2(0), last);
+            vec3 neighbour = texelFetch(current, pixel, 0).rgb;
+            lower = min(lower, neighbour);
+            upper = max(upper, neighbour);
+            float sampleDepth = texelFetch(depth, pixel, 0).r;
+            if (sampleDepth < closest)
+            {
+                closest = sampleDepth;
+                closestPixel = pixel;
+            }
+        }
+
+    // Bilinear between this frame's samples, what the pixel shows without a usable history
+    vec2 texel = clamp(position + jitter, vec2(0.5), renderSize - 0.5);
+    vec3 upsampled = texture(current, texel / vec2(textureSize(current, 0))).rgb;
+
+    // Where the surface was last frame. Pixels nothing was drawn on keep the cleared, zero motion
+    vec2 previous = uv - texelFetch(motion, closestPixel, 0).rg;
+    if (!historyValid || any(lessThan(previous, vec2(0.0))) || any(greaterThan(previous, vec2(1.0))))
+    {
+        color = vec4(upsampled, 1.0);
+        return;
+    }
+
+    // The nearest sample goes in by how close it landed to the pixel's center, measured in output pixels
+    vec2 offset = (position - (vec2(nearest) + 0.5 - jitter)) * outputSize / renderSize;
+    float weight = exp(-2.29 * dot(offset, offset));
+    vec3 shaded = texelFetch(current, clamp(nearest, ivec2(0), last), 0).rgb;
+    vec3 accumulated = clamp(texture(history, previous).rgb, lower, upper);
+    color = vec4(mix(accumulated, shaded, feedback * weight), 1.0);
+}
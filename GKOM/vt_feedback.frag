@@ -0,0 +1,20 @@
+#version 330 core
+in vec2 TexCoords;
+
+out vec4 color;
+
+uniform float vtVirtualSize;
+uniform float vtTileSize;
+uniform float vtMaxMip;
+uniform float vtLodBias;
+
+// Writes the page (x, y, mip) this fragment needs, the application reads it back to stream tiles
+void main()
+{
+    vec2 texel = TexCoords * vtVirtualSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float mip = clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias), 0.0, vtMaxMip);
+    ivec2 page = ivec2(fract(TexCoords) * (vtVirtualSize / vtTileSize)) >> int(mip);
+    color = vec4(vec3(page, mip) / 255.0, 1.0);
+}